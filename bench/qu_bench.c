@@ -0,0 +1,389 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2023 kelbeppin
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+// qu_bench.c: rendering benchmarks
+//------------------------------------------------------------------------------
+// Usage: qu_bench [--renderer null|gl3|gl1|es2] [--frames N] [--warmup N]
+//                 [--font PATH] [--render-thread] [--output PATH]
+//
+// Every scenario is run for a fixed number of frames after warm-up.
+// With "null" renderer no graphics context is created, so only the cost
+// of recording and executing commands on CPU is measured. Other renderers
+// use headless OpenGL context. Results are written as JSON.
+//------------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libqu.h>
+
+//------------------------------------------------------------------------------
+
+// Hidden functions, see src/qu.h.
+QU_API void QU_CALL qu_set_desired_graphics_api(char const *api);
+QU_API uint64_t QU_CALL qu_get_allocation_count(void);
+
+//------------------------------------------------------------------------------
+
+#define WIDTH               1280
+#define HEIGHT              720
+#define MAX_DRAWS           50000
+#define MAX_FRAMES          10000
+#define TOTAL_TEXTURES      16
+#define TEXTURE_SIZE        32
+#define SURFACE_SIZE        256
+#define TRANSIENT_SIZE      64
+
+//------------------------------------------------------------------------------
+
+struct scenario
+{
+    char const *name;
+    int draws;
+    bool needs_font;
+    void (*draw)(int draws);
+};
+
+struct result
+{
+    double ns_per_draw;
+    double allocations_per_frame;
+    double mean;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+};
+
+static struct
+{
+    char const *renderer;
+    char const *font_path;
+    char const *output_path;
+    bool render_thread;
+    int frames;
+    int warmup;
+
+    float x[MAX_DRAWS];
+    float y[MAX_DRAWS];
+    qu_color colors[MAX_DRAWS];
+
+    qu_texture textures[TOTAL_TEXTURES];
+    qu_surface surfaces[2];
+    qu_font font;
+
+    double frame_times[MAX_FRAMES];
+} bench;
+
+//------------------------------------------------------------------------------
+// Scenarios
+
+static void draw_sprites_one_texture(int draws)
+{
+    for (int i = 0; i < draws; i++) {
+        qu_draw_texture(bench.textures[0], bench.x[i], bench.y[i], TEXTURE_SIZE, TEXTURE_SIZE);
+    }
+}
+
+static void draw_sprites_many_textures(int draws)
+{
+    for (int i = 0; i < draws; i++) {
+        qu_texture texture = bench.textures[i % TOTAL_TEXTURES];
+        qu_draw_texture(texture, bench.x[i], bench.y[i], TEXTURE_SIZE, TEXTURE_SIZE);
+    }
+}
+
+static void draw_rectangles(int draws)
+{
+    for (int i = 0; i < draws; i++) {
+        qu_draw_rectangle(bench.x[i], bench.y[i], 24.f, 16.f, bench.colors[i], bench.colors[draws - i - 1]);
+    }
+}
+
+static void draw_circles(int draws)
+{
+    for (int i = 0; i < draws; i++) {
+        qu_draw_circle(bench.x[i], bench.y[i], 12.f, bench.colors[i], bench.colors[draws - i - 1]);
+    }
+}
+
+static void draw_text(int draws)
+{
+    for (int i = 0; i < draws; i++) {
+        qu_draw_text(bench.font, bench.x[i], bench.y[i], bench.colors[i],
+                     "The quick brown fox jumps over the lazy dog.");
+    }
+}
+
+// Each pass draws one surface into the other one.
+static void draw_surface_ping_pong(int draws)
+{
+    for (int i = 0; i < draws; i++) {
+        qu_surface src = bench.surfaces[i % 2];
+        qu_surface dst = bench.surfaces[(i + 1) % 2];
+
+        qu_set_surface(dst);
+        qu_clear(bench.colors[i]);
+        qu_draw_surface(src, 8.f, 8.f, SURFACE_SIZE - 16.f, SURFACE_SIZE - 16.f);
+    }
+
+    qu_reset_surface();
+    qu_draw_surface(bench.surfaces[draws % 2], 0.f, 0.f, SURFACE_SIZE, SURFACE_SIZE);
+}
+
+// Each pass renders into a temporary surface, which is drawn afterwards.
+static void draw_transient_surfaces(int draws)
+{
+    for (int i = 0; i < draws; i++) {
+        qu_surface surface = qu_create_transient_surface(TRANSIENT_SIZE, TRANSIENT_SIZE, 0);
+
+        qu_set_surface(surface);
+        qu_clear(bench.colors[i]);
+        qu_draw_circle(TRANSIENT_SIZE / 2.f, TRANSIENT_SIZE / 2.f, TRANSIENT_SIZE / 3.f, 0, bench.colors[draws - i - 1]);
+        qu_reset_surface();
+
+        qu_draw_surface(surface, bench.x[i], bench.y[i], TRANSIENT_SIZE, TRANSIENT_SIZE);
+    }
+}
+
+static struct scenario const scenarios[] = {
+    { "sprites_10k_one_texture", 10000, false, draw_sprites_one_texture },
+    { "sprites_50k_one_texture", 50000, false, draw_sprites_one_texture },
+    { "sprites_10k_many_textures", 10000, false, draw_sprites_many_textures },
+    { "sprites_50k_many_textures", 50000, false, draw_sprites_many_textures },
+    { "rectangles_10k", 10000, false, draw_rectangles },
+    { "circles_10k", 10000, false, draw_circles },
+    { "text_1k", 1000, true, draw_text },
+    { "surface_ping_pong_100", 100, false, draw_surface_ping_pong },
+    { "transient_surfaces_100", 100, false, draw_transient_surfaces },
+};
+
+//------------------------------------------------------------------------------
+
+// Fixed seed, so that every run draws the same thing.
+static void generate_data(void)
+{
+    uint32_t state = 1;
+
+    for (int i = 0; i < MAX_DRAWS; i++) {
+        state = state * 1664525u + 1013904223u;
+        bench.x[i] = (float) (state % WIDTH);
+
+        state = state * 1664525u + 1013904223u;
+        bench.y[i] = (float) (state % HEIGHT);
+
+        state = state * 1664525u + 1013904223u;
+        bench.colors[i] = QU_COLOR(state >> 24, (state >> 16) & 0xFF, (state >> 8) & 0xFF);
+    }
+}
+
+static void create_resources(void)
+{
+    for (int i = 0; i < TOTAL_TEXTURES; i++) {
+        bench.textures[i] = qu_create_texture(TEXTURE_SIZE, TEXTURE_SIZE, 4);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        bench.surfaces[i] = qu_create_surface(SURFACE_SIZE, SURFACE_SIZE);
+    }
+
+    if (bench.font_path) {
+        bench.font = qu_load_font(bench.font_path, 12.f);
+    }
+}
+
+static int compare_doubles(void const *a, void const *b)
+{
+    double x = *(double const *) a;
+    double y = *(double const *) b;
+
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted array.
+static double percentile(double const *sorted, int count, double p)
+{
+    int rank = (int) ceil(p / 100.0 * count);
+    return sorted[QU_MAX(rank, 1) - 1];
+}
+
+static void run_scenario(struct scenario const *scenario, struct result *result)
+{
+    for (int i = 0; i < bench.warmup; i++) {
+        qu_process();
+        qu_clear(QU_COLOR(0, 0, 0));
+        scenario->draw(scenario->draws);
+        qu_present();
+    }
+
+    uint64_t allocations = qu_get_allocation_count();
+    double total = 0.0;
+
+    for (int i = 0; i < bench.frames; i++) {
+        double start = qu_get_time_highp();
+
+        qu_process();
+        qu_clear(QU_COLOR(0, 0, 0));
+        scenario->draw(scenario->draws);
+        qu_present();
+
+        bench.frame_times[i] = qu_get_time_highp() - start;
+        total += bench.frame_times[i];
+    }
+
+    allocations = qu_get_allocation_count() - allocations;
+
+    qsort(bench.frame_times, bench.frames, sizeof(double), compare_doubles);
+
+    result->ns_per_draw = total * 1e9 / ((double) bench.frames * scenario->draws);
+    result->allocations_per_frame = (double) allocations / bench.frames;
+    result->mean = total * 1e3 / bench.frames;
+    result->p50 = percentile(bench.frame_times, bench.frames, 50.0) * 1e3;
+    result->p90 = percentile(bench.frame_times, bench.frames, 90.0) * 1e3;
+    result->p99 = percentile(bench.frame_times, bench.frames, 99.0) * 1e3;
+    result->max = bench.frame_times[bench.frames - 1] * 1e3;
+}
+
+static void write_result(FILE *file, struct scenario const *scenario,
+                         struct result const *result, bool last)
+{
+    fprintf(file, "    {\n");
+    fprintf(file, "      \"name\": \"%s\",\n", scenario->name);
+
+    if (!result) {
+        fprintf(file, "      \"skipped\": true\n");
+    } else {
+        fprintf(file, "      \"draws_per_frame\": %d,\n", scenario->draws);
+        fprintf(file, "      \"ns_per_draw\": %.2f,\n", result->ns_per_draw);
+        fprintf(file, "      \"allocations_per_frame\": %.2f,\n", result->allocations_per_frame);
+        fprintf(file, "      \"frame_ms\": {\n");
+        fprintf(file, "        \"mean\": %.4f,\n", result->mean);
+        fprintf(file, "        \"p50\": %.4f,\n", result->p50);
+        fprintf(file, "        \"p90\": %.4f,\n", result->p90);
+        fprintf(file, "        \"p99\": %.4f,\n", result->p99);
+        fprintf(file, "        \"max\": %.4f\n", result->max);
+        fprintf(file, "      }\n");
+    }
+
+    fprintf(file, "    }%s\n", last ? "" : ",");
+}
+
+static bool parse_arguments(int argc, char **argv)
+{
+    bench.renderer = "null";
+    bench.frames = 300;
+    bench.warmup = 30;
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = (i + 1) < argc;
+
+        if (!strcmp(argv[i], "--renderer") && has_value) {
+            bench.renderer = argv[++i];
+        } else if (!strcmp(argv[i], "--frames") && has_value) {
+            bench.frames = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--warmup") && has_value) {
+            bench.warmup = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--font") && has_value) {
+            bench.font_path = argv[++i];
+        } else if (!strcmp(argv[i], "--output") && has_value) {
+            bench.output_path = argv[++i];
+        } else if (!strcmp(argv[i], "--render-thread")) {
+            bench.render_thread = true;
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            return false;
+        }
+    }
+
+    if (bench.frames < 1 || bench.frames > MAX_FRAMES || bench.warmup < 0) {
+        fprintf(stderr, "Number of frames should be in range [1, %d].\n", MAX_FRAMES);
+        return false;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    if (!parse_arguments(argc, argv)) {
+        return EXIT_FAILURE;
+    }
+
+    generate_data();
+
+    qu_set_desired_graphics_api(bench.renderer);
+    qu_set_window_flags(QU_WINDOW_HEADLESS);
+    qu_set_window_size(WIDTH, HEIGHT);
+
+    if (bench.render_thread) {
+        qu_set_graphics_flags(QU_GRAPHICS_RENDER_THREAD);
+    }
+
+    qu_initialize();
+    create_resources();
+
+    FILE *file = stdout;
+
+    if (bench.output_path) {
+        file = fopen(bench.output_path, "w");
+
+        if (!file) {
+            fprintf(stderr, "Failed to open %s.\n", bench.output_path);
+            qu_terminate();
+            return EXIT_FAILURE;
+        }
+    }
+
+    int total_scenarios = sizeof(scenarios) / sizeof(scenarios[0]);
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"renderer\": \"%s\",\n", bench.renderer);
+    fprintf(file, "  \"render_thread\": %s,\n", bench.render_thread ? "true" : "false");
+    fprintf(file, "  \"frames\": %d,\n", bench.frames);
+    fprintf(file, "  \"warmup\": %d,\n", bench.warmup);
+    fprintf(file, "  \"scenarios\": [\n");
+
+    for (int i = 0; i < total_scenarios; i++) {
+        struct scenario const *scenario = &scenarios[i];
+        bool last = (i == total_scenarios - 1);
+
+        if (scenario->needs_font && !bench.font.id) {
+            write_result(file, scenario, NULL, last);
+            continue;
+        }
+
+        struct result result;
+        run_scenario(scenario, &result);
+        write_result(file, scenario, &result, last);
+    }
+
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    if (file != stdout) {
+        fclose(file);
+    }
+
+    qu_terminate();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2023 kelbeppin
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+// qu_replay.c: frame capture replayer
+//------------------------------------------------------------------------------
+// Usage: qu_replay [--renderer null|gl3|gl1|es2] [--size WxH] [--repeat N]
+//                  [--render-thread] [--output PATH] CAPTURE
+//
+// Replays frames captured with qu_capture_frames() on headless context.
+// Resources of the capture are created before the first frame and aren't
+// included in frame time. Results are written as JSON.
+//------------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libqu.h>
+
+//------------------------------------------------------------------------------
+
+// Hidden functions, see src/qu.h.
+QU_API void QU_CALL qu_set_desired_graphics_api(char const *api);
+QU_API int QU_CALL qu_replay_frames(char const *path, double *frame_times, int max_frames);
+
+//------------------------------------------------------------------------------
+
+#define MAX_FRAMES          100000
+
+//------------------------------------------------------------------------------
+
+static struct
+{
+    char const *renderer;
+    char const *capture_path;
+    char const *output_path;
+    bool render_thread;
+    int width;
+    int height;
+    int repeat;
+
+    double frame_times[MAX_FRAMES];
+    int total_frames;
+} replay;
+
+//------------------------------------------------------------------------------
+
+static int compare_doubles(void const *a, void const *b)
+{
+    double x = *(double const *) a;
+    double y = *(double const *) b;
+
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted array.
+static double percentile(double const *sorted, int count, double p)
+{
+    int rank = (int) ceil(p / 100.0 * count);
+    return sorted[QU_MAX(rank, 1) - 1];
+}
+
+static bool parse_arguments(int argc, char **argv)
+{
+    replay.renderer = "gl3";
+    replay.width = 1280;
+    replay.height = 720;
+    replay.repeat = 1;
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = (i + 1) < argc;
+
+        if (!strcmp(argv[i], "--renderer") && has_value) {
+            replay.renderer = argv[++i];
+        } else if (!strcmp(argv[i], "--size") && has_value) {
+            if (sscanf(argv[++i], "%dx%d", &replay.width, &replay.height) != 2) {
+                fprintf(stderr, "Invalid size: %s\n", argv[i]);
+                return false;
+            }
+        } else if (!strcmp(argv[i], "--repeat") && has_value) {
+            replay.repeat = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--output") && has_value) {
+            replay.output_path = argv[++i];
+        } else if (!strcmp(argv[i], "--render-thread")) {
+            replay.render_thread = true;
+        } else if (argv[i][0] != '-' && !replay.capture_path) {
+            replay.capture_path = argv[i];
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            return false;
+        }
+    }
+
+    if (!replay.capture_path) {
+        fprintf(stderr, "Capture file is not specified.\n");
+        return false;
+    }
+
+    if (replay.repeat < 1 || replay.width < 1 || replay.height < 1) {
+        fprintf(stderr, "Invalid arguments.\n");
+        return false;
+    }
+
+    return true;
+}
+
+static void write_results(FILE *file, int frames_per_run)
+{
+    double total = 0.0;
+
+    for (int i = 0; i < replay.total_frames; i++) {
+        total += replay.frame_times[i];
+    }
+
+    qsort(replay.frame_times, replay.total_frames, sizeof(double), compare_doubles);
+
+    double const *sorted = replay.frame_times;
+    int count = replay.total_frames;
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"capture\": \"%s\",\n", replay.capture_path);
+    fprintf(file, "  \"renderer\": \"%s\",\n", replay.renderer);
+    fprintf(file, "  \"render_thread\": %s,\n", replay.render_thread ? "true" : "false");
+    fprintf(file, "  \"repeat\": %d,\n", replay.repeat);
+    fprintf(file, "  \"frames_per_run\": %d,\n", frames_per_run);
+    fprintf(file, "  \"frame_ms\": {\n");
+    fprintf(file, "    \"mean\": %.4f,\n", count ? total * 1e3 / count : 0.0);
+    fprintf(file, "    \"p50\": %.4f,\n", count ? percentile(sorted, count, 50.0) * 1e3 : 0.0);
+    fprintf(file, "    \"p90\": %.4f,\n", count ? percentile(sorted, count, 90.0) * 1e3 : 0.0);
+    fprintf(file, "    \"p99\": %.4f,\n", count ? percentile(sorted, count, 99.0) * 1e3 : 0.0);
+    fprintf(file, "    \"max\": %.4f\n", count ? sorted[count - 1] * 1e3 : 0.0);
+    fprintf(file, "  }\n");
+    fprintf(file, "}\n");
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    if (!parse_arguments(argc, argv)) {
+        return EXIT_FAILURE;
+    }
+
+    qu_set_desired_graphics_api(replay.renderer);
+    qu_set_window_flags(QU_WINDOW_HEADLESS);
+    qu_set_window_size(replay.width, replay.height);
+
+    if (replay.render_thread) {
+        qu_set_graphics_flags(QU_GRAPHICS_RENDER_THREAD);
+    }
+
+    qu_initialize();
+
+    int frames_per_run = 0;
+
+    for (int i = 0; i < replay.repeat; i++) {
+        int max_frames = MAX_FRAMES - replay.total_frames;
+        int frames = qu_replay_frames(replay.capture_path, &replay.frame_times[replay.total_frames], max_frames);
+
+        if (frames < 0) {
+            fprintf(stderr, "Failed to replay %s.\n", replay.capture_path);
+            qu_terminate();
+            return EXIT_FAILURE;
+        }
+
+        frames_per_run = frames;
+        replay.total_frames += QU_MIN(frames, max_frames);
+    }
+
+    FILE *file = stdout;
+
+    if (replay.output_path) {
+        file = fopen(replay.output_path, "w");
+
+        if (!file) {
+            fprintf(stderr, "Failed to open %s.\n", replay.output_path);
+            qu_terminate();
+            return EXIT_FAILURE;
+        }
+    }
+
+    write_results(file, frames_per_run);
+
+    if (file != stdout) {
+        fclose(file);
+    }
+
+    qu_terminate();
+
+    return EXIT_SUCCESS;
+}
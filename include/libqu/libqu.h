@@ -243,6 +243,13 @@ typedef uint64_t qu_color;
 typedef enum qu_window_flags
 {
     QU_WINDOW_USE_CANVAS = 0x0001,
+
+    /**
+     * Don't create a window, render to an offscreen buffer
+     * of the window size instead. Used automatically on Linux
+     * when there is no X11 display. Requires EGL.
+     */
+    QU_WINDOW_HEADLESS = 0x0002,
 } qu_window_flags;
 
 /**
@@ -253,6 +260,67 @@ typedef enum qu_canvas_flags
     QU_CANVAS_SMOOTH = 0x0001,
 } qu_canvas_flags;
 
+/**
+ * Graphics flags.
+ */
+typedef enum qu_graphics_flags
+{
+    /**
+     * Apply transformations to vertices on CPU when draw
+     * functions are called. Matrix functions don't break
+     * batches, but the cost of each draw call is higher.
+     */
+    QU_GRAPHICS_CPU_TRANSFORMS = 0x0001,
+
+    /**
+     * Execute draw calls on a separate thread which owns the
+     * graphics context. The next frame is recorded while the
+     * previous one is being rendered. Ignored on platforms
+     * which don't support it.
+     */
+    QU_GRAPHICS_RENDER_THREAD = 0x0002,
+
+    /**
+     * Count and time calls to the renderer.
+     * Results are available with qu_get_frame_stats().
+     */
+    QU_GRAPHICS_RENDERER_STATS = 0x0004,
+
+    /**
+     * Measure GPU time spent on each surface pass.
+     * Results arrive a few frames late and are available
+     * with qu_get_surface_gpu_time() and related functions.
+     * Only supported by the OpenGL 3.3 renderer.
+     */
+    QU_GRAPHICS_GPU_TIMERS = 0x0008,
+
+    /**
+     * Allow capturing frames to a file with qu_capture_frames().
+     */
+    QU_GRAPHICS_FRAME_CAPTURE = 0x0010,
+} qu_graphics_flags;
+
+/**
+ * Texture flags.
+ */
+typedef enum qu_texture_flags
+{
+    /**
+     * Place textures loaded from images into shared atlas pages,
+     * so drawing different textures doesn't break batches.
+     * Atlas textures can't be resized or smoothed individually.
+     */
+    QU_TEXTURE_ATLAS = 0x0001,
+
+    /**
+     * Free CPU copy of pixels of textures loaded with qu_load_texture()
+     * and qu_load_texture_from_memory() once they are uploaded.
+     * These textures are decoded again from their source after
+     * graphics context loss, and can't be updated or resized.
+     */
+    QU_TEXTURE_GPU_ONLY = 0x0002,
+} qu_texture_flags;
+
 /**
  * Keys of keyboard.
  */
@@ -425,6 +493,38 @@ typedef enum qu_blend_equation
     QU_BLEND_REV_SUB,           /*!< `dst * dfactor - src * sfactor` */
 } qu_blend_equation;
 
+/**
+ * Renderer functions, as reported in frame statistics.
+ */
+typedef enum qu_renderer_function
+{
+    QU_RENDERER_FUNCTION_UPLOAD_VERTEX_DATA,
+    QU_RENDERER_FUNCTION_UPLOAD_INDEX_DATA,
+    QU_RENDERER_FUNCTION_APPLY_PROJECTION,
+    QU_RENDERER_FUNCTION_APPLY_TRANSFORM,
+    QU_RENDERER_FUNCTION_APPLY_SURFACE,
+    QU_RENDERER_FUNCTION_APPLY_TEXTURE,
+    QU_RENDERER_FUNCTION_APPLY_CLEAR_COLOR,
+    QU_RENDERER_FUNCTION_APPLY_DRAW_COLOR,
+    QU_RENDERER_FUNCTION_APPLY_BRUSH,
+    QU_RENDERER_FUNCTION_APPLY_VERTEX_FORMAT,
+    QU_RENDERER_FUNCTION_APPLY_BLEND_MODE,
+    QU_RENDERER_FUNCTION_EXEC_RESIZE,
+    QU_RENDERER_FUNCTION_EXEC_CLEAR,
+    QU_RENDERER_FUNCTION_EXEC_DRAW,
+    QU_RENDERER_FUNCTION_EXEC_DRAW_INDEXED,
+    QU_RENDERER_FUNCTION_EXEC_DRAW_INSTANCED,
+    QU_RENDERER_FUNCTION_LOAD_TEXTURE,
+    QU_RENDERER_FUNCTION_UPDATE_TEXTURE_REGION,
+    QU_RENDERER_FUNCTION_UNLOAD_TEXTURE,
+    QU_RENDERER_FUNCTION_SET_TEXTURE_SMOOTH,
+    QU_RENDERER_FUNCTION_SET_TEXTURE_MIPMAPS,
+    QU_RENDERER_FUNCTION_CREATE_SURFACE,
+    QU_RENDERER_FUNCTION_DESTROY_SURFACE,
+    QU_RENDERER_FUNCTION_SET_SURFACE_ANTIALIASING_LEVEL,
+    QU_TOTAL_RENDERER_FUNCTIONS,
+} qu_renderer_function;
+
 /**
  * Two-dimensional vector of floating-point values.
  */
@@ -467,6 +567,14 @@ typedef struct qu_surface
     int32_t id;                 /*!< Identifier */
 } qu_surface;
 
+/**
+ * Draw context handle.
+ */
+typedef struct qu_draw_context
+{
+    int32_t id;                 /*!< Identifier */
+} qu_draw_context;
+
 /**
  * Font handle.
  */
@@ -539,6 +647,51 @@ typedef struct qu_blend_mode
     qu_blend_equation alpha_equation; /*!< Alpha equation */
 } qu_blend_mode;
 
+/**
+ * Sprite.
+ *
+ * This structure describes a single sprite drawn with `qu_draw_sprites()`.
+ * Sprite is rotated around its origin, which is placed at (x, y).
+ */
+typedef struct qu_sprite
+{
+    float x;                        /*!< X position of the origin */
+    float y;                        /*!< Y position of the origin */
+    float w;                        /*!< Width */
+    float h;                        /*!< Height */
+    float rx;                       /*!< X of the source rectangle in texture (in pixels) */
+    float ry;                       /*!< Y of the source rectangle in texture (in pixels) */
+    float rw;                       /*!< Width of the source rectangle in texture (in pixels) */
+    float rh;                       /*!< Height of the source rectangle in texture (in pixels) */
+    float rot;                      /*!< Rotation (in degrees) */
+    float ox;                       /*!< X of the origin relative to the top-left corner */
+    float oy;                       /*!< Y of the origin relative to the top-left corner */
+    qu_color color;                 /*!< Tint color */
+} qu_sprite;
+
+/**
+ * Frame statistics.
+ *
+ * Collected when QU_GRAPHICS_RENDERER_STATS flag is set.
+ * Describes everything the renderer did during the last presented frame.
+ */
+typedef struct qu_frame_stats
+{
+    int draw_calls;                 /*!< Number of draw calls */
+    int vertices;                   /*!< Number of vertices drawn (indices for indexed draws) */
+    int texture_binds;              /*!< Number of texture changes */
+    int program_switches;           /*!< Number of brush (shader program) changes */
+    int surface_switches;           /*!< Number of surface changes */
+    int texture_uploads;            /*!< Number of whole or partial texture uploads */
+    int eliminated_commands;        /*!< Number of redundant commands removed before execution */
+    int culled_draws;               /*!< Number of draws (or sprites) outside of the view skipped while recording */
+    size_t vertex_bytes;            /*!< Size of uploaded vertex data (in bytes) */
+    double renderer_time;           /*!< Time spent in the renderer (in seconds) */
+
+    int calls[QU_TOTAL_RENDERER_FUNCTIONS];         /*!< Calls of each renderer function */
+    double call_times[QU_TOTAL_RENDERER_FUNCTIONS]; /*!< Time spent in each function (in seconds) */
+} qu_frame_stats;
+
 /**
  * Update function.
  * @return 0 if the loop should continue running, any other value if not.
@@ -1094,11 +1247,66 @@ QU_API unsigned int QU_CALL qu_get_canvas_flags(void);
  */
 QU_API void QU_CALL qu_set_canvas_flags(unsigned int flags);
 
+/**
+ * Get current graphics flags.
+ * 
+ * @return Graphics flag bitmask.
+ */
+QU_API unsigned int QU_CALL qu_get_graphics_flags(void);
+
+/**
+ * Set graphics flags.
+ * 
+ * Use this function before calling qu_initialize().
+ * 
+ * @param flags Graphics flag bitmask.
+ * @sa qu_graphics_flags
+ */
+QU_API void QU_CALL qu_set_graphics_flags(unsigned int flags);
+
+/**
+ * Get renderer statistics of the last presented frame.
+ * Everything is zero unless QU_GRAPHICS_RENDERER_STATS is set.
+ */
+QU_API void QU_CALL qu_get_frame_stats(qu_frame_stats *stats);
+
+/**
+ * Get name of renderer function, e.g. "exec_draw".
+ */
+QU_API char const * QU_CALL qu_get_renderer_function_name(qu_renderer_function function);
+
+/**
+ * Capture renderer calls of the following frames to a file.
+ * Capture starts with the frame after the current one and includes
+ * textures and surfaces which exist at that moment.
+ * Captured frames can be replayed with qu_replay tool.
+ * Requires QU_GRAPHICS_FRAME_CAPTURE flag.
+ *
+ * @param path Path to the capture file.
+ * @param count Number of frames to capture.
+ * @return False if capture isn't enabled or is already in progress.
+ */
+QU_API bool QU_CALL qu_capture_frames(char const *path, int count);
+
 /**
  * Set blend mode.
  */
 QU_API void QU_CALL qu_set_blend_mode(qu_blend_mode mode);
 
+/**
+ * Set layer of subsequent draw calls.
+ * 
+ * Once this function is called, draw calls are sorted by layer,
+ * then by blend mode, shader and texture to reduce state changes.
+ * Layers are drawn in ascending order, but order of draw calls
+ * within the same layer is not preserved.
+ * Draw calls are not moved across surface, view, transformation
+ * and clear commands.
+ * 
+ * @param layer Layer index, from -32768 to 32767. Default is 0.
+ */
+QU_API void QU_CALL qu_set_draw_layer(int layer);
+
 /**
  * Clear the screen with a specified color.
  *
@@ -1309,6 +1517,23 @@ QU_API void QU_CALL qu_fill_image(qu_image image, uint32_t value);
  * @{
  */
 
+/**
+ * Get current texture flags.
+ * 
+ * @return Texture flag bitmask.
+ */
+QU_API unsigned int QU_CALL qu_get_texture_flags(void);
+
+/**
+ * Set texture flags. They are applied to textures
+ * created with qu_create_texture_from_image(), qu_load_texture() and
+ * qu_load_texture_from_memory() after this call.
+ * 
+ * @param flags Texture flag bitmask.
+ * @sa qu_texture_flags
+ */
+QU_API void QU_CALL qu_set_texture_flags(unsigned int flags);
+
 /**
  * Create empty texture. Usable with qu_update_texture().
  */
@@ -1321,9 +1546,40 @@ QU_API qu_texture QU_CALL qu_create_texture_from_image(qu_image image);
 
 /**
  * Load texture from given path.
+ * BC1, BC3 and BC7 textures in DDS or KTX2 files stay compressed
+ * in video memory if supported, and are decompressed otherwise.
+ * Compressed textures can't be updated, resized or mipmapped.
  */
 QU_API qu_texture QU_CALL qu_load_texture(char const *path);
 
+/**
+ * Load texture from image file in memory.
+ * If QU_TEXTURE_GPU_ONLY is set, the buffer should remain valid
+ * until the texture is deleted.
+ */
+QU_API qu_texture QU_CALL qu_load_texture_from_memory(void *buffer, size_t size);
+
+/**
+ * Load texture from given path in background.
+ * Handle is returned immediately, but the texture isn't drawn
+ * until it's decoded and uploaded by one of the following
+ * qu_present() calls. Texture flags are applied at the time
+ * of this call.
+ * If loading fails, the handle becomes invalid.
+ */
+QU_API qu_texture QU_CALL qu_load_texture_async(char const *path);
+
+/**
+ * Check if texture is ready to be drawn.
+ * Returns false while it's being loaded, or if it's not valid.
+ */
+QU_API bool QU_CALL qu_is_texture_loaded(qu_texture texture);
+
+/**
+ * Get number of textures which are still being loaded in background.
+ */
+QU_API int QU_CALL qu_get_pending_texture_loads(void);
+
 /**
  * Delete texture.
  */
@@ -1339,6 +1595,13 @@ QU_API void QU_CALL qu_update_texture(qu_texture texture, qu_image image);
  */
 QU_API void QU_CALL qu_set_texture_smooth(qu_texture texture, bool smooth);
 
+/**
+ * Enable or disable mipmaps. Mipmaps make textures drawn at smaller
+ * size look smoother. They are regenerated when the texture is updated.
+ * Has no effect on atlas textures.
+ */
+QU_API void QU_CALL qu_set_texture_mipmaps(qu_texture texture, bool mipmaps);
+
 /**
  * Draw texture on the screen.
  */
@@ -1352,6 +1615,13 @@ QU_API void QU_CALL qu_draw_subtexture(qu_texture texture,
     float x, float y, float w, float h,
     float rx, float ry, float rw, float rh);
 
+/**
+ * Draw multiple sprites which use the same texture.
+ * This is much faster than calling `qu_draw_subtexture()` for each sprite.
+ */
+QU_API void QU_CALL qu_draw_sprites(qu_texture texture,
+    qu_sprite const *sprites, int count);
+
 /**@}*/
 
 /**
@@ -1364,6 +1634,14 @@ QU_API void QU_CALL qu_draw_subtexture(qu_texture texture,
  */
 QU_API qu_surface QU_CALL qu_create_surface(int width, int height);
 
+/**
+ * Create surface which is deleted when the frame is presented.
+ * Deleted surfaces are pooled and reused by new surfaces of the same
+ * size and antialiasing level, so creating temporary surfaces every
+ * frame doesn't allocate anything.
+ */
+QU_API qu_surface QU_CALL qu_create_transient_surface(int width, int height, int antialiasing_level);
+
 /**
  * Delete surface.
  */
@@ -1394,6 +1672,70 @@ QU_API void QU_CALL qu_reset_surface(void);
  */
 QU_API void QU_CALL qu_draw_surface(qu_surface surface, float x, float y, float w, float h);
 
+/**
+ * Get GPU time (in seconds) spent drawing to the surface
+ * during the last measured frame. All passes to the same
+ * surface are summed, including multisample resolve.
+ * Zero unless QU_GRAPHICS_GPU_TIMERS is set.
+ */
+QU_API double QU_CALL qu_get_surface_gpu_time(qu_surface surface);
+
+/**
+ * Get GPU time (in seconds) spent drawing to the canvas
+ * during the last measured frame.
+ */
+QU_API double QU_CALL qu_get_canvas_gpu_time(void);
+
+/**
+ * Get GPU time (in seconds) spent drawing to the display
+ * during the last measured frame. If canvas is used, this
+ * is the time of the canvas flush.
+ */
+QU_API double QU_CALL qu_get_display_gpu_time(void);
+
+/**@}*/
+
+/**
+ * @name Draw contexts
+ * @{
+ */
+
+/**
+ * Create draw context.
+ * Draw contexts allow other threads to record draw calls which are
+ * later submitted by the main thread.
+ */
+QU_API qu_draw_context QU_CALL qu_create_draw_context(void);
+
+/**
+ * Delete draw context.
+ */
+QU_API void QU_CALL qu_delete_draw_context(qu_draw_context context);
+
+/**
+ * Start recording to the draw context from the calling thread.
+ * Previously recorded draw calls are discarded. Until `qu_end_draw_context()`
+ * is called, drawing and transform functions called from this thread go to
+ * the context. Each context has its own transform stack.
+ * Textures and surfaces must not be created or deleted while any context
+ * is recording. Text drawing is only available on the main thread.
+ */
+QU_API void QU_CALL qu_begin_draw_context(qu_draw_context context);
+
+/**
+ * Stop recording on the calling thread.
+ */
+QU_API void QU_CALL qu_end_draw_context(void);
+
+/**
+ * Append draw calls recorded in the context to the current frame.
+ * Should be called from the main thread after recording is finished.
+ * Contexts are drawn in the order they are submitted. State changes made
+ * in the context (color, blend mode, surface) remain in effect afterwards.
+ * Context may be submitted multiple times.
+ */
+QU_API void QU_CALL qu_submit_draw_context(qu_draw_context context);
+
 /**@}*/
 
 /**
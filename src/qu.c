@@ -190,7 +190,14 @@ int qu_execute_game_loop(int tick_rate, qu_update_fn update_fn, qu_draw_fn draw_
 
 void qu_present(void)
 {
-    qu_flush_graphics();
-    qu_swap_buffers();
+    qu_present_graphics();
 }
 
+#ifdef QU_ALLOCATION_COUNTER
+
+uint64_t qu_get_allocation_count(void)
+{
+    return pl_get_allocation_count();
+}
+
+#endif
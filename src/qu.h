@@ -46,6 +46,12 @@
         } \
     } while (0);
 
+#if defined(_MSC_VER)
+#define QU_THREAD_LOCAL __declspec(thread)
+#else
+#define QU_THREAD_LOCAL __thread
+#endif
+
 //------------------------------------------------------------------------------
 
 typedef enum qu_result
@@ -132,6 +138,12 @@ int64_t np_android_asset_seek(void *asset, int64_t offset, int whence);
 QU_API int QU_CALL qu_get_desired_graphics_api(void);
 QU_API void QU_CALL qu_set_desired_graphics_api(char const *api);
 
+#ifdef QU_ALLOCATION_COUNTER
+QU_API uint64_t QU_CALL qu_get_allocation_count(void);
+#endif
+
+QU_API int QU_CALL qu_replay_frames(char const *path, double *frame_times, int max_frames);
+
 //------------------------------------------------------------------------------
 
 #endif // QU_PRIVATE_H_INC
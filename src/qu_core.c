@@ -41,6 +41,10 @@ static qu_core_impl const *core_impl_list[] = {
     &qu_x11_core_impl,
 #endif
 
+#ifdef QU_USE_EGL
+    &qu_headless_core_impl,
+#endif
+
 #ifdef QU_EMSCRIPTEN
     &qu_emscripten_core_impl,
 #endif
@@ -518,6 +522,15 @@ int qu_gl_get_samples(void)
     return priv.impl->get_gl_multisample_samples();
 }
 
+bool qu_gl_make_context_current(bool current)
+{
+    if (!priv.impl->make_gl_context_current) {
+        return false;
+    }
+
+    return priv.impl->make_gl_context_current(current);
+}
+
 void qu_enqueue_event(qu_event const *event)
 {
     struct event_buffer *buffer = &priv.event_buffer;
@@ -559,6 +572,8 @@ void qu_set_desired_graphics_api(char const *api)
         priv.params.desired_graphics_api = QU_GRAPHICS_API_GL33;
     } else if (strcmp(api, "es2") == 0) {
         priv.params.desired_graphics_api = QU_GRAPHICS_API_ES20;
+    } else if (strcmp(api, "null") == 0) {
+        priv.params.desired_graphics_api = QU_GRAPHICS_API_NO_CONTEXT;
     } else {
         QU_LOGW("unknown graphics api \"%s\"\n", api);
     }
@@ -31,10 +31,11 @@
 
 typedef enum qu_graphics_api
 {
-    QU_GRAPHICS_API_NULL,
+    QU_GRAPHICS_API_NULL, // not specified, picked by the core
     QU_GRAPHICS_API_GL15,
     QU_GRAPHICS_API_GL33,
     QU_GRAPHICS_API_ES20,
+    QU_GRAPHICS_API_NO_CONTEXT, // no context, null renderer is used
 } qu_graphics_api;
 
 typedef struct qu_core_impl
@@ -49,6 +50,7 @@ typedef struct qu_core_impl
 
     void *(*gl_proc_address)(char const *name);
     int (*get_gl_multisample_samples)(void);
+    bool (*make_gl_context_current)(bool current);
 
     char const *(*get_window_title)(void);
     void (*set_window_title)(char const *title);
@@ -80,6 +82,7 @@ typedef struct qu_joystick_impl
 
 extern qu_core_impl const qu_android_core_impl;
 extern qu_core_impl const qu_emscripten_core_impl;
+extern qu_core_impl const qu_headless_core_impl;
 extern qu_core_impl const qu_win32_core_impl;
 extern qu_core_impl const qu_x11_core_impl;
 
@@ -96,6 +99,7 @@ void qu_swap_buffers(void);
 char const *qu_get_graphics_context_name(void);
 void *qu_gl_get_proc_address(char const *name);
 int qu_gl_get_samples(void);
+bool qu_gl_make_context_current(bool current);
 
 //------------------------------------------------------------------------------
 
@@ -0,0 +1,457 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2023 kelbeppin
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//------------------------------------------------------------------------------
+// qu_core_headless.c: EGL-based offscreen core module
+//------------------------------------------------------------------------------
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "qu_core.h"
+#include "qu_log.h"
+#include "qu_platform.h"
+
+//------------------------------------------------------------------------------
+
+#define TITLE_LENGTH            256
+
+// Not defined by older headers.
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+//------------------------------------------------------------------------------
+
+// There is no window, so everything is drawn to a pbuffer of the
+// "window" size. Resizing replaces the pbuffer on the next swap,
+// since the context may be current on the render thread.
+static struct
+{
+    int graphics_api;
+    int sample_count;
+
+    EGLDisplay display;
+    EGLConfig config;
+    EGLContext context;
+    EGLSurface surface;
+
+    pl_mutex *mutex;
+    qu_vec2i size;
+    qu_vec2i pending_size;
+    char title[TITLE_LENGTH];
+
+    void (*glFinish)(void);
+} impl;
+
+//------------------------------------------------------------------------------
+
+static bool check_client_extension(char const *extension)
+{
+    char const *list = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+    if (!list) {
+        return false;
+    }
+
+    size_t length = strlen(extension);
+
+    while ((list = strstr(list, extension))) {
+        if (list[length] == ' ' || list[length] == '\0') {
+            return true;
+        }
+
+        list += length;
+    }
+
+    return false;
+}
+
+static EGLDisplay open_display(void)
+{
+    // Mesa can run without any window system or device.
+    if (check_client_extension("EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+        if (get_platform_display) {
+            EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                                      EGL_DEFAULT_DISPLAY, NULL);
+
+            if (display != EGL_NO_DISPLAY) {
+                return display;
+            }
+        }
+    }
+
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static EGLSurface create_pbuffer(int width, int height)
+{
+    EGLint attribs[] = {
+        EGL_WIDTH,      width,
+        EGL_HEIGHT,     height,
+        EGL_NONE,
+    };
+
+    return eglCreatePbufferSurface(impl.display, impl.config, attribs);
+}
+
+static bool choose_config(EGLint renderable_type)
+{
+    EGLint attribs[] = {
+        EGL_SURFACE_TYPE,       EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE,    renderable_type,
+        EGL_RED_SIZE,           8,
+        EGL_GREEN_SIZE,         8,
+        EGL_BLUE_SIZE,          8,
+        EGL_ALPHA_SIZE,         8,
+        EGL_NONE,
+    };
+
+    EGLint config_count = 0;
+    EGLConfig configs[32];
+
+    if (!eglChooseConfig(impl.display, attribs, configs, 32, &config_count) || !config_count) {
+        return false;
+    }
+
+    int best_config = 0;
+    int best_samples = 0;
+    int desired_samples = qu_get_window_aa_level();
+
+    for (int i = 0; i < config_count; i++) {
+        EGLint samples = 0;
+        eglGetConfigAttrib(impl.display, configs[i], EGL_SAMPLES, &samples);
+
+        if (samples > best_samples && samples <= desired_samples) {
+            best_config = i;
+            best_samples = samples;
+        }
+    }
+
+    impl.config = configs[best_config];
+    impl.sample_count = QU_MAX(1, best_samples);
+
+    return true;
+}
+
+static EGLContext create_context(void)
+{
+    switch (impl.graphics_api) {
+    case QU_GRAPHICS_API_GL15:
+        QU_LOGI("Creating OpenGL 1.5 context...\n");
+
+        if (!eglBindAPI(EGL_OPENGL_API) || !choose_config(EGL_OPENGL_BIT)) {
+            return EGL_NO_CONTEXT;
+        }
+
+        return eglCreateContext(impl.display, impl.config, EGL_NO_CONTEXT, (EGLint[]) {
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+            EGL_NONE,
+        });
+    default:
+    case QU_GRAPHICS_API_GL33:
+        QU_LOGI("Creating OpenGL 3.3 (Core Profile) context...\n");
+
+        if (!eglBindAPI(EGL_OPENGL_API) || !choose_config(EGL_OPENGL_BIT)) {
+            return EGL_NO_CONTEXT;
+        }
+
+        return eglCreateContext(impl.display, impl.config, EGL_NO_CONTEXT, (EGLint[]) {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE,
+        });
+    case QU_GRAPHICS_API_ES20:
+        QU_LOGI("Creating OpenGL ES 2.0 context...\n");
+
+        if (!eglBindAPI(EGL_OPENGL_ES_API) || !choose_config(EGL_OPENGL_ES2_BIT)) {
+            return EGL_NO_CONTEXT;
+        }
+
+        return eglCreateContext(impl.display, impl.config, EGL_NO_CONTEXT, (EGLint[]) {
+            EGL_CONTEXT_CLIENT_VERSION, 2,
+            EGL_NONE,
+        });
+    }
+}
+
+static bool initialize_egl(void)
+{
+    impl.display = open_display();
+
+    if (impl.display == EGL_NO_DISPLAY) {
+        QU_LOGE("Failed to get EGL display.\n");
+        return false;
+    }
+
+    EGLint major, minor;
+
+    if (!eglInitialize(impl.display, &major, &minor)) {
+        QU_LOGE("Failed to initialize EGL.\n");
+        return false;
+    }
+
+    QU_LOGI("EGL version: %d.%d\n", major, minor);
+    QU_LOGI("EGL vendor: %s\n", eglQueryString(impl.display, EGL_VENDOR));
+
+    if (impl.graphics_api == QU_GRAPHICS_API_NULL) {
+        impl.graphics_api = QU_GRAPHICS_API_GL33;
+    }
+
+    impl.context = create_context();
+
+    // Fall back to the default API if the requested one isn't available.
+    if (impl.context == EGL_NO_CONTEXT && impl.graphics_api != QU_GRAPHICS_API_GL33) {
+        QU_LOGW("Failed to create requested context, trying OpenGL 3.3.\n");
+        impl.graphics_api = QU_GRAPHICS_API_GL33;
+        impl.context = create_context();
+    }
+
+    if (impl.context == EGL_NO_CONTEXT) {
+        QU_LOGE("Failed to create OpenGL context.\n");
+        return false;
+    }
+
+    impl.surface = create_pbuffer(impl.size.x, impl.size.y);
+
+    if (impl.surface == EGL_NO_SURFACE) {
+        QU_LOGE("Failed to create %dx%d pbuffer.\n", impl.size.x, impl.size.y);
+        return false;
+    }
+
+    if (!eglMakeCurrent(impl.display, impl.surface, impl.surface, impl.context)) {
+        QU_LOGE("Failed to make OpenGL context current.\n");
+        return false;
+    }
+
+    impl.glFinish = (void (*)(void)) eglGetProcAddress("glFinish");
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+static qu_result headless_precheck(void)
+{
+    return QU_SUCCESS;
+}
+
+static void terminate(void);
+
+static qu_result initialize(void)
+{
+    impl.mutex = pl_create_mutex();
+    impl.size = qu_get_window_size();
+    impl.pending_size = impl.size;
+
+    strncpy(impl.title, qu_get_window_title(), TITLE_LENGTH - 1);
+
+    impl.graphics_api = qu_get_desired_graphics_api();
+
+    // Only null renderer can be used then.
+    if (impl.graphics_api == QU_GRAPHICS_API_NO_CONTEXT) {
+        QU_LOGI("Headless core module initialized without graphics context.\n");
+        return QU_SUCCESS;
+    }
+
+    if (!initialize_egl()) {
+        terminate();
+        return QU_FAILURE;
+    }
+
+    QU_LOGI("Headless core module initialized.\n");
+
+    return QU_SUCCESS;
+}
+
+static void terminate(void)
+{
+    if (impl.display != EGL_NO_DISPLAY) {
+        eglMakeCurrent(impl.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+        if (impl.surface != EGL_NO_SURFACE) {
+            eglDestroySurface(impl.display, impl.surface);
+        }
+
+        if (impl.context != EGL_NO_CONTEXT) {
+            eglDestroyContext(impl.display, impl.context);
+        }
+
+        eglTerminate(impl.display);
+    }
+
+    pl_destroy_mutex(impl.mutex);
+    memset(&impl, 0, sizeof(impl));
+
+    QU_LOGI("Headless core module terminated.\n");
+}
+
+static bool process(void)
+{
+    return true;
+}
+
+// Called by whichever thread owns the context.
+static void present(void)
+{
+    // Pbuffer is single-buffered, so swapping does nothing.
+    // Wait for the frame instead, so that timing is meaningful.
+    if (impl.glFinish) {
+        impl.glFinish();
+    }
+
+    pl_lock_mutex(impl.mutex);
+    qu_vec2i size = impl.pending_size;
+    pl_unlock_mutex(impl.mutex);
+
+    if (size.x == impl.size.x && size.y == impl.size.y) {
+        return;
+    }
+
+    if (impl.context == EGL_NO_CONTEXT) {
+        impl.size = size;
+        return;
+    }
+
+    EGLSurface surface = create_pbuffer(size.x, size.y);
+
+    if (surface == EGL_NO_SURFACE) {
+        QU_LOGE("Failed to resize pbuffer to %dx%d.\n", size.x, size.y);
+        return;
+    }
+
+    eglMakeCurrent(impl.display, surface, surface, impl.context);
+    eglDestroySurface(impl.display, impl.surface);
+
+    impl.surface = surface;
+    impl.size = size;
+}
+
+static char const *get_graphics_context_name(void)
+{
+    switch (impl.graphics_api) {
+    case QU_GRAPHICS_API_GL15:
+        return "OpenGL (Compatibility Profile)";
+    case QU_GRAPHICS_API_GL33:
+        return "OpenGL";
+    case QU_GRAPHICS_API_ES20:
+        return "OpenGL ES 2.0";
+    case QU_GRAPHICS_API_NO_CONTEXT:
+        return "None";
+    default:
+        return "Unknown";
+    }
+}
+
+static void *gl_proc_address(char const *name)
+{
+    return (void *) eglGetProcAddress(name);
+}
+
+static int get_gl_multisample_samples(void)
+{
+    return impl.sample_count;
+}
+
+static bool make_gl_context_current(bool current)
+{
+    if (impl.context == EGL_NO_CONTEXT) {
+        return true;
+    }
+
+    if (current) {
+        return eglMakeCurrent(impl.display, impl.surface, impl.surface, impl.context);
+    }
+
+    return eglMakeCurrent(impl.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+static char const *headless_get_window_title(void)
+{
+    return impl.title;
+}
+
+static void headless_set_window_title(char const *title)
+{
+    strncpy(impl.title, title, TITLE_LENGTH - 1);
+}
+
+static qu_vec2i headless_get_window_size(void)
+{
+    pl_lock_mutex(impl.mutex);
+    qu_vec2i size = impl.pending_size;
+    pl_unlock_mutex(impl.mutex);
+
+    return size;
+}
+
+static void headless_set_window_size(int width, int height)
+{
+    pl_lock_mutex(impl.mutex);
+
+    bool changed = (impl.pending_size.x != width || impl.pending_size.y != height);
+    impl.pending_size = (qu_vec2i) { width, height };
+
+    pl_unlock_mutex(impl.mutex);
+
+    if (!changed) {
+        return;
+    }
+
+    qu_enqueue_event(&(qu_event) {
+        .type = QU_EVENT_TYPE_WINDOW_RESIZE,
+        .data.window_resize = {
+            .width = width,
+            .height = height,
+        },
+    });
+}
+
+static int headless_get_window_aa_level(void)
+{
+    return impl.sample_count;
+}
+
+static void headless_set_window_aa_level(int level)
+{
+    QU_LOGW("Modifying of MSAA level is not supported.\n");
+}
+
+//------------------------------------------------------------------------------
+
+qu_core_impl const qu_headless_core_impl = {
+    .precheck = headless_precheck,
+    .initialize = initialize,
+    .terminate = terminate,
+    .process_input = process,
+    .swap_buffers = present,
+    .get_graphics_context_name = get_graphics_context_name,
+    .gl_proc_address = gl_proc_address,
+    .get_gl_multisample_samples = get_gl_multisample_samples,
+    .make_gl_context_current = make_gl_context_current,
+    .get_window_title = headless_get_window_title,
+    .set_window_title = headless_set_window_title,
+    .get_window_size = headless_get_window_size,
+    .set_window_size = headless_set_window_size,
+    .get_window_aa_level = headless_get_window_aa_level,
+    .set_window_aa_level = headless_set_window_aa_level,
+};
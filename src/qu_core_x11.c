@@ -221,6 +221,16 @@ static qu_mouse_button mouse_button_conv(unsigned int button)
 
 static qu_result x11_precheck(void)
 {
+    if (qu_get_window_flags() & QU_WINDOW_HEADLESS) {
+        return QU_FAILURE;
+    }
+
+    // Let headless module take over on machines without display.
+    if (!getenv("DISPLAY")) {
+        QU_LOGI("DISPLAY is not set, skipping X11.\n");
+        return QU_FAILURE;
+    }
+
     return QU_SUCCESS;
 }
 
@@ -228,6 +238,12 @@ static qu_result initialize(void)
 {
     // (0) Open display
 
+    // GLX context is used by the render thread while
+    // the main thread handles events.
+    if (qu_get_graphics_flags() & QU_GRAPHICS_RENDER_THREAD) {
+        XInitThreads();
+    }
+
     impl.display = XOpenDisplay(NULL);
 
     if (!impl.display) {
@@ -609,6 +625,15 @@ static int get_gl_multisample_samples(void)
     return impl.sample_count;
 }
 
+static bool make_gl_context_current(bool current)
+{
+    if (current) {
+        return glXMakeContextCurrent(impl.display, impl.surface, impl.surface, impl.context);
+    }
+
+    return glXMakeContextCurrent(impl.display, None, None, NULL);
+}
+
 static char const *x11_get_window_title(void)
 {
     Atom type;
@@ -690,6 +715,7 @@ qu_core_impl const qu_x11_core_impl = {
     .get_graphics_context_name = get_graphics_context_name,
     .gl_proc_address = gl_proc_address,
     .get_gl_multisample_samples = get_gl_multisample_samples,
+    .make_gl_context_current = make_gl_context_current,
     .get_window_title = x11_get_window_title,
     .set_window_title = x11_set_window_title,
     .get_window_size = x11_get_window_size,
@@ -20,6 +20,9 @@
 // qu_graphics.c: Graphics module
 //------------------------------------------------------------------------------
 
+#include <limits.h>
+
+#include "qu_core.h"
 #include "qu_graphics.h"
 #include "qu_log.h"
 #include "qu_resource_loader.h"
@@ -44,6 +47,16 @@ static qu_renderer_impl const *supported_renderer_impl_list[] = {
 static unsigned int vertex_size_map[QU_TOTAL_VERTEX_FORMATS] = {
     [QU_VERTEX_FORMAT_2XY] = 2,
     [QU_VERTEX_FORMAT_4XYST] = 4,
+    [QU_VERTEX_FORMAT_5XYCST] = 5,
+    [QU_VERTEX_FORMAT_SPRITE] = 12,
+};
+
+// Draw calls in these modes can be concatenated without changing
+// the result, so consecutive draws can be merged into one.
+static bool const render_mode_batch_map[QU_TOTAL_RENDER_MODES] = {
+    [QU_RENDER_MODE_POINTS] = true,
+    [QU_RENDER_MODE_LINES] = true,
+    [QU_RENDER_MODE_TRIANGLES] = true,
 };
 
 //------------------------------------------------------------------------------
@@ -51,7 +64,21 @@ static unsigned int vertex_size_map[QU_TOTAL_VERTEX_FORMATS] = {
 #define QU__MATRIX_STACK_SIZE                           32
 #define QU__RENDER_COMMAND_BUFFER_INITIAL_CAPACITY      256
 #define QU__VERTEX_BUFFER_INITIAL_CAPACITY              1024
+#define QU__VERTEX_BUFFER_FLUSH_THRESHOLD               (1 << 18)
 #define QU__CIRCLE_VERTEX_COUNT                         64
+#define QU__ATLAS_PAGE_SIZE                             2048
+#define QU__ATLAS_PADDING                               1
+#define QU__MAX_SORTED_BLEND_MODES                      256
+#define QU__TEXTURE_LOADER_THREADS                      2
+#define QU__TEXTURE_UPLOAD_BUDGET_NS                    2000000
+#define QU__SURFACE_POOL_MAX_AGE                        120
+
+// Display surface has zero id, canvas uses this one.
+#define QU__CANVAS_SURFACE_ID                           (-1)
+
+// Quad indices are 16-bit and relative to the first vertex of a draw call,
+// so a single indexed draw call can't contain more quads than this.
+#define QU__MAX_QUADS_PER_DRAW                          16384
 
 enum qu__render_command
 {
@@ -74,6 +101,7 @@ struct graphics_params
 {
     qu_vec2i canvas_size;
     unsigned int canvas_flags;
+    unsigned int graphics_flags;
 };
 
 struct qu__resize_render_command_args
@@ -121,6 +149,9 @@ struct qu__draw_render_command_args
     qu_render_mode render_mode;
     unsigned int first_vertex;
     unsigned int total_vertices;
+    bool indexed; // vertices are quads drawn with shared quad indices
+    bool instanced; // vertices are instances of 4-vertex sprite quad
+    int layer;
 };
 
 union qu__render_command_args
@@ -154,6 +185,214 @@ struct qu__vertex_buffer
     size_t capacity;
 };
 
+// Sort key, from the most significant bits:
+// layer (16), blend mode (8), brush (4), vertex format (4), texture (32).
+struct qu__draw_sort_entry
+{
+    uint64_t key;
+    size_t index;
+};
+
+struct qu__atlas_node
+{
+    int x;
+    int y;
+    int w;
+};
+
+// Atlas page is packed with skyline bottom-left algorithm.
+// Space isn't reused until all textures of the page are deleted.
+struct qu__atlas_page
+{
+    int32_t texture_id;
+    int channels;
+    int total_textures;
+
+    struct qu__atlas_node *nodes;
+    int total_nodes;
+};
+
+// Recorder holds draw calls which are not executed yet.
+// Main thread records to the default recorder,
+// other threads record to draw contexts.
+struct qu__recorder
+{
+    struct qu__render_command_buffer command_buffer;
+    struct qu__vertex_buffer vertex_buffers[QU_TOTAL_VERTEX_FORMATS];
+
+    // Modelview stack of this surface is used by CPU transforms.
+    qu_surface_obj *target_surface;
+
+    // Draw order within a layer isn't preserved once layers are used.
+    bool sort_draws;
+    int draw_layer;
+
+    // Draws skipped since the last execution.
+    int culled_draws;
+};
+
+struct qu__draw_context
+{
+    struct qu__recorder recorder;
+    qu_surface_obj transform; // only the modelview stack is used
+};
+
+// Dirty texture region which is uploaded by the render thread.
+// Pixels are copied, since the main thread may modify the texture
+// while the frame is executed.
+struct qu__texture_upload
+{
+    qu_texture_obj *texture;
+    int x, y, w, h;
+    size_t offset; // in the pixel buffer
+    bool mipmaps; // regenerate mip levels after the upload
+};
+
+struct qu__texture_upload_buffer
+{
+    struct qu__texture_upload *uploads;
+    int total_uploads;
+    int uploads_capacity;
+
+    unsigned char *pixels;
+    size_t pixels_size;
+    size_t pixels_capacity;
+};
+
+// Render thread executes command buffer of the previous frame
+// while the main thread records the next one.
+struct qu__render_thread
+{
+    pl_thread *thread;
+    pl_mutex *mutex;
+    pl_cond *cond;
+
+    void (*job)(void *);
+    void *job_arg;
+    bool quit;
+
+    struct qu__recorder recorder; // Frame which is being executed.
+    struct qu__texture_upload_buffer uploads;
+    bool present;
+
+    // Texture uploads of the frame which is being recorded.
+    struct qu__texture_upload_buffer pending_uploads;
+
+    // Functions which may be called outside of command execution
+    // are forwarded to the render thread.
+    qu_renderer_impl const *renderer;
+    qu_renderer_impl proxy;
+};
+
+// Decorator which counts and times calls to the selected renderer.
+// Statistics of the last complete frame are guarded by the mutex,
+// since the frame may be executed by the render thread.
+struct qu__renderer_stats
+{
+    qu_renderer_impl const *renderer;
+    qu_renderer_impl decorator;
+
+    pl_mutex *mutex;
+    qu_frame_stats current;
+    qu_frame_stats last;
+};
+
+// GPU timings of the last frame which the renderer could read back.
+struct qu__gpu_timers
+{
+    pl_mutex *mutex;
+    qu_gpu_timings last;
+};
+
+// Decorator which writes renderer calls to a file.
+// Accessed only by the thread which owns graphics context.
+struct qu__frame_capture
+{
+    qu_renderer_impl const *renderer;
+    qu_renderer_impl decorator;
+
+    FILE *file;
+    int frames_left;
+    uint32_t next_id;
+
+    // Capture starts when the current frame is presented.
+    char *pending_path;
+    int pending_frames;
+};
+
+// Surface and transform of the main recorder as of the last recorded
+// command. Execution may lag behind, so these are tracked separately.
+struct qu__draw_culling
+{
+    qu_surface_obj *surface;
+
+    // Transform isn't reapplied when surface is changed,
+    // so the last applied one is tracked instead of the surface's.
+    qu_mat4 transform;
+    bool transform_known;
+};
+
+struct qu__pooled_surface
+{
+    qu_surface_obj *surface;
+    uint64_t frame; // in which the surface was deleted
+};
+
+// Deleted surfaces keep their renderer objects and are given to new
+// surfaces of the same size and sample count. Commands of the frame
+// in which a surface is deleted may still use it, so it isn't reused
+// until that frame is executed.
+struct qu__surface_pool
+{
+    struct qu__pooled_surface *entries;
+    int total_entries;
+    int entries_capacity;
+
+    uint64_t frame; // number of presented frames
+    uint64_t executed_frames;
+
+    // Highest antialiasing level supported by renderer, zero if unknown.
+    int max_sample_count;
+
+    // Deleted when the frame is presented.
+    int32_t *transient_surfaces;
+    int total_transient_surfaces;
+    int transient_surfaces_capacity;
+};
+
+// Asynchronous texture load. Image is decoded by a worker thread,
+// and uploaded by the main thread when the frame is flushed.
+struct qu__texture_load
+{
+    int32_t texture_id;
+    unsigned int texture_flags;
+    char *path;
+
+    qu_texture_obj texture;
+    bool decoded;
+
+    struct qu__texture_load *next;
+};
+
+struct qu__texture_load_queue
+{
+    struct qu__texture_load *head;
+    struct qu__texture_load *tail;
+};
+
+struct qu__texture_loader
+{
+    pl_thread *threads[QU__TEXTURE_LOADER_THREADS];
+    pl_mutex *mutex;
+    pl_cond *cond;
+    bool quit;
+
+    struct qu__texture_load_queue pending;
+    struct qu__texture_load_queue decoded;
+
+    int total_loads; // not uploaded yet, accessed only by the main thread
+};
+
 struct qu__graphics_priv
 {
     bool initialized;
@@ -161,18 +400,28 @@ struct qu__graphics_priv
     struct graphics_params params;
     
     qu_renderer_impl const *renderer;
+    unsigned int renderer_features;
 
-    struct qu__render_command_buffer command_buffer;
-    struct qu__vertex_buffer vertex_buffers[QU_TOTAL_VERTEX_FORMATS];
-    float *circle_vertices;
+    struct qu__recorder recorder;
+    uint16_t *quad_indices;
 
     qu_handle_list *textures; // qu_texture_obj
-    qu_handle_list *surfaces; // qu_surface_obj
+    qu_handle_list *surfaces; // qu_surface_obj *
+    qu_handle_list *draw_contexts; // struct qu__draw_context *
+
+    unsigned int texture_flags;
+    struct qu__atlas_page *atlas_pages;
+    int total_atlas_pages;
+
+    int32_t *dirty_textures;
+    int total_dirty_textures;
+    int dirty_textures_capacity;
 
     qu_color clear_color;
     qu_color draw_color;
     qu_brush brush;
     qu_vertex_format vertex_format;
+    qu_blend_mode blend_mode;
 
     qu_surface_obj display;
     qu_surface_obj canvas;
@@ -181,31 +430,45 @@ struct qu__graphics_priv
     qu_surface_obj *current_surface;
 
     bool canvas_enabled;
+    bool cpu_transforms;
+
+    struct qu__draw_sort_entry *sort_entries;
+    size_t sort_capacity;
 
     float canvas_ax;
     float canvas_ay;
     float canvas_bx;
     float canvas_by;
+
+    struct qu__render_thread render_thread;
+    struct qu__texture_loader texture_loader;
+    struct qu__renderer_stats renderer_stats;
+    struct qu__gpu_timers gpu_timers;
+    struct qu__frame_capture frame_capture;
+    struct qu__draw_culling culling;
+    struct qu__surface_pool surface_pool;
 };
 
 static struct qu__graphics_priv priv;
 
+// Set on the render thread, which owns graphics context.
+static QU_THREAD_LOCAL bool is_render_thread;
+
+// Draw context which is being recorded by the current thread, if any.
+static QU_THREAD_LOCAL struct qu__draw_context *thread_draw_context;
+
+static struct qu__recorder *graphics__get_recorder(void)
+{
+    return thread_draw_context ? &thread_draw_context->recorder : &priv.recorder;
+}
+
 //------------------------------------------------------------------------------
 // Render commands
 
-static void graphics__update_canvas_coords(int w_display, int h_display);
-
 static void graphics__exec_resize(struct qu__resize_render_command_args const *args)
 {
-    priv.display.texture.width = args->width;
-    priv.display.texture.height = args->height;
-
     qu_mat4_ortho(&priv.display.projection, 0.f, args->width, args->height, 0.f);
 
-    if (priv.canvas_enabled) {
-        graphics__update_canvas_coords(args->width, args->height);
-    }
-
     if (priv.current_surface == &priv.display) {
         priv.renderer->apply_projection(&priv.display.projection);
         priv.renderer->exec_resize(args->width, args->height);
@@ -224,18 +487,22 @@ static void graphics__exec_set_surface(struct qu__surface_render_command_args co
     priv.current_surface = args->surface;
 }
 
-static void graphics__exec_set_view(struct qu__set_view_render_command_args const *args)
+static void graphics__make_view_projection(qu_mat4 *projection, struct qu__set_view_render_command_args const *args)
 {
-    qu_mat4_ortho(&priv.current_surface->projection,
+    qu_mat4_ortho(projection,
                   args->x - (args->w / 2.f), args->x + (args->w / 2.f),
                   args->y + (args->h / 2.f), args->y - (args->h / 2.f));
 
     if (args->rot != 0.f) {
-        qu_mat4_translate(&priv.current_surface->projection, args->x, args->y, 0.f);
-        qu_mat4_rotate(&priv.current_surface->projection, QU_DEG2RAD(args->rot), 0.f, 0.f, 1.f);
-        qu_mat4_translate(&priv.current_surface->projection, -args->x, -args->y, 0.f);
+        qu_mat4_translate(projection, args->x, args->y, 0.f);
+        qu_mat4_rotate(projection, QU_DEG2RAD(args->rot), 0.f, 0.f, 1.f);
+        qu_mat4_translate(projection, -args->x, -args->y, 0.f);
     }
+}
 
+static void graphics__exec_set_view(struct qu__set_view_render_command_args const *args)
+{
+    graphics__make_view_projection(&priv.current_surface->projection, args);
     priv.renderer->apply_projection(&priv.current_surface->projection);
 }
 
@@ -248,33 +515,46 @@ static void graphics__exec_reset_view(void)
     priv.renderer->apply_projection(&priv.current_surface->projection);
 }
 
-static void graphics__exec_push_matrix(void)
+static qu_mat4 *graphics__get_modelview(qu_surface_obj *surface)
+{
+    return &surface->modelview[surface->modelview_index];
+}
+
+static void graphics__push_matrix(qu_surface_obj *surface)
 {
-    int index = priv.current_surface->modelview_index;
+    int index = surface->modelview_index;
 
     if (index < (QU__MATRIX_STACK_SIZE - 1)) {
-        qu_mat4 *next = &priv.current_surface->modelview[index + 1];
-        qu_mat4 *current = &priv.current_surface->modelview[index];
+        qu_mat4_copy(&surface->modelview[index + 1], &surface->modelview[index]);
+        surface->modelview_index++;
+    }
+}
 
-        qu_mat4_copy(next, current);
-        priv.current_surface->modelview_index++;
+static bool graphics__pop_matrix(qu_surface_obj *surface)
+{
+    if (surface->modelview_index > 0) {
+        surface->modelview_index--;
+        return true;
     }
+
+    return false;
 }
 
-static void graphics__exec_pop_matrix(void)
+static void graphics__exec_push_matrix(void)
 {
-    int index = priv.current_surface->modelview_index;
+    graphics__push_matrix(priv.current_surface);
+}
 
-    if (index > 0) {
-        priv.renderer->apply_transform(&priv.current_surface->modelview[index - 1]);
-        priv.current_surface->modelview_index--;
+static void graphics__exec_pop_matrix(void)
+{
+    if (graphics__pop_matrix(priv.current_surface)) {
+        priv.renderer->apply_transform(graphics__get_modelview(priv.current_surface));
     }
 }
 
 static void graphics__exec_translate(struct qu__transform_render_command_args const *args)
 {
-    int index = priv.current_surface->modelview_index;
-    qu_mat4 *matrix = &priv.current_surface->modelview[index];
+    qu_mat4 *matrix = graphics__get_modelview(priv.current_surface);
 
     qu_mat4_translate(matrix, args->a, args->b, 0.f);
     priv.renderer->apply_transform(matrix);
@@ -282,8 +562,7 @@ static void graphics__exec_translate(struct qu__transform_render_command_args co
 
 static void graphics__exec_scale(struct qu__transform_render_command_args const *args)
 {
-    int index = priv.current_surface->modelview_index;
-    qu_mat4 *matrix = &priv.current_surface->modelview[index];
+    qu_mat4 *matrix = graphics__get_modelview(priv.current_surface);
 
     qu_mat4_scale(matrix, args->a, args->b, 1.f);
     priv.renderer->apply_transform(matrix);
@@ -291,8 +570,7 @@ static void graphics__exec_scale(struct qu__transform_render_command_args const
 
 static void graphics__exec_rotate(struct qu__transform_render_command_args const *args)
 {
-    int index = priv.current_surface->modelview_index;
-    qu_mat4 *matrix = &priv.current_surface->modelview[index];
+    qu_mat4 *matrix = graphics__get_modelview(priv.current_surface);
 
     qu_mat4_rotate(matrix, QU_DEG2RAD(args->a), 0.f, 0.f, 1.f);
     priv.renderer->apply_transform(matrix);
@@ -300,6 +578,11 @@ static void graphics__exec_rotate(struct qu__transform_render_command_args const
 
 static void graphics__exec_set_blend_mode(struct qu__blend_render_command_args const *args)
 {
+    if (memcmp(&priv.blend_mode, &args->mode, sizeof(qu_blend_mode)) == 0) {
+        return;
+    }
+
+    priv.blend_mode = args->mode;
     priv.renderer->apply_blend_mode(args->mode);
 }
 
@@ -335,29 +618,233 @@ static void graphics__exec_draw(struct qu__draw_render_command_args const *args)
         priv.renderer->apply_vertex_format(priv.vertex_format);
     }
 
-    priv.renderer->exec_draw(args->render_mode, args->first_vertex, args->total_vertices);
+    if (args->instanced) {
+        priv.renderer->exec_draw_instanced(args->render_mode, 4, args->first_vertex, args->total_vertices);
+    } else if (args->indexed) {
+        unsigned int total_indices = 6 * (args->total_vertices / 4);
+        priv.renderer->exec_draw_indexed(args->render_mode, args->first_vertex, 0, total_indices);
+    } else {
+        priv.renderer->exec_draw(args->render_mode, args->first_vertex, args->total_vertices);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Draw culling
+
+static void graphics__initialize_recorded_state(qu_surface_obj *surface)
+{
+    qu_mat4_copy(&surface->recorded_projection, &surface->projection);
+    qu_mat4_identity(&surface->recorded_modelview[0]);
+    surface->recorded_modelview_index = 0;
+}
+
+static void graphics__set_recorded_transform(qu_mat4 const *transform)
+{
+    qu_mat4_copy(&priv.culling.transform, transform);
+    priv.culling.transform_known = true;
+}
+
+// Follows commands recorded by the main recorder the same way
+// graphics__execute_command() does when they are executed.
+static void graphics__track_render_command(struct qu__render_command_info const *info)
+{
+    qu_surface_obj *surface = priv.culling.surface;
+    qu_mat4 *modelview = &surface->recorded_modelview[surface->recorded_modelview_index];
+
+    switch (info->command) {
+    case QU__RENDER_COMMAND_RESIZE:
+        qu_mat4_ortho(&priv.display.recorded_projection, 0.f,
+                      info->args.resize.width, info->args.resize.height, 0.f);
+        break;
+    case QU__RENDER_COMMAND_SET_SURFACE:
+        priv.culling.surface = info->args.surface.surface;
+        break;
+    case QU__RENDER_COMMAND_SET_VIEW:
+        graphics__make_view_projection(&surface->recorded_projection, &info->args.view);
+        break;
+    case QU__RENDER_COMMAND_RESET_VIEW:
+        qu_mat4_ortho(&surface->recorded_projection, 0.f,
+                      surface->texture.width, surface->texture.height, 0.f);
+        break;
+    case QU__RENDER_COMMAND_PUSH_MATRIX:
+        if (surface->recorded_modelview_index < (QU__MATRIX_STACK_SIZE - 1)) {
+            qu_mat4_copy(modelview + 1, modelview);
+            surface->recorded_modelview_index++;
+        }
+        break;
+    case QU__RENDER_COMMAND_POP_MATRIX:
+        if (surface->recorded_modelview_index > 0) {
+            surface->recorded_modelview_index--;
+            graphics__set_recorded_transform(modelview - 1);
+        }
+        break;
+    case QU__RENDER_COMMAND_TRANSLATE:
+        qu_mat4_translate(modelview, info->args.transform.a, info->args.transform.b, 0.f);
+        graphics__set_recorded_transform(modelview);
+        break;
+    case QU__RENDER_COMMAND_SCALE:
+        qu_mat4_scale(modelview, info->args.transform.a, info->args.transform.b, 1.f);
+        graphics__set_recorded_transform(modelview);
+        break;
+    case QU__RENDER_COMMAND_ROTATE:
+        qu_mat4_rotate(modelview, QU_DEG2RAD(info->args.transform.a), 0.f, 0.f, 1.f);
+        graphics__set_recorded_transform(modelview);
+        break;
+    default:
+        break;
+    }
+}
+
+// Returns true if the rectangle is entirely outside of the view of the
+// current surface, so the draw can be skipped. Coordinates are the ones
+// passed to draw functions, before any transform.
+static bool graphics__cull_rect(float x0, float y0, float x1, float y1)
+{
+    // Draw context can be submitted while any surface is set.
+    if (thread_draw_context) {
+        return false;
+    }
+
+    qu_mat4 const *modelview = &priv.culling.transform;
+
+    if (priv.cpu_transforms) {
+        modelview = graphics__get_modelview(priv.recorder.target_surface);
+    } else if (!priv.culling.transform_known) {
+        return false;
+    }
+
+    qu_surface_obj const *surface = priv.culling.surface;
+    float const *p = surface->recorded_projection.m;
+    float const *m = modelview->m;
+
+    // 2D part of projection * modelview.
+    float a = p[0] * m[0] + p[4] * m[1];
+    float b = p[1] * m[0] + p[5] * m[1];
+    float c = p[0] * m[4] + p[4] * m[5];
+    float d = p[1] * m[4] + p[5] * m[5];
+    float e = p[0] * m[12] + p[4] * m[13] + p[12];
+    float f = p[1] * m[12] + p[5] * m[13] + p[13];
+
+    // Bounding box of the transformed rectangle in clip space,
+    // as center and half size.
+    float cx = (x0 + x1) / 2.f;
+    float cy = (y0 + y1) / 2.f;
+    float hw = fabsf(x1 - x0) / 2.f;
+    float hh = fabsf(y1 - y0) / 2.f;
+
+    float x = a * cx + c * cy + e;
+    float y = b * cx + d * cy + f;
+    float w = fabsf(a) * hw + fabsf(c) * hh;
+    float h = fabsf(b) * hw + fabsf(d) * hh;
+
+    // One pixel margin, so points and lines on the edge aren't lost.
+    float xmax = 1.f + 2.f / surface->texture.width;
+    float ymax = 1.f + 2.f / surface->texture.height;
+
+    if ((x - w) > xmax || (x + w) < -xmax || (y - h) > ymax || (y + h) < -ymax) {
+        priv.recorder.culled_draws++;
+        return true;
+    }
+
+    return false;
+}
+
+static bool graphics__cull_vertices(float const *data, int count, int stride)
+{
+    float x0 = data[0];
+    float y0 = data[1];
+    float x1 = data[0];
+    float y1 = data[1];
+
+    for (int i = 1; i < count; i++) {
+        float const *v = &data[i * stride];
+
+        x0 = QU_MIN(x0, v[0]);
+        y0 = QU_MIN(y0, v[1]);
+        x1 = QU_MAX(x1, v[0]);
+        y1 = QU_MAX(y1, v[1]);
+    }
+
+    return graphics__cull_rect(x0, y0, x1, y1);
+}
+
+// Rotated sprite is bounded by the circle around its origin.
+static bool graphics__cull_sprite(qu_sprite const *sprite)
+{
+    float ax = -sprite->ox;
+    float ay = -sprite->oy;
+    float bx = ax + sprite->w;
+    float by = ay + sprite->h;
+
+    if (sprite->rot == 0.f) {
+        return graphics__cull_rect(sprite->x + ax, sprite->y + ay, sprite->x + bx, sprite->y + by);
+    }
+
+    float r = sqrtf(QU_MAX(ax * ax, bx * bx) + QU_MAX(ay * ay, by * by));
+
+    return graphics__cull_rect(sprite->x - r, sprite->y - r, sprite->x + r, sprite->y + r);
 }
 
 //------------------------------------------------------------------------------
 // Command buffer
 
-static void graphics__grow_render_command_buffer(void)
+static void graphics__grow_render_command_buffer(struct qu__render_command_buffer *buffer)
 {
-    size_t next_capacity = priv.command_buffer.capacity * 2;
+    size_t next_capacity = buffer->capacity * 2;
     size_t data_bytes = sizeof(struct qu__render_command_info) * next_capacity;
-    struct qu__render_command_info *next_data = pl_realloc(priv.command_buffer.data, data_bytes);
+    struct qu__render_command_info *next_data = pl_realloc(buffer->data, data_bytes);
 
     QU_HALT_IF(!next_data);
 
-    priv.command_buffer.data = next_data;
-    priv.command_buffer.capacity = next_capacity;
+    buffer->data = next_data;
+    buffer->capacity = next_capacity;
 }
 
-static void graphics__append_render_command(struct qu__render_command_info const *info)
+static bool graphics__merge_draw_commands(struct qu__draw_render_command_args *last,
+                                          struct qu__draw_render_command_args const *next)
+{
+    // Blend mode, transform, view and surface changes are separate commands,
+    // so they can't be in between two consecutive draw commands.
+
+    if (last->render_mode != next->render_mode) {
+        return false;
+    }
+
+    // Each instance is drawn separately, so any render mode can be batched.
+    if (!render_mode_batch_map[last->render_mode] && !last->instanced) {
+        return false;
+    }
+
+    if (last->texture != next->texture || last->color != next->color || last->brush != next->brush) {
+        return false;
+    }
+
+    if (last->layer != next->layer) {
+        return false;
+    }
+
+    if (last->vertex_format != next->vertex_format || last->indexed != next->indexed
+        || last->instanced != next->instanced) {
+        return false;
+    }
+
+    if (last->indexed && (last->total_vertices + next->total_vertices) > 4 * QU__MAX_QUADS_PER_DRAW) {
+        return false;
+    }
+
+    if ((last->first_vertex + last->total_vertices) != next->first_vertex) {
+        return false;
+    }
+
+    last->total_vertices += next->total_vertices;
+    return true;
+}
+
+static void graphics__push_render_command(struct qu__render_command_buffer *buffer,
+                                          struct qu__render_command_info const *info)
 {
-    if (priv.command_buffer.size > 0) {
-        size_t last_index = priv.command_buffer.size - 1;
-        struct qu__render_command_info *last = &priv.command_buffer.data[last_index];
+    if (buffer->size > 0) {
+        struct qu__render_command_info *last = &buffer->data[buffer->size - 1];
 
         if (last->command == info->command) {
             switch (last->command) {
@@ -365,18 +852,40 @@ static void graphics__append_render_command(struct qu__render_command_info const
                 last->args.resize.width = info->args.resize.width;
                 last->args.resize.height = info->args.resize.height;
                 return;
+            case QU__RENDER_COMMAND_DRAW:
+                if (graphics__merge_draw_commands(&last->args.draw, &info->args.draw)) {
+                    return;
+                }
+                break;
             default:
                 break;
             }
         }
     }
 
-    if (priv.command_buffer.size >= priv.command_buffer.capacity) {
-        graphics__grow_render_command_buffer();
+    if (buffer->size >= buffer->capacity) {
+        graphics__grow_render_command_buffer(buffer);
+    }
+
+    memcpy(&buffer->data[buffer->size++], info, sizeof(struct qu__render_command_info));
+}
+
+static void graphics__append_render_command(struct qu__render_command_info const *info)
+{
+    struct qu__recorder *recorder = graphics__get_recorder();
+    struct qu__render_command_info layered;
+
+    if (info->command == QU__RENDER_COMMAND_DRAW) {
+        layered = *info;
+        layered.args.draw.layer = recorder->draw_layer;
+        info = &layered;
+    }
+
+    if (recorder == &priv.recorder) {
+        graphics__track_render_command(info);
     }
 
-    size_t index = priv.command_buffer.size++;
-    memcpy(&priv.command_buffer.data[index], info, sizeof(struct qu__render_command_info));
+    graphics__push_render_command(&recorder->command_buffer, info);
 }
 
 static void graphics__execute_command(struct qu__render_command_info const *info)
@@ -423,280 +932,3694 @@ static void graphics__execute_command(struct qu__render_command_info const *info
     }
 }
 
-static void graphics__execute_command_buffer(void)
+// Stable LSD radix sort, 8 bits per pass.
+// Returns either `entries` or `temp`, whichever holds the result.
+static struct qu__draw_sort_entry *graphics__sort_draw_entries(struct qu__draw_sort_entry *entries,
+                                                               struct qu__draw_sort_entry *temp,
+                                                               size_t count)
 {
-    for (size_t i = 0; i < priv.command_buffer.size; i++) {
-        graphics__execute_command(&priv.command_buffer.data[i]);
-    }
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t offsets[256] = { 0 };
 
-    priv.command_buffer.size = 0;
-}
+        for (size_t i = 0; i < count; i++) {
+            offsets[(entries[i].key >> shift) & 0xFF]++;
+        }
 
-//------------------------------------------------------------------------------
-// Vertex buffer
+        // Skip the pass if all keys have the same byte.
+        if (offsets[(entries[0].key >> shift) & 0xFF] == count) {
+            continue;
+        }
 
-static void graphics__grow_vertex_buffer(struct qu__vertex_buffer *buffer, size_t required_capacity)
-{
-    size_t next_capacity = buffer->capacity * 2;
+        for (size_t i = 0, sum = 0; i < 256; i++) {
+            size_t n = offsets[i];
+            offsets[i] = sum;
+            sum += n;
+        }
 
-    while (next_capacity < required_capacity) {
-        next_capacity *= 2;
-    }
+        for (size_t i = 0; i < count; i++) {
+            temp[offsets[(entries[i].key >> shift) & 0xFF]++] = entries[i];
+        }
 
-    size_t data_bytes = sizeof(float) * next_capacity;
-    float *next_data = pl_realloc(buffer->data, data_bytes);
+        struct qu__draw_sort_entry *swap = entries;
+        entries = temp;
+        temp = swap;
+    }
 
-    QU_HALT_IF(!next_data);
+    return entries;
+}
 
-    buffer->data = next_data;
-    buffer->capacity = next_capacity;
+static bool graphics__is_sortable_command(enum qu__render_command command)
+{
+    return command == QU__RENDER_COMMAND_DRAW || command == QU__RENDER_COMMAND_SET_BLEND_MODE;
 }
 
-static unsigned int graphics__append_vertex_data(qu_vertex_format format, float const *data, size_t size)
+// Executes draw and blend mode commands in [begin, end) ordered by sort key.
+// Any other command changes the state draws depend on, so it ends the range.
+static void graphics__execute_sorted_commands(struct qu__render_command_info const *commands,
+                                              size_t begin, size_t end)
 {
-    struct qu__vertex_buffer *buffer = &priv.vertex_buffers[format];
+    if (priv.sort_capacity < 2 * (end - begin)) {
+        priv.sort_capacity = 2 * (end - begin);
 
-    size_t required_capacity = buffer->size + size;
+        struct qu__draw_sort_entry *next_entries = pl_realloc(priv.sort_entries,
+            sizeof(struct qu__draw_sort_entry) * priv.sort_capacity);
 
-    if (buffer->capacity < required_capacity) {
-        graphics__grow_vertex_buffer(buffer, required_capacity);
+        QU_HALT_IF(!next_entries);
+
+        priv.sort_entries = next_entries;
     }
 
-    float *dst = &buffer->data[buffer->size];
+    qu_blend_mode blend_modes[QU__MAX_SORTED_BLEND_MODES];
+    int total_blend_modes = 0;
+    int blend_index = -1;
 
-    memcpy(dst, data, sizeof(float) * size);
+    qu_blend_mode blend_mode = priv.blend_mode;
+    struct qu__draw_sort_entry *entries = priv.sort_entries;
+    size_t total_entries = 0;
 
-    size_t offset = buffer->size;
-    buffer->size += size;
+    for (size_t i = begin; i < end; i++) {
+        if (commands[i].command == QU__RENDER_COMMAND_SET_BLEND_MODE) {
+            blend_mode = commands[i].args.blend.mode;
+            blend_index = -1;
+            continue;
+        }
 
-    return (unsigned int) (offset / vertex_size_map[format]);
-}
+        if (blend_index == -1) {
+            for (int j = 0; j < total_blend_modes; j++) {
+                if (memcmp(&blend_modes[j], &blend_mode, sizeof(qu_blend_mode)) == 0) {
+                    blend_index = j;
+                    break;
+                }
+            }
+        }
 
-static void graphics__upload_vertex_data(qu_vertex_format format)
-{
-    struct qu__vertex_buffer *buffer = &priv.vertex_buffers[format];
+        if (blend_index == -1) {
+            if (total_blend_modes == QU__MAX_SORTED_BLEND_MODES) {
+                for (size_t j = begin; j < end; j++) {
+                    graphics__execute_command(&commands[j]);
+                }
 
-    if (buffer->size == 0) {
-        return;
-    }
+                return;
+            }
 
-    priv.renderer->upload_vertex_data(format, buffer->data, buffer->size);
-    buffer->size = 0;
-}
+            blend_index = total_blend_modes;
+            blend_modes[total_blend_modes++] = blend_mode;
+        }
+
+        struct qu__draw_render_command_args const *draw = &commands[i].args.draw;
+
+        entries[total_entries++] = (struct qu__draw_sort_entry) {
+            .key = ((uint64_t) (uint16_t) (draw->layer + 32768) << 48)
+                 | ((uint64_t) blend_index << 40)
+                 | ((uint64_t) draw->brush << 36)
+                 | ((uint64_t) draw->vertex_format << 32)
+                 | ((uint64_t) (uint32_t) (uintptr_t) draw->texture),
+            .index = i,
+        };
+    }
+
+    if (total_entries > 0) {
+        entries = graphics__sort_draw_entries(entries, entries + total_entries, total_entries);
+    }
+
+    // Draws which became adjacent after sorting are merged if possible.
+    struct qu__draw_render_command_args pending;
+    int pending_blend_index = -1;
+
+    for (size_t i = 0; i < total_entries; i++) {
+        struct qu__draw_render_command_args const *draw = &commands[entries[i].index].args.draw;
+        int index = (entries[i].key >> 40) & 0xFF;
+
+        if (index == pending_blend_index && graphics__merge_draw_commands(&pending, draw)) {
+            continue;
+        }
+
+        if (pending_blend_index != -1) {
+            graphics__exec_set_blend_mode(&(struct qu__blend_render_command_args) {
+                .mode = blend_modes[pending_blend_index],
+            });
+
+            graphics__exec_draw(&pending);
+        }
+
+        pending = *draw;
+        pending_blend_index = index;
+    }
+
+    if (pending_blend_index != -1) {
+        graphics__exec_set_blend_mode(&(struct qu__blend_render_command_args) {
+            .mode = blend_modes[pending_blend_index],
+        });
+
+        graphics__exec_draw(&pending);
+    }
+
+    // Commands after the range expect the last blend mode in submission order.
+    graphics__exec_set_blend_mode(&(struct qu__blend_render_command_args) {
+        .mode = blend_mode,
+    });
+}
+
+static bool graphics__is_transform_command(enum qu__render_command command)
+{
+    return command == QU__RENDER_COMMAND_TRANSLATE
+        || command == QU__RENDER_COMMAND_SCALE
+        || command == QU__RENDER_COMMAND_ROTATE;
+}
+
+static bool graphics__is_view_command(enum qu__render_command command)
+{
+    return command == QU__RENDER_COMMAND_SET_VIEW || command == QU__RENDER_COMMAND_RESET_VIEW;
+}
+
+// Peephole pass which removes commands without visible effect and merges
+// the ones which can be merged. Runs right before execution, so current
+// surface and blend mode are known. Returns number of removed commands.
+static size_t graphics__optimize_command_buffer(struct qu__render_command_buffer *buffer)
+{
+    struct qu__render_command_info *data = buffer->data;
+    size_t size = 0;
+
+    qu_surface_obj *surface = priv.current_surface;
+    qu_surface_obj *previous_surface = NULL;
+
+    qu_blend_mode blend_mode = priv.blend_mode;
+    qu_blend_mode previous_blend_mode = blend_mode;
+
+    // Clear of the current surface with nothing drawn after it.
+    size_t last_clear = SIZE_MAX;
+
+    // Renderer keeps transform when surface is changed, so it's only
+    // known to match the top of the matrix stack after a transform.
+    // Push and pop can be removed only if it matched at the push.
+    bool transform_synced = false;
+    uint32_t push_synced_bits = 0;
+    int push_depth = 0;
+
+    for (size_t i = 0; i < buffer->size; i++) {
+        struct qu__render_command_info info = data[i];
+        struct qu__render_command_info *last = (size > 0) ? &data[size - 1] : NULL;
+
+        switch (info.command) {
+        case QU__RENDER_COMMAND_NO_OP:
+            continue;
+        case QU__RENDER_COMMAND_RESIZE:
+            last_clear = SIZE_MAX;
+            break;
+        case QU__RENDER_COMMAND_SET_SURFACE:
+            // Surface which is left before anything is done to it.
+            if (last && last->command == QU__RENDER_COMMAND_SET_SURFACE) {
+                surface = previous_surface;
+                size--;
+            }
+
+            if (info.args.surface.surface == surface) {
+                continue;
+            }
+
+            previous_surface = surface;
+            surface = info.args.surface.surface;
+            last_clear = SIZE_MAX;
+            transform_synced = false;
+            break;
+        case QU__RENDER_COMMAND_SET_VIEW:
+        case QU__RENDER_COMMAND_RESET_VIEW:
+            // Projection is replaced entirely.
+            if (last && graphics__is_view_command(last->command)) {
+                size--;
+            }
+            break;
+        case QU__RENDER_COMMAND_PUSH_MATRIX:
+            if (push_depth < 32 && transform_synced) {
+                push_synced_bits |= (1u << push_depth);
+            } else if (push_depth < 32) {
+                push_synced_bits &= ~(1u << push_depth);
+            }
+
+            push_depth++;
+            break;
+        case QU__RENDER_COMMAND_POP_MATRIX: {
+            // Transforms between push and pop are undone.
+            size_t push = size;
+            bool synced = push_depth > 0 && push_depth <= 32 && (push_synced_bits & (1u << (push_depth - 1)));
+
+            push_depth = QU_MAX(push_depth - 1, 0);
+
+            while (push > 0 && graphics__is_transform_command(data[push - 1].command)) {
+                push--;
+            }
+
+            if (synced && push > 0 && data[push - 1].command == QU__RENDER_COMMAND_PUSH_MATRIX) {
+                size = push - 1;
+                transform_synced = true;
+                continue;
+            }
+            break;
+        }
+        case QU__RENDER_COMMAND_TRANSLATE:
+        case QU__RENDER_COMMAND_SCALE:
+        case QU__RENDER_COMMAND_ROTATE:
+            transform_synced = true;
+
+            if (last && last->command == info.command) {
+                if (info.command == QU__RENDER_COMMAND_SCALE) {
+                    last->args.transform.a *= info.args.transform.a;
+                    last->args.transform.b *= info.args.transform.b;
+                } else {
+                    last->args.transform.a += info.args.transform.a;
+                    last->args.transform.b += info.args.transform.b;
+                }
+
+                continue;
+            }
+            break;
+        case QU__RENDER_COMMAND_SET_BLEND_MODE:
+            // Blend mode which isn't used by any draw.
+            if (last && last->command == QU__RENDER_COMMAND_SET_BLEND_MODE) {
+                blend_mode = previous_blend_mode;
+                size--;
+            }
+
+            if (memcmp(&info.args.blend.mode, &blend_mode, sizeof(qu_blend_mode)) == 0) {
+                continue;
+            }
+
+            previous_blend_mode = blend_mode;
+            blend_mode = info.args.blend.mode;
+            break;
+        case QU__RENDER_COMMAND_CLEAR:
+            // Surface is cleared again before anything is drawn.
+            // Commands in between don't draw, so they are moved back.
+            if (last_clear != SIZE_MAX) {
+                memmove(&data[last_clear], &data[last_clear + 1],
+                        sizeof(struct qu__render_command_info) * (size - last_clear - 1));
+                size--;
+            }
+
+            last_clear = size;
+            break;
+        case QU__RENDER_COMMAND_DRAW:
+            last_clear = SIZE_MAX;
+
+            // Draws may become adjacent after commands in between are removed.
+            if (last && last->command == QU__RENDER_COMMAND_DRAW
+                && graphics__merge_draw_commands(&last->args.draw, &info.args.draw)) {
+                continue;
+            }
+            break;
+        }
+
+        data[size++] = info;
+    }
+
+    size_t eliminated = buffer->size - size;
+    buffer->size = size;
+
+    return eliminated;
+}
+
+static void graphics__execute_command_buffer(struct qu__recorder *recorder)
+{
+    struct qu__render_command_buffer *buffer = &recorder->command_buffer;
+    size_t eliminated = graphics__optimize_command_buffer(buffer);
+
+    if (priv.renderer_stats.mutex) {
+        priv.renderer_stats.current.eliminated_commands += (int) eliminated;
+        priv.renderer_stats.current.culled_draws += recorder->culled_draws;
+    }
+
+    recorder->culled_draws = 0;
+
+    for (size_t i = 0; i < buffer->size;) {
+        if (recorder->sort_draws && graphics__is_sortable_command(buffer->data[i].command)) {
+            size_t end = i + 1;
+
+            while (end < buffer->size && graphics__is_sortable_command(buffer->data[end].command)) {
+                end++;
+            }
+
+            graphics__execute_sorted_commands(buffer->data, i, end);
+            i = end;
+        } else {
+            graphics__execute_command(&buffer->data[i++]);
+        }
+    }
+
+    buffer->size = 0;
+}
+
+//------------------------------------------------------------------------------
+// Texture uploads
+
+static bool graphics__dirty_rects_touch(qu_dirty_rect const *a, qu_dirty_rect const *b)
+{
+    return a->x0 <= b->x1 && b->x0 <= a->x1 && a->y0 <= b->y1 && b->y0 <= a->y1;
+}
+
+static qu_dirty_rect graphics__unite_dirty_rects(qu_dirty_rect const *a, qu_dirty_rect const *b)
+{
+    return (qu_dirty_rect) {
+        .x0 = QU_MIN(a->x0, b->x0),
+        .y0 = QU_MIN(a->y0, b->y0),
+        .x1 = QU_MAX(a->x1, b->x1),
+        .y1 = QU_MAX(a->y1, b->y1),
+    };
+}
+
+static int graphics__get_dirty_rect_area(qu_dirty_rect const *rect)
+{
+    return (rect->x1 - rect->x0) * (rect->y1 - rect->y0);
+}
+
+// Marks region of the texture to be uploaded on the next flush.
+// Overlapping or adjacent regions are merged. If there are too many,
+// the new one is merged with the one which grows the least.
+static void graphics__invalidate_texture(int32_t id, qu_texture_obj *texture, int x, int y, int w, int h)
+{
+    if (texture->total_dirty_rects == 0) {
+        if (priv.total_dirty_textures == priv.dirty_textures_capacity) {
+            int next_capacity = QU_MAX(16, 2 * priv.dirty_textures_capacity);
+            int32_t *next_data = pl_realloc(priv.dirty_textures, sizeof(int32_t) * next_capacity);
+
+            QU_HALT_IF(!next_data);
+
+            priv.dirty_textures = next_data;
+            priv.dirty_textures_capacity = next_capacity;
+        }
+
+        priv.dirty_textures[priv.total_dirty_textures++] = id;
+    }
+
+    qu_dirty_rect rect = { .x0 = x, .y0 = y, .x1 = x + w, .y1 = y + h };
+    qu_dirty_rect *rects = texture->dirty_rects;
+
+    while (true) {
+        for (int i = 0; i < texture->total_dirty_rects;) {
+            if (graphics__dirty_rects_touch(&rect, &rects[i])) {
+                rect = graphics__unite_dirty_rects(&rect, &rects[i]);
+                rects[i] = rects[--texture->total_dirty_rects];
+                i = 0;
+            } else {
+                i++;
+            }
+        }
+
+        if (texture->total_dirty_rects < QU_MAX_DIRTY_RECTS) {
+            break;
+        }
+
+        int best_index = 0;
+        int best_growth = INT_MAX;
+
+        for (int i = 0; i < texture->total_dirty_rects; i++) {
+            qu_dirty_rect united = graphics__unite_dirty_rects(&rect, &rects[i]);
+            int growth = graphics__get_dirty_rect_area(&united) - graphics__get_dirty_rect_area(&rects[i]);
+
+            if (growth < best_growth) {
+                best_index = i;
+                best_growth = growth;
+            }
+        }
+
+        rect = graphics__unite_dirty_rects(&rect, &rects[best_index]);
+        rects[best_index] = rects[--texture->total_dirty_rects];
+    }
+
+    rects[texture->total_dirty_rects++] = rect;
+}
+
+static void graphics__copy_dirty_rect(struct qu__texture_upload_buffer *buffer,
+                                      qu_texture_obj *texture, qu_dirty_rect const *rect)
+{
+    int w = rect->x1 - rect->x0;
+    int h = rect->y1 - rect->y0;
+    size_t row_size = (size_t) w * texture->channels;
+    size_t size = row_size * h;
+
+    if (buffer->total_uploads == buffer->uploads_capacity) {
+        int next_capacity = QU_MAX(16, 2 * buffer->uploads_capacity);
+        struct qu__texture_upload *next_uploads =
+            pl_realloc(buffer->uploads, sizeof(struct qu__texture_upload) * next_capacity);
+
+        QU_HALT_IF(!next_uploads);
+
+        buffer->uploads = next_uploads;
+        buffer->uploads_capacity = next_capacity;
+    }
+
+    if (buffer->pixels_capacity < (buffer->pixels_size + size)) {
+        size_t next_capacity = QU_MAX(2 * buffer->pixels_capacity, buffer->pixels_size + size);
+        unsigned char *next_pixels = pl_realloc(buffer->pixels, next_capacity);
+
+        QU_HALT_IF(!next_pixels);
+
+        buffer->pixels = next_pixels;
+        buffer->pixels_capacity = next_capacity;
+    }
+
+    for (int y = 0; y < h; y++) {
+        size_t offset = ((size_t) (rect->y0 + y) * texture->width + rect->x0) * texture->channels;
+        memcpy(buffer->pixels + buffer->pixels_size + (y * row_size), texture->pixels + offset, row_size);
+    }
+
+    buffer->uploads[buffer->total_uploads++] = (struct qu__texture_upload) {
+        .texture = texture,
+        .x = rect->x0,
+        .y = rect->y0,
+        .w = w,
+        .h = h,
+        .offset = buffer->pixels_size,
+    };
+
+    buffer->pixels_size += size;
+}
+
+// Executed by the render thread before the frame.
+static void graphics__execute_texture_uploads(struct qu__texture_upload_buffer *buffer)
+{
+    qu_renderer_impl const *renderer = priv.render_thread.renderer;
+
+    for (int i = 0; i < buffer->total_uploads; i++) {
+        struct qu__texture_upload const *upload = &buffer->uploads[i];
+
+        renderer->update_texture_region(upload->texture, upload->x, upload->y, upload->w, upload->h,
+                                        buffer->pixels + upload->offset);
+
+        if (upload->mipmaps) {
+            renderer->set_texture_mipmaps(upload->texture, true);
+        }
+    }
+
+    buffer->total_uploads = 0;
+    buffer->pixels_size = 0;
+}
+
+// With render thread, regions are copied and uploaded along with the frame,
+// so that recording doesn't wait for the frame which is being executed.
+static void graphics__upload_dirty_textures(void)
+{
+    struct qu__texture_upload_buffer *buffer = &priv.render_thread.pending_uploads;
+
+    for (int i = 0; i < priv.total_dirty_textures; i++) {
+        qu_texture_obj *texture = qu_handle_list_get(priv.textures, priv.dirty_textures[i]);
+
+        if (!texture) {
+            continue;
+        }
+
+        for (int j = 0; j < texture->total_dirty_rects; j++) {
+            qu_dirty_rect const *rect = &texture->dirty_rects[j];
+
+            if (priv.render_thread.thread) {
+                graphics__copy_dirty_rect(buffer, texture, rect);
+            } else {
+                priv.renderer->update_texture_region(texture, rect->x0, rect->y0,
+                                                     rect->x1 - rect->x0, rect->y1 - rect->y0, NULL);
+            }
+        }
+
+        // Mip levels are generated again once all regions are uploaded.
+        if (texture->mipmaps && texture->total_dirty_rects > 0) {
+            if (priv.render_thread.thread) {
+                buffer->uploads[buffer->total_uploads - 1].mipmaps = true;
+            } else {
+                priv.renderer->set_texture_mipmaps(texture, true);
+            }
+        }
+
+        texture->total_dirty_rects = 0;
+    }
+
+    priv.total_dirty_textures = 0;
+}
+
+//------------------------------------------------------------------------------
+// Texture atlas
+
+// Returns Y at which rectangle fits if placed at the node,
+// or -1 if it doesn't fit.
+static int graphics__fit_atlas_node(struct qu__atlas_page *page, int index, int w, int h)
+{
+    if (page->nodes[index].x + w > QU__ATLAS_PAGE_SIZE) {
+        return -1;
+    }
+
+    int y = 0;
+
+    for (int i = index, left = w; left > 0; i++) {
+        y = QU_MAX(y, page->nodes[i].y);
+
+        if (y + h > QU__ATLAS_PAGE_SIZE) {
+            return -1;
+        }
+
+        left -= page->nodes[i].w;
+    }
+
+    return y;
+}
+
+static void graphics__remove_atlas_node(struct qu__atlas_page *page, int index)
+{
+    memmove(&page->nodes[index], &page->nodes[index + 1],
+            sizeof(struct qu__atlas_node) * (page->total_nodes - index - 1));
+
+    page->total_nodes--;
+}
+
+static bool graphics__pack_atlas_rect(struct qu__atlas_page *page, int w, int h, int *x, int *y)
+{
+    int best_index = -1;
+    int best_bottom = QU__ATLAS_PAGE_SIZE + 1;
+    int best_width = QU__ATLAS_PAGE_SIZE + 1;
+
+    for (int i = 0; i < page->total_nodes; i++) {
+        int fit_y = graphics__fit_atlas_node(page, i, w, h);
+
+        if (fit_y == -1) {
+            continue;
+        }
+
+        if ((fit_y + h) < best_bottom || ((fit_y + h) == best_bottom && page->nodes[i].w < best_width)) {
+            best_index = i;
+            best_bottom = fit_y + h;
+            best_width = page->nodes[i].w;
+        }
+    }
+
+    if (best_index == -1) {
+        return false;
+    }
+
+    *x = page->nodes[best_index].x;
+    *y = best_bottom - h;
+
+    memmove(&page->nodes[best_index + 1], &page->nodes[best_index],
+            sizeof(struct qu__atlas_node) * (page->total_nodes - best_index));
+
+    page->nodes[best_index] = (struct qu__atlas_node) { .x = *x, .y = best_bottom, .w = w };
+    page->total_nodes++;
+
+    // Shrink or remove nodes covered by the new one.
+    for (int i = best_index + 1; i < page->total_nodes;) {
+        struct qu__atlas_node *prev = &page->nodes[i - 1];
+        struct qu__atlas_node *node = &page->nodes[i];
+
+        int overlap = (prev->x + prev->w) - node->x;
+
+        if (overlap <= 0) {
+            break;
+        }
+
+        if (overlap < node->w) {
+            node->x += overlap;
+            node->w -= overlap;
+            break;
+        }
+
+        graphics__remove_atlas_node(page, i);
+    }
+
+    // Merge neighbor nodes of the same height.
+    for (int i = 0; i < (page->total_nodes - 1);) {
+        if (page->nodes[i].y == page->nodes[i + 1].y) {
+            page->nodes[i].w += page->nodes[i + 1].w;
+            graphics__remove_atlas_node(page, i + 1);
+        } else {
+            i++;
+        }
+    }
+
+    return true;
+}
+
+// Edge pixels are repeated in padding, so neighbors don't bleed
+// into each other when the page is sampled with filtering.
+static void graphics__blit_atlas_image(qu_texture_obj *page_texture, int x, int y, int w, int h,
+                                       unsigned char const *pixels)
+{
+    size_t nc = page_texture->channels;
+
+    for (int i = -QU__ATLAS_PADDING; i < (h + QU__ATLAS_PADDING); i++) {
+        unsigned char const *src = pixels + QU_MIN(QU_MAX(i, 0), h - 1) * w * nc;
+        unsigned char *dst = page_texture->pixels + ((y + i) * page_texture->width + x) * nc;
+
+        memcpy(dst, src, w * nc);
+
+        for (int j = 1; j <= QU__ATLAS_PADDING; j++) {
+            memcpy(dst - j * nc, src, nc);
+            memcpy(dst + (w - 1 + j) * nc, src + (w - 1) * nc, nc);
+        }
+    }
+}
+
+static struct qu__atlas_page *graphics__find_atlas_page(int32_t texture_id)
+{
+    for (int i = 0; i < priv.total_atlas_pages; i++) {
+        if (priv.atlas_pages[i].texture_id == texture_id) {
+            return &priv.atlas_pages[i];
+        }
+    }
+
+    return NULL;
+}
+
+static struct qu__atlas_page *graphics__add_atlas_page(int channels)
+{
+    qu_texture_obj texture = {
+        .width = QU__ATLAS_PAGE_SIZE,
+        .height = QU__ATLAS_PAGE_SIZE,
+        .channels = channels,
+        .pixels = pl_calloc(QU__ATLAS_PAGE_SIZE * QU__ATLAS_PAGE_SIZE, channels),
+    };
+
+    if (!texture.pixels) {
+        return NULL;
+    }
+
+    int32_t texture_id = qu_handle_list_add(priv.textures, &texture);
+
+    if (!texture_id) {
+        return NULL;
+    }
+
+    struct qu__atlas_page *next_pages = pl_realloc(priv.atlas_pages,
+        sizeof(struct qu__atlas_page) * (priv.total_atlas_pages + 1));
+
+    QU_HALT_IF(!next_pages);
+
+    priv.atlas_pages = next_pages;
+
+    struct qu__atlas_page *page = &priv.atlas_pages[priv.total_atlas_pages++];
+
+    *page = (struct qu__atlas_page) {
+        .texture_id = texture_id,
+        .channels = channels,
+        .total_nodes = 1,
+    };
+
+    graphics__invalidate_texture(texture_id, qu_handle_list_get(priv.textures, texture_id),
+                                 0, 0, QU__ATLAS_PAGE_SIZE, QU__ATLAS_PAGE_SIZE);
+
+    // Each node is at least 1 pixel wide, plus one extra for insertion.
+    QU_ALLOC_ARRAY(page->nodes, QU__ATLAS_PAGE_SIZE + 1);
+    QU_HALT_IF(!page->nodes);
+
+    page->nodes[0] = (struct qu__atlas_node) { .x = 0, .y = 0, .w = QU__ATLAS_PAGE_SIZE };
+
+    QU_LOGD("Created atlas page #%d (%d channels).\n", priv.total_atlas_pages, channels);
+
+    return page;
+}
+
+// Copies pixels of the texture to an atlas page.
+// Returns false if the texture is too large for atlas.
+static bool graphics__add_texture_to_atlas(qu_texture_obj *texture)
+{
+    int w = texture->width + 2 * QU__ATLAS_PADDING;
+    int h = texture->height + 2 * QU__ATLAS_PADDING;
+
+    if (w > QU__ATLAS_PAGE_SIZE || h > QU__ATLAS_PAGE_SIZE) {
+        return false;
+    }
+
+    struct qu__atlas_page *page = NULL;
+    int x, y;
+
+    for (int i = 0; i < priv.total_atlas_pages; i++) {
+        struct qu__atlas_page *candidate = &priv.atlas_pages[i];
+
+        if (candidate->channels == texture->channels && graphics__pack_atlas_rect(candidate, w, h, &x, &y)) {
+            page = candidate;
+            break;
+        }
+    }
+
+    if (!page) {
+        page = graphics__add_atlas_page(texture->channels);
+
+        if (!page || !graphics__pack_atlas_rect(page, w, h, &x, &y)) {
+            return false;
+        }
+    }
+
+    qu_texture_obj *page_texture = qu_handle_list_get(priv.textures, page->texture_id);
+
+    graphics__blit_atlas_image(page_texture, x + QU__ATLAS_PADDING, y + QU__ATLAS_PADDING,
+                               texture->width, texture->height, texture->pixels);
+
+    page->total_textures++;
+
+    graphics__invalidate_texture(page->texture_id, page_texture, x, y, w, h);
+
+    texture->atlas_page = page->texture_id;
+    texture->atlas_x = x + QU__ATLAS_PADDING;
+    texture->atlas_y = y + QU__ATLAS_PADDING;
+
+    return true;
+}
+
+static void graphics__remove_texture_from_atlas(qu_texture_obj *texture)
+{
+    struct qu__atlas_page *page = graphics__find_atlas_page(texture->atlas_page);
+
+    if (!page || --page->total_textures > 0) {
+        return;
+    }
+
+    int32_t texture_id = page->texture_id;
+
+    pl_free(page->nodes);
+    *page = priv.atlas_pages[--priv.total_atlas_pages];
+
+    qu_handle_list_remove(priv.textures, texture_id);
+}
+
+// Returns texture which should be bound to draw the given one,
+// and adds offset of the texture within it to `x` and `y`.
+static qu_texture_obj *graphics__get_texture_page(qu_texture_obj *texture, int *x, int *y)
+{
+    if (!texture->atlas_page) {
+        return texture;
+    }
+
+    *x += texture->atlas_x;
+    *y += texture->atlas_y;
+
+    return qu_handle_list_get(priv.textures, texture->atlas_page);
+}
+
+//------------------------------------------------------------------------------
+// Vertex buffer
+
+static void graphics__grow_vertex_buffer(struct qu__vertex_buffer *buffer, size_t required_capacity)
+{
+    size_t next_capacity = buffer->capacity * 2;
+
+    while (next_capacity < required_capacity) {
+        next_capacity *= 2;
+    }
+
+    size_t data_bytes = sizeof(float) * next_capacity;
+    float *next_data = pl_realloc(buffer->data, data_bytes);
+
+    QU_HALT_IF(!next_data);
+
+    buffer->data = next_data;
+    buffer->capacity = next_capacity;
+}
+
+static void graphics__execute_recorder(struct qu__recorder *recorder);
+static void graphics__submit_frame(bool present);
+
+// Uploads and executes everything recorded so far,
+// so vertex buffers can be reused within the same frame.
+static void graphics__flush_vertex_data(void)
+{
+    graphics__upload_dirty_textures();
+
+    if (priv.render_thread.thread) {
+        graphics__submit_frame(false);
+    } else {
+        graphics__execute_recorder(&priv.recorder);
+    }
+}
+
+// Returns pointer to the space for `size` floats at the end of vertex buffer.
+// The pointer is only valid until the next call of this function.
+static float *graphics__reserve_vertex_data(qu_vertex_format format, size_t size, unsigned int *first_vertex)
+{
+    struct qu__recorder *recorder = graphics__get_recorder();
+    struct qu__vertex_buffer *buffer = &recorder->vertex_buffers[format];
+
+    // Draw contexts are never flushed, they are executed once submitted.
+    if (recorder == &priv.recorder && buffer->size > 0
+        && (buffer->size + size) > QU__VERTEX_BUFFER_FLUSH_THRESHOLD) {
+        graphics__flush_vertex_data();
+    }
+
+    size_t required_capacity = buffer->size + size;
+
+    if (buffer->capacity < required_capacity) {
+        graphics__grow_vertex_buffer(buffer, required_capacity);
+    }
+
+    float *dst = &buffer->data[buffer->size];
+
+    *first_vertex = (unsigned int) (buffer->size / vertex_size_map[format]);
+    buffer->size += size;
+
+    return dst;
+}
+
+// Gives back unused end of the space returned by the last reservation.
+static void graphics__release_vertex_data(qu_vertex_format format, size_t size)
+{
+    graphics__get_recorder()->vertex_buffers[format].size -= size;
+}
+
+static bool graphics__is_translation(qu_mat4 const *matrix)
+{
+    float const *m = matrix->m;
+
+    return m[0] == 1.f && m[1] == 0.f && m[4] == 0.f && m[5] == 1.f;
+}
+
+// With CPU transforms enabled, modelview matrix of the target surface
+// is applied to vertex positions here instead of the vertex shader.
+static void graphics__transform_vertex_data(qu_vertex_format format, float *data, size_t size)
+{
+    if (!priv.cpu_transforms) {
+        return;
+    }
+
+    qu_mat4 const *matrix = graphics__get_modelview(graphics__get_recorder()->target_surface);
+    float const *m = matrix->m;
+    size_t stride = vertex_size_map[format];
+
+    if (graphics__is_translation(matrix)) {
+        if (m[12] == 0.f && m[13] == 0.f) {
+            return;
+        }
+
+        for (size_t i = 0; i < size; i += stride) {
+            data[i + 0] += m[12];
+            data[i + 1] += m[13];
+        }
+
+        return;
+    }
+
+    for (size_t i = 0; i < size; i += stride) {
+        float x = data[i + 0];
+        float y = data[i + 1];
+
+        data[i + 0] = m[0] * x + m[4] * y + m[12];
+        data[i + 1] = m[1] * x + m[5] * y + m[13];
+    }
+}
+
+static unsigned int graphics__append_vertex_data(qu_vertex_format format, float const *data, size_t size)
+{
+    unsigned int first_vertex;
+    float *dst = graphics__reserve_vertex_data(format, size, &first_vertex);
+
+    memcpy(dst, data, sizeof(float) * size);
+    graphics__transform_vertex_data(format, dst, size);
+
+    return first_vertex;
+}
+
+// Color is stored as RGBA8 in a single float slot.
+// memcpy() is used so the bytes are never loaded as a float.
+static void graphics__write_color(float *dst, qu_color color)
+{
+    unsigned char const rgba[4] = {
+        (color >> 16) & 255,
+        (color >> 8) & 255,
+        (color >> 0) & 255,
+        (color >> 24) & 255,
+    };
+
+    memcpy(dst, rgba, sizeof(rgba));
+}
+
+// Color of 5XYCST vertex is in the slot right after the position.
+static void graphics__set_vertex_color(float *vertices, int count, qu_color color)
+{
+    for (int i = 0; i < count; i++) {
+        graphics__write_color(&vertices[5 * i + 2], color);
+    }
+}
+
+static void graphics__upload_vertex_data(qu_vertex_format format, struct qu__vertex_buffer *buffer)
+{
+    if (buffer->size == 0) {
+        return;
+    }
+
+    priv.renderer->upload_vertex_data(format, buffer->data, buffer->size);
+    buffer->size = 0;
+}
+
+static void graphics__execute_recorder(struct qu__recorder *recorder)
+{
+    for (int i = 0; i < QU_TOTAL_VERTEX_FORMATS; i++) {
+        graphics__upload_vertex_data(i, &recorder->vertex_buffers[i]);
+    }
+
+    graphics__execute_command_buffer(recorder);
+}
+
+//------------------------------------------------------------------------------
+// Draw contexts
+
+static void graphics__initialize_recorder(struct qu__recorder *recorder, qu_surface_obj *target_surface)
+{
+    QU_ALLOC_ARRAY(recorder->command_buffer.data, QU__RENDER_COMMAND_BUFFER_INITIAL_CAPACITY);
+    QU_HALT_IF(!recorder->command_buffer.data);
+
+    recorder->command_buffer.size = 0;
+    recorder->command_buffer.capacity = QU__RENDER_COMMAND_BUFFER_INITIAL_CAPACITY;
+
+    for (int i = 0; i < QU_TOTAL_VERTEX_FORMATS; i++) {
+        QU_ALLOC_ARRAY(recorder->vertex_buffers[i].data, QU__VERTEX_BUFFER_INITIAL_CAPACITY);
+        QU_HALT_IF(!recorder->vertex_buffers[i].data);
+
+        recorder->vertex_buffers[i].size = 0;
+        recorder->vertex_buffers[i].capacity = QU__VERTEX_BUFFER_INITIAL_CAPACITY;
+    }
+
+    recorder->target_surface = target_surface;
+    recorder->sort_draws = false;
+    recorder->draw_layer = 0;
+    recorder->culled_draws = 0;
+}
+
+static void graphics__terminate_recorder(struct qu__recorder *recorder)
+{
+    pl_free(recorder->command_buffer.data);
+
+    for (int i = 0; i < QU_TOTAL_VERTEX_FORMATS; i++) {
+        pl_free(recorder->vertex_buffers[i].data);
+    }
+}
+
+static void draw_context_dtor(void *ptr)
+{
+    struct qu__draw_context *context = *((struct qu__draw_context **) ptr);
+
+    graphics__terminate_recorder(&context->recorder);
+    pl_free(context);
+}
+
+// Appends draw calls recorded in a draw context to the main recorder.
+// Vertex data is copied, so the context can be submitted again.
+static void graphics__submit_recorder(struct qu__recorder const *source)
+{
+    struct qu__recorder *target = &priv.recorder;
+
+    for (int i = 0; i < QU_TOTAL_VERTEX_FORMATS; i++) {
+        size_t size = target->vertex_buffers[i].size;
+
+        if (size > 0 && (size + source->vertex_buffers[i].size) > QU__VERTEX_BUFFER_FLUSH_THRESHOLD) {
+            graphics__flush_vertex_data();
+            break;
+        }
+    }
+
+    unsigned int base_vertex[QU_TOTAL_VERTEX_FORMATS] = { 0 };
+
+    for (int i = 0; i < QU_TOTAL_VERTEX_FORMATS; i++) {
+        size_t size = source->vertex_buffers[i].size;
+
+        if (size > 0) {
+            float *dst = graphics__reserve_vertex_data(i, size, &base_vertex[i]);
+            memcpy(dst, source->vertex_buffers[i].data, sizeof(float) * size);
+        }
+    }
+
+    for (size_t i = 0; i < source->command_buffer.size; i++) {
+        struct qu__render_command_info info = source->command_buffer.data[i];
+
+        if (info.command == QU__RENDER_COMMAND_DRAW) {
+            info.args.draw.first_vertex += base_vertex[info.args.draw.vertex_format];
+        }
+
+        graphics__track_render_command(&info);
+        graphics__push_render_command(&target->command_buffer, &info);
+    }
+
+    if (source->sort_draws) {
+        target->sort_draws = true;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+static void graphics__update_canvas_coords(int w_display, int h_display)
+{
+    float ard = w_display / (float) h_display;
+    float arc = priv.canvas.texture.width / (float) priv.canvas.texture.height;
+
+    if (ard > arc) {
+        priv.canvas_ax = (w_display / 2.f) - ((arc / ard) * w_display / 2.f);
+        priv.canvas_ay = 0.f;
+        priv.canvas_bx = (w_display / 2.f) + ((arc / ard) * w_display / 2.f);
+        priv.canvas_by = h_display;
+    } else {
+        priv.canvas_ax = 0.f;
+        priv.canvas_ay = (h_display / 2.f) - ((ard / arc) * h_display / 2.f);
+        priv.canvas_bx = w_display;
+        priv.canvas_by = (h_display / 2.f) + ((ard / arc) * h_display / 2.f);
+    }
+}
+
+static void graphics__flush_canvas(void)
+{
+    priv.recorder.target_surface = &priv.display;
+
+    graphics__append_render_command(&(struct qu__render_command_info) {
+        .command = QU__RENDER_COMMAND_SET_SURFACE,
+        .args.surface.surface = &priv.display,
+    });
+
+    graphics__append_render_command(&(struct qu__render_command_info) {
+        .command = QU__RENDER_COMMAND_CLEAR,
+        .args.clear.color = QU_COLOR(0, 0, 0),
+    });
+
+    float vertices[] = {
+        priv.canvas_ax, priv.canvas_ay, 0.f, 1.f,
+        priv.canvas_bx, priv.canvas_ay, 1.f, 1.f,
+        priv.canvas_bx, priv.canvas_by, 1.f, 0.f,
+        priv.canvas_ax, priv.canvas_by, 0.f, 0.f,
+    };
+
+    graphics__append_render_command(&(struct qu__render_command_info) {
+        .command = QU__RENDER_COMMAND_DRAW,
+        .args.draw = {
+            .texture = &priv.canvas.texture,
+            .color = QU_COLOR(255, 255, 255),
+            .brush = QU_BRUSH_TEXTURED,
+            .render_mode = QU_RENDER_MODE_TRIANGLE_FAN,
+            .vertex_format = QU_VERTEX_FORMAT_4XYST,
+            .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_4XYST, vertices, 16),
+            .total_vertices = 4,
+        },
+    });
+}
+
+static unsigned int const compression_feature_bits[QU_TOTAL_IMAGE_COMPRESSIONS] = {
+    [QU_IMAGE_COMPRESSION_BC1] = QU_RENDERER_FEATURE_BIT_BC1,
+    [QU_IMAGE_COMPRESSION_BC3] = QU_RENDERER_FEATURE_BIT_BC3,
+    [QU_IMAGE_COMPRESSION_BC7] = QU_RENDERER_FEATURE_BIT_BC7,
+};
+
+// Compressed blocks are kept as is if renderer supports them,
+// otherwise they are decompressed by the loader.
+static bool graphics__decode_compressed_texture(qu_texture_obj *texture, qu_image_loader *loader)
+{
+    size_t size = qu_get_compressed_image_size(loader->compression, loader->width, loader->height);
+
+    if (size == 0) {
+        return false;
+    }
+
+    texture->compression = loader->compression;
+    texture->pixels = pl_malloc(size);
+
+    if (!texture->pixels) {
+        return false;
+    }
+
+    return qu_image_loader_load_compressed(loader, texture->pixels) == QU_SUCCESS;
+}
+
+// Decodes image file to the pixel array of the texture.
+// File is closed afterwards.
+static bool graphics__decode_texture(qu_texture_obj *texture, qu_file *file)
+{
+    if (!file) {
+        return false;
+    }
+
+    qu_image_loader *loader = qu_open_image_loader(file);
+
+    if (!loader) {
+        qu_close_file(file);
+        return false;
+    }
+
+    texture->width = loader->width;
+    texture->height = loader->height;
+    texture->channels = loader->channels;
+    texture->compression = QU_IMAGE_COMPRESSION_NONE;
+
+    qu_result status = QU_FAILURE;
+
+    if (priv.renderer_features & compression_feature_bits[loader->compression]) {
+        if (graphics__decode_compressed_texture(texture, loader)) {
+            status = QU_SUCCESS;
+        }
+    } else {
+        size_t size = qu_get_pixel_data_size(loader->width, loader->height, loader->channels);
+
+        texture->pixels = size ? pl_malloc(size) : NULL;
+
+        if (texture->pixels) {
+            status = qu_image_loader_load(loader, texture->pixels);
+        }
+    }
+
+    qu_close_image_loader(loader);
+    qu_close_file(file);
+
+    if (status != QU_SUCCESS) {
+        pl_free(texture->pixels);
+        texture->pixels = NULL;
+        texture->compression = QU_IMAGE_COMPRESSION_NONE;
+        return false;
+    }
+
+    return true;
+}
+
+static void graphics__restore_texture(qu_texture_obj *texture)
+{
+    qu_file *file = NULL;
+
+    if (texture->source_path) {
+        file = qu_open_file_from_path(texture->source_path);
+    } else if (texture->source_buffer) {
+        file = qu_open_file_from_buffer(texture->source_buffer, texture->source_size);
+    }
+
+    if (!graphics__decode_texture(texture, file)) {
+        QU_LOGE("Failed to restore texture.\n");
+    }
+
+    // Texture is created even if it can't be decoded.
+    priv.renderer->load_texture(texture);
+
+    pl_free(texture->pixels);
+    texture->pixels = NULL;
+}
+
+static void texture_dtor(void *ptr)
+{
+    qu_texture_obj *texture = ptr;
+
+    if (texture->atlas_page) {
+        graphics__remove_texture_from_atlas(texture);
+        return;
+    }
+
+    pl_free(texture->pixels);
+    pl_free(texture->source_path);
+
+    if (!priv.renderer) {
+        return;
+    }
+
+    // This won't be called on surface textures.
+    priv.renderer->unload_texture(texture);
+}
+
+static void graphics__release_surface(qu_surface_obj *surface);
+
+static void surface_dtor(void *ptr)
+{
+    qu_surface_obj *surface = *((qu_surface_obj **) ptr);
+
+    // Renderer objects are gone along with the renderer.
+    if (!priv.renderer) {
+        pl_free(surface);
+        return;
+    }
+
+    graphics__release_surface(surface);
+}
+
+//------------------------------------------------------------------------------
+// Surface pool
+
+static void graphics__invoke(void (*job)(void *), void *arg);
+
+static qu_surface_obj *graphics__get_surface(int32_t id)
+{
+    qu_surface_obj **surface = qu_handle_list_get(priv.surfaces, id);
+    return surface ? *surface : NULL;
+}
+
+static void graphics__reset_surface_transform(qu_surface_obj *surface)
+{
+    qu_mat4_ortho(&surface->projection, 0.f, surface->texture.width, surface->texture.height, 0.f);
+    qu_mat4_identity(&surface->modelview[0]);
+    surface->modelview_index = 0;
+
+    graphics__initialize_recorded_state(surface);
+}
+
+static void graphics__release_surface(qu_surface_obj *surface)
+{
+    struct qu__surface_pool *pool = &priv.surface_pool;
+
+    if (pool->total_entries == pool->entries_capacity) {
+        int next_capacity = QU_MAX(16, 2 * pool->entries_capacity);
+        struct qu__pooled_surface *next_entries =
+            pl_realloc(pool->entries, sizeof(struct qu__pooled_surface) * next_capacity);
+
+        QU_HALT_IF(!next_entries);
+
+        pool->entries = next_entries;
+        pool->entries_capacity = next_capacity;
+    }
+
+    pool->entries[pool->total_entries++] = (struct qu__pooled_surface) {
+        .surface = surface,
+        .frame = pool->frame,
+    };
+}
+
+// Returns pooled surface of the given size and sample count which
+// isn't used by any frame being executed, or NULL if there is none.
+static qu_surface_obj *graphics__reuse_surface(int width, int height, int sample_count)
+{
+    struct qu__surface_pool *pool = &priv.surface_pool;
+    int index = -1;
+
+    if (pool->max_sample_count > 0) {
+        sample_count = QU_MIN(sample_count, pool->max_sample_count);
+    }
+
+    for (int i = 0; i < pool->total_entries; i++) {
+        qu_surface_obj *surface = pool->entries[i].surface;
+
+        if (pool->entries[i].frame >= pool->executed_frames) {
+            continue;
+        }
+
+        if (surface->texture.width != width || surface->texture.height != height
+            || QU_MAX(surface->sample_count, 1) != QU_MAX(sample_count, 1)) {
+            continue;
+        }
+
+        index = i;
+
+        // Prefer the one which doesn't need smoothing reset.
+        if (!surface->texture.smooth) {
+            break;
+        }
+    }
+
+    if (index == -1) {
+        return NULL;
+    }
+
+    qu_surface_obj *surface = pool->entries[index].surface;
+    pool->entries[index] = pool->entries[--pool->total_entries];
+
+    if (surface->texture.smooth) {
+        priv.renderer->set_texture_smooth(&surface->texture, false);
+        surface->texture.smooth = false;
+    }
+
+    graphics__reset_surface_transform(surface);
+
+    return surface;
+}
+
+// Executed on the thread which owns graphics context, so that
+// nothing refers to the surface once it's freed.
+static void graphics__destroy_surface(qu_surface_obj *surface)
+{
+    if (priv.current_texture == &surface->texture) {
+        priv.renderer->apply_texture(NULL);
+        priv.current_texture = NULL;
+    }
+
+    if (priv.current_surface == surface) {
+        graphics__exec_set_surface(&(struct qu__surface_render_command_args) {
+            .surface = &priv.display,
+        });
+    }
+
+    priv.renderer->destroy_surface(surface);
+    pl_free(surface);
+}
+
+static void graphics__clear_surface_pool(void)
+{
+    struct qu__surface_pool *pool = &priv.surface_pool;
+
+    for (int i = 0; i < pool->total_entries; i++) {
+        graphics__destroy_surface(pool->entries[i].surface);
+    }
+
+    pool->total_entries = 0;
+    pool->max_sample_count = 0;
+}
+
+static void graphics__trim_surface_pool_job(void *arg)
+{
+    struct qu__surface_pool *pool = &priv.surface_pool;
+
+    for (int i = 0; i < pool->total_entries;) {
+        if ((pool->frame - pool->entries[i].frame) > QU__SURFACE_POOL_MAX_AGE) {
+            graphics__destroy_surface(pool->entries[i].surface);
+            pool->entries[i] = pool->entries[--pool->total_entries];
+        } else {
+            i++;
+        }
+    }
+}
+
+// Called when the frame is presented. Transient surfaces are deleted,
+// and pooled surfaces which aren't reused for a while are destroyed.
+static void graphics__update_surface_pool(void)
+{
+    struct qu__surface_pool *pool = &priv.surface_pool;
+
+    for (int i = 0; i < pool->total_transient_surfaces; i++) {
+        qu_delete_surface((qu_surface) { .id = pool->transient_surfaces[i] });
+    }
+
+    pool->total_transient_surfaces = 0;
+    pool->frame++;
+
+    // Render thread may still be executing the frame.
+    pool->executed_frames = priv.render_thread.thread ? (pool->frame - 1) : pool->frame;
+
+    for (int i = 0; i < pool->total_entries; i++) {
+        if ((pool->frame - pool->entries[i].frame) > QU__SURFACE_POOL_MAX_AGE) {
+            graphics__invoke(graphics__trim_surface_pool_job, NULL);
+            break;
+        }
+    }
+}
+
+static qu_surface graphics__create_surface(int width, int height, int sample_count)
+{
+    qu_surface_obj *surface = graphics__reuse_surface(width, height, sample_count);
+
+    if (surface) {
+        qu_surface_obj *current = priv.culling.surface;
+
+        // Reused surface is cleared, since a new one would be empty.
+        graphics__append_render_command(&(struct qu__render_command_info) {
+            .command = QU__RENDER_COMMAND_SET_SURFACE,
+            .args.surface.surface = surface,
+        });
+
+        graphics__append_render_command(&(struct qu__render_command_info) {
+            .command = QU__RENDER_COMMAND_CLEAR,
+            .args.clear.color = QU_RGBA(0, 0, 0, 0),
+        });
+
+        graphics__append_render_command(&(struct qu__render_command_info) {
+            .command = QU__RENDER_COMMAND_SET_SURFACE,
+            .args.surface.surface = current,
+        });
+    } else {
+        surface = pl_calloc(1, sizeof(*surface));
+
+        if (!surface) {
+            return (qu_surface) { .id = 0 };
+        }
+
+        surface->texture.width = width;
+        surface->texture.height = height;
+
+        graphics__reset_surface_transform(surface);
+        priv.renderer->create_surface(surface);
+
+        if (sample_count > 1) {
+            priv.renderer->set_surface_antialiasing_level(surface, sample_count);
+
+            if (surface->sample_count < sample_count) {
+                priv.surface_pool.max_sample_count = QU_MAX(surface->sample_count, 1);
+            }
+        }
+    }
+
+    // Surface is released by the handle list if it can't be added.
+    int32_t id = qu_handle_list_add(priv.surfaces, &surface);
+
+    if (id) {
+        surface->id = id;
+    }
+
+    return (qu_surface) { .id = id };
+}
+
+//------------------------------------------------------------------------------
+// Renderer statistics
+
+static char const *renderer_function_names[QU_TOTAL_RENDERER_FUNCTIONS] = {
+    [QU_RENDERER_FUNCTION_UPLOAD_VERTEX_DATA] = "upload_vertex_data",
+    [QU_RENDERER_FUNCTION_UPLOAD_INDEX_DATA] = "upload_index_data",
+    [QU_RENDERER_FUNCTION_APPLY_PROJECTION] = "apply_projection",
+    [QU_RENDERER_FUNCTION_APPLY_TRANSFORM] = "apply_transform",
+    [QU_RENDERER_FUNCTION_APPLY_SURFACE] = "apply_surface",
+    [QU_RENDERER_FUNCTION_APPLY_TEXTURE] = "apply_texture",
+    [QU_RENDERER_FUNCTION_APPLY_CLEAR_COLOR] = "apply_clear_color",
+    [QU_RENDERER_FUNCTION_APPLY_DRAW_COLOR] = "apply_draw_color",
+    [QU_RENDERER_FUNCTION_APPLY_BRUSH] = "apply_brush",
+    [QU_RENDERER_FUNCTION_APPLY_VERTEX_FORMAT] = "apply_vertex_format",
+    [QU_RENDERER_FUNCTION_APPLY_BLEND_MODE] = "apply_blend_mode",
+    [QU_RENDERER_FUNCTION_EXEC_RESIZE] = "exec_resize",
+    [QU_RENDERER_FUNCTION_EXEC_CLEAR] = "exec_clear",
+    [QU_RENDERER_FUNCTION_EXEC_DRAW] = "exec_draw",
+    [QU_RENDERER_FUNCTION_EXEC_DRAW_INDEXED] = "exec_draw_indexed",
+    [QU_RENDERER_FUNCTION_EXEC_DRAW_INSTANCED] = "exec_draw_instanced",
+    [QU_RENDERER_FUNCTION_LOAD_TEXTURE] = "load_texture",
+    [QU_RENDERER_FUNCTION_UPDATE_TEXTURE_REGION] = "update_texture_region",
+    [QU_RENDERER_FUNCTION_UNLOAD_TEXTURE] = "unload_texture",
+    [QU_RENDERER_FUNCTION_SET_TEXTURE_SMOOTH] = "set_texture_smooth",
+    [QU_RENDERER_FUNCTION_SET_TEXTURE_MIPMAPS] = "set_texture_mipmaps",
+    [QU_RENDERER_FUNCTION_CREATE_SURFACE] = "create_surface",
+    [QU_RENDERER_FUNCTION_DESTROY_SURFACE] = "destroy_surface",
+    [QU_RENDERER_FUNCTION_SET_SURFACE_ANTIALIASING_LEVEL] = "set_surface_antialiasing_level",
+};
+
+static void graphics__count_renderer_call(qu_renderer_function function, uint64_t start)
+{
+    double time = (pl_get_ticks_highp() - start) / 1e9;
+
+    priv.renderer_stats.current.calls[function]++;
+    priv.renderer_stats.current.call_times[function] += time;
+    priv.renderer_stats.current.renderer_time += time;
+}
+
+#define QU__STATS_CALL(function, call) \
+    do { \
+        uint64_t start = pl_get_ticks_highp(); \
+        priv.renderer_stats.renderer->call; \
+        graphics__count_renderer_call(function, start); \
+    } while (0)
+
+static void stats_upload_vertex_data(qu_vertex_format vertex_format, float const *data, size_t size)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_UPLOAD_VERTEX_DATA, upload_vertex_data(vertex_format, data, size));
+    priv.renderer_stats.current.vertex_bytes += sizeof(float) * size;
+}
+
+static void stats_upload_index_data(uint16_t const *data, size_t size)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_UPLOAD_INDEX_DATA, upload_index_data(data, size));
+}
+
+static void stats_apply_projection(qu_mat4 const *projection)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_APPLY_PROJECTION, apply_projection(projection));
+}
+
+static void stats_apply_transform(qu_mat4 const *transform)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_APPLY_TRANSFORM, apply_transform(transform));
+}
+
+static void stats_apply_surface(qu_surface_obj const *surface)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_APPLY_SURFACE, apply_surface(surface));
+    priv.renderer_stats.current.surface_switches++;
+}
+
+static void stats_apply_texture(qu_texture_obj const *texture)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_APPLY_TEXTURE, apply_texture(texture));
+    priv.renderer_stats.current.texture_binds++;
+}
+
+static void stats_apply_clear_color(qu_color clear_color)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_APPLY_CLEAR_COLOR, apply_clear_color(clear_color));
+}
+
+static void stats_apply_draw_color(qu_color draw_color)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_APPLY_DRAW_COLOR, apply_draw_color(draw_color));
+}
+
+static void stats_apply_brush(qu_brush brush)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_APPLY_BRUSH, apply_brush(brush));
+    priv.renderer_stats.current.program_switches++;
+}
+
+static void stats_apply_vertex_format(qu_vertex_format vertex_format)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_APPLY_VERTEX_FORMAT, apply_vertex_format(vertex_format));
+}
+
+static void stats_apply_blend_mode(qu_blend_mode mode)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_APPLY_BLEND_MODE, apply_blend_mode(mode));
+}
+
+static void stats_exec_resize(int width, int height)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_EXEC_RESIZE, exec_resize(width, height));
+}
+
+static void stats_exec_clear(void)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_EXEC_CLEAR, exec_clear());
+}
+
+static void stats_exec_draw(qu_render_mode render_mode, unsigned int first_vertex, unsigned int total_vertices)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_EXEC_DRAW, exec_draw(render_mode, first_vertex, total_vertices));
+    priv.renderer_stats.current.draw_calls++;
+    priv.renderer_stats.current.vertices += total_vertices;
+}
+
+static void stats_exec_draw_indexed(qu_render_mode render_mode, unsigned int first_vertex,
+                                    unsigned int first_index, unsigned int total_indices)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_EXEC_DRAW_INDEXED, exec_draw_indexed(render_mode, first_vertex, first_index, total_indices));
+    priv.renderer_stats.current.draw_calls++;
+    priv.renderer_stats.current.vertices += total_indices;
+}
+
+static void stats_exec_draw_instanced(qu_render_mode render_mode, unsigned int total_vertices,
+                                      unsigned int first_instance, unsigned int total_instances)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_EXEC_DRAW_INSTANCED, exec_draw_instanced(render_mode, total_vertices, first_instance, total_instances));
+    priv.renderer_stats.current.draw_calls++;
+    priv.renderer_stats.current.vertices += total_vertices * total_instances;
+}
+
+static void stats_load_texture(qu_texture_obj *texture)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_LOAD_TEXTURE, load_texture(texture));
+    priv.renderer_stats.current.texture_uploads++;
+}
+
+static void stats_update_texture_region(qu_texture_obj *texture, int x, int y, int w, int h,
+                                        unsigned char const *pixels)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_UPDATE_TEXTURE_REGION, update_texture_region(texture, x, y, w, h, pixels));
+    priv.renderer_stats.current.texture_uploads++;
+}
+
+static void stats_unload_texture(qu_texture_obj *texture)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_UNLOAD_TEXTURE, unload_texture(texture));
+}
+
+static void stats_set_texture_smooth(qu_texture_obj *texture, bool smooth)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_SET_TEXTURE_SMOOTH, set_texture_smooth(texture, smooth));
+}
+
+static void stats_set_texture_mipmaps(qu_texture_obj *texture, bool mipmaps)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_SET_TEXTURE_MIPMAPS, set_texture_mipmaps(texture, mipmaps));
+}
+
+static void stats_create_surface(qu_surface_obj *surface)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_CREATE_SURFACE, create_surface(surface));
+}
+
+static void stats_destroy_surface(qu_surface_obj *surface)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_DESTROY_SURFACE, destroy_surface(surface));
+}
+
+static void stats_set_surface_antialiasing_level(qu_surface_obj *surface, int level)
+{
+    QU__STATS_CALL(QU_RENDERER_FUNCTION_SET_SURFACE_ANTIALIASING_LEVEL, set_surface_antialiasing_level(surface, level));
+}
+
+// Wraps the selected renderer. Functions which aren't
+// called during a frame are passed through.
+static void graphics__install_renderer_stats(void)
+{
+    struct qu__renderer_stats *stats = &priv.renderer_stats;
+
+    if (!stats->mutex) {
+        stats->mutex = pl_create_mutex();
+    }
+
+    stats->renderer = priv.renderer;
+    stats->decorator = *priv.renderer;
+
+    stats->decorator.upload_vertex_data = stats_upload_vertex_data;
+    stats->decorator.upload_index_data = stats_upload_index_data;
+    stats->decorator.apply_projection = stats_apply_projection;
+    stats->decorator.apply_transform = stats_apply_transform;
+    stats->decorator.apply_surface = stats_apply_surface;
+    stats->decorator.apply_texture = stats_apply_texture;
+    stats->decorator.apply_clear_color = stats_apply_clear_color;
+    stats->decorator.apply_draw_color = stats_apply_draw_color;
+    stats->decorator.apply_brush = stats_apply_brush;
+    stats->decorator.apply_vertex_format = stats_apply_vertex_format;
+    stats->decorator.apply_blend_mode = stats_apply_blend_mode;
+    stats->decorator.exec_resize = stats_exec_resize;
+    stats->decorator.exec_clear = stats_exec_clear;
+    stats->decorator.exec_draw = stats_exec_draw;
+    stats->decorator.exec_draw_indexed = stats_exec_draw_indexed;
+    stats->decorator.exec_draw_instanced = stats_exec_draw_instanced;
+    stats->decorator.load_texture = stats_load_texture;
+    stats->decorator.update_texture_region = stats_update_texture_region;
+    stats->decorator.unload_texture = stats_unload_texture;
+    stats->decorator.set_texture_smooth = stats_set_texture_smooth;
+    stats->decorator.set_texture_mipmaps = stats_set_texture_mipmaps;
+    stats->decorator.create_surface = stats_create_surface;
+    stats->decorator.destroy_surface = stats_destroy_surface;
+    stats->decorator.set_surface_antialiasing_level = stats_set_surface_antialiasing_level;
+
+    priv.renderer = &stats->decorator;
+}
+
+// Called when a presented frame is done executing.
+static void graphics__finish_stats_frame(void)
+{
+    struct qu__renderer_stats *stats = &priv.renderer_stats;
+
+    if (!stats->mutex) {
+        return;
+    }
+
+    pl_lock_mutex(stats->mutex);
+    stats->last = stats->current;
+    pl_unlock_mutex(stats->mutex);
+
+    memset(&stats->current, 0, sizeof(stats->current));
+}
+
+//------------------------------------------------------------------------------
+// GPU timers
+
+static void graphics__enable_gpu_timers(void)
+{
+    if (!(priv.renderer_features & QU_RENDERER_FEATURE_BIT_GPU_TIMERS)) {
+        QU_LOGW("GPU timers are not supported by the renderer.\n");
+        return;
+    }
+
+    if (!priv.gpu_timers.mutex) {
+        priv.gpu_timers.mutex = pl_create_mutex();
+    }
+
+    priv.renderer->enable_gpu_timers();
+}
+
+// Called when a presented frame is done executing.
+static void graphics__finish_gpu_timer_frame(void)
+{
+    if (!priv.gpu_timers.mutex) {
+        return;
+    }
+
+    qu_gpu_timings timings;
+
+    if (priv.renderer->end_gpu_frame(&timings)) {
+        pl_lock_mutex(priv.gpu_timers.mutex);
+        priv.gpu_timers.last = timings;
+        pl_unlock_mutex(priv.gpu_timers.mutex);
+    }
+}
+
+static double graphics__get_gpu_time(int32_t surface_id)
+{
+    if (!priv.gpu_timers.mutex) {
+        return 0.0;
+    }
+
+    double time = 0.0;
+
+    pl_lock_mutex(priv.gpu_timers.mutex);
+
+    for (int i = 0; i < priv.gpu_timers.last.total_timers; i++) {
+        if (priv.gpu_timers.last.timers[i].surface_id == surface_id) {
+            time += priv.gpu_timers.last.timers[i].time;
+        }
+    }
+
+    pl_unlock_mutex(priv.gpu_timers.mutex);
+
+    return time;
+}
+
+//------------------------------------------------------------------------------
+// Frame capture
+
+// Capture file starts with a header, followed by records. Each record
+// is a byte with renderer function or marker, followed by arguments.
+// Textures and surfaces are referred to by capture IDs. Values are
+// written in native byte order.
+#define QU__CAPTURE_MAGIC                               0x50414351 // "QCAP"
+#define QU__CAPTURE_VERSION                             1
+
+#define QU__CAPTURE_DISPLAY_ID                          1
+#define QU__CAPTURE_FIRST_ID                            2
+
+enum qu__capture_marker
+{
+    // Resources and state which existed before the first frame.
+    QU__CAPTURE_MARKER_END_SETUP = QU_TOTAL_RENDERER_FUNCTIONS,
+    QU__CAPTURE_MARKER_END_FRAME,
+};
+
+struct qu__capture_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t renderer_features;
+    int32_t display_width;
+    int32_t display_height;
+};
+
+struct qu__capture_request
+{
+    char const *path;
+    int count;
+    bool accepted;
+};
+
+static void graphics__apply_renderer_state(qu_renderer_impl const *renderer);
+
+static void capture__write(void const *data, size_t size)
+{
+    fwrite(data, size, 1, priv.frame_capture.file);
+}
+
+static void capture__write_record(int record)
+{
+    uint8_t value = (uint8_t) record;
+    capture__write(&value, sizeof(value));
+}
+
+static void capture__write_int(int32_t value)
+{
+    capture__write(&value, sizeof(value));
+}
+
+static void capture__write_bool(bool value)
+{
+    uint8_t byte = value ? 1 : 0;
+    capture__write(&byte, sizeof(byte));
+}
+
+static void capture__write_size(size_t size)
+{
+    uint64_t value = size;
+    capture__write(&value, sizeof(value));
+}
+
+static void capture__write_id(qu_texture_obj const *texture)
+{
+    uint32_t id = texture ? texture->capture_id : 0;
+    capture__write(&id, sizeof(id));
+}
+
+static size_t capture__get_texture_data_size(qu_texture_obj const *texture)
+{
+    if (texture->compression) {
+        return qu_get_compressed_image_size(texture->compression, texture->width, texture->height);
+    }
+
+    return (size_t) texture->width * texture->height * texture->channels;
+}
+
+static void capture_upload_vertex_data(qu_vertex_format vertex_format, float const *data, size_t size)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_UPLOAD_VERTEX_DATA);
+        capture__write_int(vertex_format);
+        capture__write_size(size);
+        capture__write(data, sizeof(float) * size);
+    }
+
+    priv.frame_capture.renderer->upload_vertex_data(vertex_format, data, size);
+}
+
+static void capture_upload_index_data(uint16_t const *data, size_t size)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_UPLOAD_INDEX_DATA);
+        capture__write_size(size);
+        capture__write(data, sizeof(uint16_t) * size);
+    }
+
+    priv.frame_capture.renderer->upload_index_data(data, size);
+}
+
+static void capture_apply_projection(qu_mat4 const *projection)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_APPLY_PROJECTION);
+        capture__write(projection, sizeof(qu_mat4));
+    }
+
+    priv.frame_capture.renderer->apply_projection(projection);
+}
+
+static void capture_apply_transform(qu_mat4 const *transform)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_APPLY_TRANSFORM);
+        capture__write(transform, sizeof(qu_mat4));
+    }
+
+    priv.frame_capture.renderer->apply_transform(transform);
+}
+
+static void capture_apply_surface(qu_surface_obj const *surface)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_APPLY_SURFACE);
+        capture__write_id(&surface->texture);
+    }
+
+    priv.frame_capture.renderer->apply_surface(surface);
+}
+
+static void capture_apply_texture(qu_texture_obj const *texture)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_APPLY_TEXTURE);
+        capture__write_id(texture);
+    }
+
+    priv.frame_capture.renderer->apply_texture(texture);
+}
+
+static void capture_apply_clear_color(qu_color clear_color)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_APPLY_CLEAR_COLOR);
+        capture__write(&clear_color, sizeof(qu_color));
+    }
+
+    priv.frame_capture.renderer->apply_clear_color(clear_color);
+}
+
+static void capture_apply_draw_color(qu_color draw_color)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_APPLY_DRAW_COLOR);
+        capture__write(&draw_color, sizeof(qu_color));
+    }
+
+    priv.frame_capture.renderer->apply_draw_color(draw_color);
+}
+
+static void capture_apply_brush(qu_brush brush)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_APPLY_BRUSH);
+        capture__write_int(brush);
+    }
+
+    priv.frame_capture.renderer->apply_brush(brush);
+}
+
+static void capture_apply_vertex_format(qu_vertex_format vertex_format)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_APPLY_VERTEX_FORMAT);
+        capture__write_int(vertex_format);
+    }
+
+    priv.frame_capture.renderer->apply_vertex_format(vertex_format);
+}
+
+static void capture_apply_blend_mode(qu_blend_mode mode)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_APPLY_BLEND_MODE);
+        capture__write(&mode, sizeof(qu_blend_mode));
+    }
+
+    priv.frame_capture.renderer->apply_blend_mode(mode);
+}
+
+static void capture_exec_resize(int width, int height)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_EXEC_RESIZE);
+        capture__write_int(width);
+        capture__write_int(height);
+    }
+
+    priv.frame_capture.renderer->exec_resize(width, height);
+}
+
+static void capture_exec_clear(void)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_EXEC_CLEAR);
+    }
+
+    priv.frame_capture.renderer->exec_clear();
+}
+
+static void capture_exec_draw(qu_render_mode render_mode, unsigned int first_vertex, unsigned int total_vertices)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_EXEC_DRAW);
+        capture__write_int(render_mode);
+        capture__write_int(first_vertex);
+        capture__write_int(total_vertices);
+    }
+
+    priv.frame_capture.renderer->exec_draw(render_mode, first_vertex, total_vertices);
+}
+
+static void capture_exec_draw_indexed(qu_render_mode render_mode, unsigned int first_vertex,
+                                      unsigned int first_index, unsigned int total_indices)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_EXEC_DRAW_INDEXED);
+        capture__write_int(render_mode);
+        capture__write_int(first_vertex);
+        capture__write_int(first_index);
+        capture__write_int(total_indices);
+    }
+
+    priv.frame_capture.renderer->exec_draw_indexed(render_mode, first_vertex, first_index, total_indices);
+}
+
+static void capture_exec_draw_instanced(qu_render_mode render_mode, unsigned int total_vertices,
+                                        unsigned int first_instance, unsigned int total_instances)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_EXEC_DRAW_INSTANCED);
+        capture__write_int(render_mode);
+        capture__write_int(total_vertices);
+        capture__write_int(first_instance);
+        capture__write_int(total_instances);
+    }
+
+    priv.frame_capture.renderer->exec_draw_instanced(render_mode, total_vertices, first_instance, total_instances);
+}
+
+// Textures without pixels (GPU-only ones) are replayed blank.
+static void capture_load_texture(qu_texture_obj *texture)
+{
+    if (priv.frame_capture.file) {
+        if (!texture->capture_id) {
+            texture->capture_id = priv.frame_capture.next_id++;
+        }
+
+        capture__write_record(QU_RENDERER_FUNCTION_LOAD_TEXTURE);
+        capture__write_id(texture);
+        capture__write_int(texture->width);
+        capture__write_int(texture->height);
+        capture__write_int(texture->channels);
+        capture__write_int(texture->compression);
+        capture__write_bool(texture->smooth);
+        capture__write_bool(texture->mipmaps);
+        capture__write_bool(texture->pixels != NULL);
+
+        if (texture->pixels) {
+            capture__write(texture->pixels, capture__get_texture_data_size(texture));
+        }
+    }
+
+    priv.frame_capture.renderer->load_texture(texture);
+}
+
+static void capture_update_texture_region(qu_texture_obj *texture, int x, int y, int w, int h,
+                                          unsigned char const *pixels)
+{
+    if (priv.frame_capture.file && texture->pixels && !texture->compression) {
+        capture__write_record(QU_RENDERER_FUNCTION_UPDATE_TEXTURE_REGION);
+        capture__write_id(texture);
+        capture__write_int(x);
+        capture__write_int(y);
+        capture__write_int(w);
+        capture__write_int(h);
+
+        if (pixels) {
+            capture__write(pixels, (size_t) w * h * texture->channels);
+        } else {
+            for (int row = y; row < (y + h); row++) {
+                size_t offset = ((size_t) row * texture->width + x) * texture->channels;
+                capture__write(texture->pixels + offset, (size_t) w * texture->channels);
+            }
+        }
+    }
+
+    priv.frame_capture.renderer->update_texture_region(texture, x, y, w, h, pixels);
+}
+
+static void capture_unload_texture(qu_texture_obj *texture)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_UNLOAD_TEXTURE);
+        capture__write_id(texture);
+    }
+
+    priv.frame_capture.renderer->unload_texture(texture);
+}
+
+static void capture_set_texture_smooth(qu_texture_obj *texture, bool smooth)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_SET_TEXTURE_SMOOTH);
+        capture__write_id(texture);
+        capture__write_bool(smooth);
+    }
+
+    priv.frame_capture.renderer->set_texture_smooth(texture, smooth);
+}
+
+static void capture_set_texture_mipmaps(qu_texture_obj *texture, bool mipmaps)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_SET_TEXTURE_MIPMAPS);
+        capture__write_id(texture);
+        capture__write_bool(mipmaps);
+    }
+
+    priv.frame_capture.renderer->set_texture_mipmaps(texture, mipmaps);
+}
+
+static void capture_create_surface(qu_surface_obj *surface)
+{
+    if (priv.frame_capture.file) {
+        if (!surface->texture.capture_id) {
+            surface->texture.capture_id = priv.frame_capture.next_id++;
+        }
+
+        capture__write_record(QU_RENDERER_FUNCTION_CREATE_SURFACE);
+        capture__write_id(&surface->texture);
+        capture__write_int(surface->id);
+        capture__write_int(surface->texture.width);
+        capture__write_int(surface->texture.height);
+        capture__write_int(surface->sample_count);
+    }
+
+    priv.frame_capture.renderer->create_surface(surface);
+}
+
+static void capture_destroy_surface(qu_surface_obj *surface)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_DESTROY_SURFACE);
+        capture__write_id(&surface->texture);
+    }
+
+    priv.frame_capture.renderer->destroy_surface(surface);
+}
+
+static void capture_set_surface_antialiasing_level(qu_surface_obj *surface, int level)
+{
+    if (priv.frame_capture.file) {
+        capture__write_record(QU_RENDERER_FUNCTION_SET_SURFACE_ANTIALIASING_LEVEL);
+        capture__write_id(&surface->texture);
+        capture__write_int(level);
+    }
+
+    priv.frame_capture.renderer->set_surface_antialiasing_level(surface, level);
+}
+
+// Wraps the selected renderer. Calls are only written while capture
+// is in progress, otherwise they are passed through.
+static void graphics__install_frame_capture(void)
+{
+    struct qu__frame_capture *capture = &priv.frame_capture;
+
+    capture->renderer = priv.renderer;
+    capture->decorator = *priv.renderer;
+
+    capture->decorator.upload_vertex_data = capture_upload_vertex_data;
+    capture->decorator.upload_index_data = capture_upload_index_data;
+    capture->decorator.apply_projection = capture_apply_projection;
+    capture->decorator.apply_transform = capture_apply_transform;
+    capture->decorator.apply_surface = capture_apply_surface;
+    capture->decorator.apply_texture = capture_apply_texture;
+    capture->decorator.apply_clear_color = capture_apply_clear_color;
+    capture->decorator.apply_draw_color = capture_apply_draw_color;
+    capture->decorator.apply_brush = capture_apply_brush;
+    capture->decorator.apply_vertex_format = capture_apply_vertex_format;
+    capture->decorator.apply_blend_mode = capture_apply_blend_mode;
+    capture->decorator.exec_resize = capture_exec_resize;
+    capture->decorator.exec_clear = capture_exec_clear;
+    capture->decorator.exec_draw = capture_exec_draw;
+    capture->decorator.exec_draw_indexed = capture_exec_draw_indexed;
+    capture->decorator.exec_draw_instanced = capture_exec_draw_instanced;
+    capture->decorator.load_texture = capture_load_texture;
+    capture->decorator.update_texture_region = capture_update_texture_region;
+    capture->decorator.unload_texture = capture_unload_texture;
+    capture->decorator.set_texture_smooth = capture_set_texture_smooth;
+    capture->decorator.set_texture_mipmaps = capture_set_texture_mipmaps;
+    capture->decorator.create_surface = capture_create_surface;
+    capture->decorator.destroy_surface = capture_destroy_surface;
+    capture->decorator.set_surface_antialiasing_level = capture_set_surface_antialiasing_level;
+
+    priv.renderer = &capture->decorator;
+}
+
+// Existing resources and renderer state are written as if they were
+// created now. Calls go to the null renderer, so nothing is created twice.
+// Resource lists are owned by the main thread, so it must be blocked.
+static void graphics__begin_frame_capture_job(void *arg)
+{
+    struct qu__frame_capture *capture = &priv.frame_capture;
+
+    capture->file = fopen(capture->pending_path, "wb");
+
+    if (!capture->file) {
+        QU_LOGE("Failed to open capture file %s.\n", capture->pending_path);
+
+        pl_free(capture->pending_path);
+        capture->pending_path = NULL;
+
+        return;
+    }
+
+    QU_LOGI("Capturing %d frame(s) to %s...\n", capture->pending_frames, capture->pending_path);
+
+    struct qu__capture_header header = {
+        .magic = QU__CAPTURE_MAGIC,
+        .version = QU__CAPTURE_VERSION,
+        .renderer_features = priv.renderer_features,
+        .display_width = priv.display.texture.width,
+        .display_height = priv.display.texture.height,
+    };
+
+    capture__write(&header, sizeof(header));
+
+    capture->frames_left = capture->pending_frames;
+    capture->next_id = QU__CAPTURE_FIRST_ID;
+
+    pl_free(capture->pending_path);
+    capture->pending_path = NULL;
+
+    qu_renderer_impl const *renderer = capture->renderer;
+    capture->renderer = &qu_null_renderer_impl;
+
+    capture_upload_index_data(priv.quad_indices, 6 * QU__MAX_QUADS_PER_DRAW);
+
+    qu_texture_obj *texture = qu_handle_list_get_first(priv.textures);
+
+    while (texture) {
+        texture->capture_id = 0;
+
+        if (!texture->atlas_page && !texture->loading) {
+            capture_load_texture(texture);
+        }
+
+        texture = qu_handle_list_get_next(priv.textures);
+    }
+
+    qu_surface_obj **surface = qu_handle_list_get_first(priv.surfaces);
+
+    while (surface) {
+        (*surface)->texture.capture_id = 0;
+        capture_create_surface(*surface);
+        capture_set_texture_smooth(&(*surface)->texture, (*surface)->texture.smooth);
+
+        surface = qu_handle_list_get_next(priv.surfaces);
+    }
+
+    // Pooled surfaces may be reused during capture.
+    for (int i = 0; i < priv.surface_pool.total_entries; i++) {
+        qu_surface_obj *pooled = priv.surface_pool.entries[i].surface;
+
+        pooled->texture.capture_id = 0;
+        capture_create_surface(pooled);
+        capture_set_texture_smooth(&pooled->texture, pooled->texture.smooth);
+    }
+
+    if (priv.canvas_enabled) {
+        priv.canvas.texture.capture_id = 0;
+        capture_create_surface(&priv.canvas);
+        capture_set_texture_smooth(&priv.canvas.texture, priv.canvas.texture.smooth);
+    }
+
+    priv.display.texture.capture_id = QU__CAPTURE_DISPLAY_ID;
+
+    graphics__apply_renderer_state(&capture->decorator);
+
+    capture->renderer = renderer;
+    capture__write_record(QU__CAPTURE_MARKER_END_SETUP);
+}
+
+// Called when a presented frame is done executing.
+static void graphics__finish_frame_capture(void)
+{
+    struct qu__frame_capture *capture = &priv.frame_capture;
+
+    if (capture->file) {
+        capture__write_record(QU__CAPTURE_MARKER_END_FRAME);
+
+        if (ferror(capture->file)) {
+            QU_LOGE("Failed to write capture file.\n");
+            capture->frames_left = 0;
+        } else {
+            capture->frames_left--;
+        }
+
+        if (capture->frames_left == 0) {
+            fclose(capture->file);
+            capture->file = NULL;
+
+            QU_LOGI("Capture is finished.\n");
+        }
+    }
+}
+
+static void graphics__request_frame_capture_job(void *arg)
+{
+    struct qu__capture_request *request = arg;
+    struct qu__frame_capture *capture = &priv.frame_capture;
+
+    if (!capture->renderer || capture->file || capture->pending_path) {
+        request->accepted = false;
+        return;
+    }
+
+    capture->pending_path = qu_strdup(request->path);
+    capture->pending_frames = request->count;
+
+    request->accepted = true;
+}
+
+static void graphics__terminate_frame_capture(void)
+{
+    struct qu__frame_capture *capture = &priv.frame_capture;
+
+    if (capture->file) {
+        QU_LOGW("Capture is incomplete, %d frame(s) left.\n", capture->frames_left);
+        fclose(capture->file);
+    }
+
+    pl_free(capture->pending_path);
+}
+
+//------------------------------------------------------------------------------
+// Frame replay
+
+// Textures and surfaces created during replay.
+struct qu__replay_object
+{
+    qu_surface_obj surface;
+    bool is_surface;
+};
+
+struct qu__frame_replay
+{
+    qu_file *file;
+    qu_renderer_impl const *renderer;
+    bool failed;
+
+    struct qu__replay_object **objects; // indexed by capture ID
+    uint32_t total_objects;
+
+    // Renderer may keep pointers to uploaded data, so each vertex
+    // format (and index data, which goes last) has its own buffer.
+    void *buffers[QU_TOTAL_VERTEX_FORMATS + 1];
+    size_t buffer_capacities[QU_TOTAL_VERTEX_FORMATS + 1];
+
+    // Draws are checked against the last uploaded data.
+    size_t total_vertices[QU_TOTAL_VERTEX_FORMATS];
+    size_t total_indices;
+    int vertex_format; // -1 until applied
+};
+
+struct qu__replay_request
+{
+    char const *path;
+    double *frame_times;
+    int max_frames;
+    int total_frames;
+};
+
+static void replay__read(struct qu__frame_replay *replay, void *data, size_t size)
+{
+    if (replay->failed) {
+        memset(data, 0, size);
+        return;
+    }
+
+    if (qu_file_read(data, size, replay->file) != (int64_t) size) {
+        QU_LOGE("Unexpected end of capture file.\n");
+        memset(data, 0, size);
+        replay->failed = true;
+    }
+}
+
+static int32_t replay__read_int(struct qu__frame_replay *replay)
+{
+    int32_t value;
+    replay__read(replay, &value, sizeof(value));
+    return value;
+}
+
+static bool replay__read_bool(struct qu__frame_replay *replay)
+{
+    uint8_t value;
+    replay__read(replay, &value, sizeof(value));
+    return value != 0;
+}
+
+// Returns false on invalid value, so it can't reach the renderer.
+static bool replay__check(struct qu__frame_replay *replay, bool condition)
+{
+    if (!condition && !replay->failed) {
+        QU_LOGE("Capture file is corrupted.\n");
+        replay->failed = true;
+    }
+
+    return !replay->failed;
+}
+
+// Instanced sprites can't be replayed if renderer doesn't support instancing.
+static bool replay__check_instancing(struct qu__frame_replay *replay, bool condition)
+{
+    if (!condition && !replay->failed && !(priv.renderer_features & QU_RENDERER_FEATURE_BIT_INSTANCING)) {
+        QU_LOGE("Capture has instanced draws which the renderer doesn't support.\n");
+        replay->failed = true;
+    }
+
+    return !replay->failed;
+}
+
+// Draw should only use vertices and indices which were uploaded.
+static bool replay__check_draw(struct qu__frame_replay *replay, int record,
+                               unsigned int a, unsigned int b, unsigned int c)
+{
+    if (!replay__check(replay, replay->vertex_format != -1)) {
+        return false;
+    }
+
+    uint64_t total_vertices = replay->total_vertices[replay->vertex_format];
+
+    if (record == QU_RENDERER_FUNCTION_EXEC_DRAW) {
+        return replay__check(replay, (uint64_t) a + b <= total_vertices);
+    }
+
+    if (record == QU_RENDERER_FUNCTION_EXEC_DRAW_INSTANCED) {
+        return replay__check(replay, (uint64_t) b + c <= total_vertices);
+    }
+
+    if (!replay__check(replay, (uint64_t) b + c <= replay->total_indices)) {
+        return false;
+    }
+
+    uint16_t const *indices = replay->buffers[QU_TOTAL_VERTEX_FORMATS];
+
+    for (unsigned int i = 0; i < c; i++) {
+        if (!replay__check(replay, (uint64_t) a + indices[b + i] < total_vertices)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Reads `count` elements of `size` bytes into the given buffer.
+static void *replay__read_array(struct qu__frame_replay *replay, int buffer, size_t size, size_t *count)
+{
+    uint64_t value;
+    replay__read(replay, &value, sizeof(value));
+
+    *count = 0;
+
+    if (!replay__check(replay, value <= (SIZE_MAX / size))) {
+        return NULL;
+    }
+
+    if (replay->buffer_capacities[buffer] < (value * size)) {
+        void *data = pl_realloc(replay->buffers[buffer], value * size);
+        QU_HALT_IF(!data);
+
+        replay->buffers[buffer] = data;
+        replay->buffer_capacities[buffer] = value * size;
+    }
+
+    replay__read(replay, replay->buffers[buffer], value * size);
+    *count = value;
+
+    return replay->buffers[buffer];
+}
+
+static struct qu__replay_object *replay__create_object(struct qu__frame_replay *replay,
+                                                       uint32_t id, bool is_surface)
+{
+    if (!replay__check(replay, id >= QU__CAPTURE_FIRST_ID)) {
+        return NULL;
+    }
+
+    if (id >= replay->total_objects) {
+        uint32_t total_objects = QU_MAX(id + 1, 2 * replay->total_objects);
+        void *objects = pl_realloc(replay->objects, sizeof(*replay->objects) * total_objects);
+        QU_HALT_IF(!objects);
+
+        replay->objects = objects;
+
+        for (uint32_t i = replay->total_objects; i < total_objects; i++) {
+            replay->objects[i] = NULL;
+        }
+
+        replay->total_objects = total_objects;
+    }
+
+    // Textures may be loaded again, e.g. after resize.
+    if (!replay->objects[id]) {
+        replay->objects[id] = pl_calloc(1, sizeof(struct qu__replay_object));
+        QU_HALT_IF(!replay->objects[id]);
+    }
+
+    replay->objects[id]->is_surface = is_surface;
+
+    return replay->objects[id];
+}
+
+static qu_surface_obj *replay__read_surface(struct qu__frame_replay *replay)
+{
+    uint32_t id;
+    replay__read(replay, &id, sizeof(id));
+
+    if (id == QU__CAPTURE_DISPLAY_ID) {
+        return &priv.display;
+    }
+
+    bool exists = id < replay->total_objects && replay->objects[id] && replay->objects[id]->is_surface;
+
+    if (!replay__check(replay, exists)) {
+        return NULL;
+    }
+
+    return &replay->objects[id]->surface;
+}
+
+// Zero ID stands for no texture.
+static qu_texture_obj *replay__read_texture(struct qu__frame_replay *replay, bool *valid)
+{
+    uint32_t id;
+    replay__read(replay, &id, sizeof(id));
+
+    if (id == 0 || id == QU__CAPTURE_DISPLAY_ID) {
+        *valid = !replay->failed && id == 0;
+        return NULL;
+    }
+
+    bool exists = id < replay->total_objects && replay->objects[id];
+    *valid = replay__check(replay, exists);
+
+    return *valid ? &replay->objects[id]->surface.texture : NULL;
+}
+
+static void replay__destroy_object(struct qu__frame_replay *replay, uint32_t id)
+{
+    struct qu__replay_object *object = replay->objects[id];
+
+    if (object->is_surface) {
+        replay->renderer->destroy_surface(&object->surface);
+    } else {
+        replay->renderer->unload_texture(&object->surface.texture);
+    }
+
+    pl_free(object->surface.texture.pixels);
+    pl_free(object);
+
+    replay->objects[id] = NULL;
+}
+
+static void replay__load_texture(struct qu__frame_replay *replay)
+{
+    uint32_t id;
+    replay__read(replay, &id, sizeof(id));
+
+    struct qu__replay_object *object = replay__create_object(replay, id, false);
+
+    if (!object) {
+        return;
+    }
+
+    qu_texture_obj *texture = &object->surface.texture;
+
+    texture->width = replay__read_int(replay);
+    texture->height = replay__read_int(replay);
+    texture->channels = replay__read_int(replay);
+    texture->compression = replay__read_int(replay);
+    texture->smooth = replay__read_bool(replay);
+    texture->mipmaps = replay__read_bool(replay);
+
+    bool has_pixels = replay__read_bool(replay);
+
+    bool valid = texture->width > 0 && texture->width <= QU_MAX_IMAGE_DIMENSION
+        && texture->height > 0 && texture->height <= QU_MAX_IMAGE_DIMENSION
+        && texture->channels >= 1 && texture->channels <= 4
+        && texture->compression >= 0 && texture->compression < QU_TOTAL_IMAGE_COMPRESSIONS;
+
+    if (!replay__check(replay, valid)) {
+        return;
+    }
+
+    if (texture->compression && !(priv.renderer_features & compression_feature_bits[texture->compression])) {
+        QU_LOGE("Capture has compressed textures which the renderer doesn't support.\n");
+        replay->failed = true;
+        return;
+    }
+
+    size_t size = capture__get_texture_data_size(texture);
+
+    pl_free(texture->pixels);
+    texture->pixels = pl_calloc(size, 1);
+    QU_HALT_IF(!texture->pixels);
+
+    if (has_pixels) {
+        replay__read(replay, texture->pixels, size);
+    }
+
+    if (!replay->failed) {
+        replay->renderer->load_texture(texture);
+    }
+}
+
+static void replay__update_texture_region(struct qu__frame_replay *replay)
+{
+    bool valid;
+    qu_texture_obj *texture = replay__read_texture(replay, &valid);
+
+    int x = replay__read_int(replay);
+    int y = replay__read_int(replay);
+    int w = replay__read_int(replay);
+    int h = replay__read_int(replay);
+
+    valid = valid && texture && !texture->compression && x >= 0 && y >= 0 && w > 0 && h > 0
+        && (x + w) <= texture->width && (y + h) <= texture->height;
+
+    if (!replay__check(replay, valid)) {
+        return;
+    }
+
+    for (int row = y; row < (y + h); row++) {
+        size_t offset = ((size_t) row * texture->width + x) * texture->channels;
+        replay__read(replay, texture->pixels + offset, (size_t) w * texture->channels);
+    }
+
+    if (!replay->failed) {
+        replay->renderer->update_texture_region(texture, x, y, w, h, NULL);
+    }
+}
+
+static void replay__create_surface(struct qu__frame_replay *replay)
+{
+    uint32_t id;
+    replay__read(replay, &id, sizeof(id));
+
+    struct qu__replay_object *object = replay__create_object(replay, id, true);
+
+    if (!object) {
+        return;
+    }
+
+    qu_surface_obj *surface = &object->surface;
+
+    surface->id = replay__read_int(replay);
+    surface->texture.width = replay__read_int(replay);
+    surface->texture.height = replay__read_int(replay);
+    surface->texture.channels = 4;
+    surface->sample_count = replay__read_int(replay);
+
+    bool valid = surface->texture.width > 0 && surface->texture.height > 0 && surface->sample_count >= 0;
+
+    if (!replay__check(replay, valid)) {
+        return;
+    }
+
+    qu_mat4_ortho(&surface->projection, 0.f, surface->texture.width, surface->texture.height, 0.f);
+    qu_mat4_identity(&surface->modelview[0]);
+
+    replay->renderer->create_surface(surface);
+}
+
+static void replay__execute_record(struct qu__frame_replay *replay, int record)
+{
+    qu_renderer_impl const *renderer = replay->renderer;
+
+    switch (record) {
+    case QU_RENDERER_FUNCTION_UPLOAD_VERTEX_DATA: {
+        qu_vertex_format format = replay__read_int(replay);
+
+        if (!replay__check(replay, format >= 0 && format < QU_TOTAL_VERTEX_FORMATS)) {
+            break;
+        }
+
+        if (!replay__check_instancing(replay, format != QU_VERTEX_FORMAT_SPRITE)) {
+            break;
+        }
+
+        size_t size;
+        float *data = replay__read_array(replay, format, sizeof(float), &size);
+
+        if (!replay->failed) {
+            replay->total_vertices[format] = size / vertex_size_map[format];
+            renderer->upload_vertex_data(format, data, size);
+        }
+        break;
+    }
+    case QU_RENDERER_FUNCTION_UPLOAD_INDEX_DATA: {
+        size_t size;
+        uint16_t *data = replay__read_array(replay, QU_TOTAL_VERTEX_FORMATS, sizeof(uint16_t), &size);
+
+        if (!replay->failed) {
+            replay->total_indices = size;
+            renderer->upload_index_data(data, size);
+        }
+        break;
+    }
+    case QU_RENDERER_FUNCTION_APPLY_PROJECTION:
+    case QU_RENDERER_FUNCTION_APPLY_TRANSFORM: {
+        qu_mat4 matrix;
+        replay__read(replay, &matrix, sizeof(matrix));
+
+        if (replay->failed) {
+            break;
+        }
+
+        if (record == QU_RENDERER_FUNCTION_APPLY_PROJECTION) {
+            renderer->apply_projection(&matrix);
+        } else {
+            renderer->apply_transform(&matrix);
+        }
+        break;
+    }
+    case QU_RENDERER_FUNCTION_APPLY_SURFACE: {
+        qu_surface_obj *surface = replay__read_surface(replay);
+
+        if (surface) {
+            renderer->apply_surface(surface);
+        }
+        break;
+    }
+    case QU_RENDERER_FUNCTION_APPLY_TEXTURE: {
+        bool valid;
+        qu_texture_obj *texture = replay__read_texture(replay, &valid);
+
+        if (valid) {
+            renderer->apply_texture(texture);
+        }
+        break;
+    }
+    case QU_RENDERER_FUNCTION_APPLY_CLEAR_COLOR:
+    case QU_RENDERER_FUNCTION_APPLY_DRAW_COLOR: {
+        qu_color color;
+        replay__read(replay, &color, sizeof(color));
+
+        if (replay->failed) {
+            break;
+        }
+
+        if (record == QU_RENDERER_FUNCTION_APPLY_CLEAR_COLOR) {
+            renderer->apply_clear_color(color);
+        } else {
+            renderer->apply_draw_color(color);
+        }
+        break;
+    }
+    case QU_RENDERER_FUNCTION_APPLY_BRUSH: {
+        qu_brush brush = replay__read_int(replay);
+
+        if (!replay__check(replay, brush >= 0 && brush < QU_TOTAL_BRUSHES)) {
+            break;
+        }
+
+        if (replay__check_instancing(replay, brush != QU_BRUSH_SPRITE)) {
+            renderer->apply_brush(brush);
+        }
+        break;
+    }
+    case QU_RENDERER_FUNCTION_APPLY_VERTEX_FORMAT: {
+        qu_vertex_format format = replay__read_int(replay);
+
+        if (!replay__check(replay, format >= 0 && format < QU_TOTAL_VERTEX_FORMATS)) {
+            break;
+        }
+
+        if (replay__check_instancing(replay, format != QU_VERTEX_FORMAT_SPRITE)) {
+            replay->vertex_format = format;
+            renderer->apply_vertex_format(format);
+        }
+        break;
+    }
+    case QU_RENDERER_FUNCTION_APPLY_BLEND_MODE: {
+        qu_blend_mode mode;
+        replay__read(replay, &mode, sizeof(mode));
+
+        // Same limits as in qu_set_blend_mode().
+        replay__check(replay, mode.color_src_factor >= 0 && mode.color_src_factor < 10);
+        replay__check(replay, mode.color_dst_factor >= 0 && mode.color_dst_factor < 10);
+        replay__check(replay, mode.alpha_src_factor >= 0 && mode.alpha_src_factor < 10);
+        replay__check(replay, mode.alpha_dst_factor >= 0 && mode.alpha_dst_factor < 10);
+        replay__check(replay, mode.color_equation >= 0 && mode.color_equation < 3);
+        replay__check(replay, mode.alpha_equation >= 0 && mode.alpha_equation < 3);
+
+        if (!replay->failed) {
+            renderer->apply_blend_mode(mode);
+        }
+        break;
+    }
+    case QU_RENDERER_FUNCTION_EXEC_RESIZE: {
+        int width = replay__read_int(replay);
+        int height = replay__read_int(replay);
+
+        if (!replay->failed) {
+            renderer->exec_resize(width, height);
+        }
+        break;
+    }
+    case QU_RENDERER_FUNCTION_EXEC_CLEAR:
+        renderer->exec_clear();
+        break;
+    case QU_RENDERER_FUNCTION_EXEC_DRAW:
+    case QU_RENDERER_FUNCTION_EXEC_DRAW_INDEXED:
+    case QU_RENDERER_FUNCTION_EXEC_DRAW_INSTANCED: {
+        qu_render_mode mode = replay__read_int(replay);
+        unsigned int a = replay__read_int(replay);
+        unsigned int b = replay__read_int(replay);
+        unsigned int c = (record == QU_RENDERER_FUNCTION_EXEC_DRAW) ? 0 : replay__read_int(replay);
+
+        if (!replay__check(replay, mode >= 0 && mode < QU_TOTAL_RENDER_MODES)) {
+            break;
+        }
+
+        if (!replay__check_instancing(replay, record != QU_RENDERER_FUNCTION_EXEC_DRAW_INSTANCED)) {
+            break;
+        }
+
+        if (!replay__check_draw(replay, record, a, b, c)) {
+            break;
+        }
+
+        if (record == QU_RENDERER_FUNCTION_EXEC_DRAW) {
+            renderer->exec_draw(mode, a, b);
+        } else if (record == QU_RENDERER_FUNCTION_EXEC_DRAW_INDEXED) {
+            renderer->exec_draw_indexed(mode, a, b, c);
+        } else {
+            renderer->exec_draw_instanced(mode, a, b, c);
+        }
+        break;
+    }
+    case QU_RENDERER_FUNCTION_LOAD_TEXTURE:
+        replay__load_texture(replay);
+        break;
+    case QU_RENDERER_FUNCTION_UPDATE_TEXTURE_REGION:
+        replay__update_texture_region(replay);
+        break;
+    case QU_RENDERER_FUNCTION_UNLOAD_TEXTURE:
+    case QU_RENDERER_FUNCTION_DESTROY_SURFACE: {
+        uint32_t id;
+        replay__read(replay, &id, sizeof(id));
+
+        bool is_surface = (record == QU_RENDERER_FUNCTION_DESTROY_SURFACE);
+        bool exists = id < replay->total_objects && replay->objects[id]
+            && replay->objects[id]->is_surface == is_surface;
+
+        if (replay__check(replay, exists)) {
+            replay__destroy_object(replay, id);
+        }
+        break;
+    }
+    case QU_RENDERER_FUNCTION_SET_TEXTURE_SMOOTH:
+    case QU_RENDERER_FUNCTION_SET_TEXTURE_MIPMAPS: {
+        bool valid;
+        qu_texture_obj *texture = replay__read_texture(replay, &valid);
+        bool value = replay__read_bool(replay);
+
+        if (!replay__check(replay, valid && texture)) {
+            break;
+        }
+
+        if (record == QU_RENDERER_FUNCTION_SET_TEXTURE_SMOOTH) {
+            renderer->set_texture_smooth(texture, value);
+        } else {
+            renderer->set_texture_mipmaps(texture, value);
+        }
+        break;
+    }
+    case QU_RENDERER_FUNCTION_CREATE_SURFACE:
+        replay__create_surface(replay);
+        break;
+    case QU_RENDERER_FUNCTION_SET_SURFACE_ANTIALIASING_LEVEL: {
+        qu_surface_obj *surface = replay__read_surface(replay);
+        int level = replay__read_int(replay);
+
+        if (!replay->failed && surface != &priv.display) {
+            renderer->set_surface_antialiasing_level(surface, level);
+        }
+        break;
+    }
+    default:
+        replay__check(replay, false);
+        break;
+    }
+}
+
+// Executed on the thread which owns graphics context.
+// Renderer state is restored afterwards.
+static void graphics__replay_frames_job(void *arg)
+{
+    struct qu__replay_request *request = arg;
+    struct qu__frame_replay replay = {
+        .renderer = priv.renderer,
+        .vertex_format = -1,
+    };
+
+    request->total_frames = -1;
+    replay.file = qu_open_file_from_path(request->path);
+
+    if (!replay.file) {
+        QU_LOGE("Failed to open capture file %s.\n", request->path);
+        return;
+    }
+
+    struct qu__capture_header header;
+    replay__read(&replay, &header, sizeof(header));
+
+    if (replay.failed || header.magic != QU__CAPTURE_MAGIC || header.version != QU__CAPTURE_VERSION) {
+        QU_LOGE("%s is not a capture file.\n", request->path);
+        qu_close_file(replay.file);
+        return;
+    }
+
+    if (header.display_width != priv.display.texture.width
+        || header.display_height != priv.display.texture.height) {
+        QU_LOGW("Capture was recorded at %dx%d, display is %dx%d.\n",
+                header.display_width, header.display_height,
+                priv.display.texture.width, priv.display.texture.height);
+    }
+
+    int total_frames = 0;
+    uint64_t frame_start = 0;
+
+    while (!replay.failed) {
+        uint8_t record;
+
+        if (qu_file_read(&record, sizeof(record), replay.file) != sizeof(record)) {
+            break;
+        }
+
+        if (record == QU__CAPTURE_MARKER_END_SETUP) {
+            frame_start = pl_get_ticks_highp();
+        } else if (record == QU__CAPTURE_MARKER_END_FRAME) {
+            qu_swap_buffers();
+            graphics__finish_stats_frame();
+            graphics__finish_gpu_timer_frame();
+
+            uint64_t frame_end = pl_get_ticks_highp();
+
+            if (total_frames < request->max_frames) {
+                request->frame_times[total_frames] = (frame_end - frame_start) / 1e9;
+            }
+
+            total_frames++;
+            frame_start = frame_end;
+        } else {
+            replay__execute_record(&replay, record);
+        }
+    }
+
+    // Replayed surface may still be bound.
+    priv.renderer->apply_surface(&priv.display);
+
+    for (uint32_t id = 0; id < replay.total_objects; id++) {
+        if (replay.objects[id]) {
+            replay__destroy_object(&replay, id);
+        }
+    }
+
+    priv.renderer->upload_index_data(priv.quad_indices, 6 * QU__MAX_QUADS_PER_DRAW);
+    graphics__apply_renderer_state(priv.renderer);
+
+    for (int i = 0; i <= QU_TOTAL_VERTEX_FORMATS; i++) {
+        pl_free(replay.buffers[i]);
+    }
+
+    pl_free(replay.objects);
+    qu_close_file(replay.file);
+
+    if (!replay.failed) {
+        request->total_frames = total_frames;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+static void graphics__apply_renderer_state(qu_renderer_impl const *renderer)
+{
+    renderer->apply_clear_color(priv.clear_color);
+    renderer->apply_draw_color(priv.draw_color);
+    renderer->apply_brush(priv.brush);
+    renderer->apply_vertex_format(priv.vertex_format);
+    renderer->apply_projection(&priv.current_surface->projection);
+
+    if (priv.cpu_transforms) {
+        qu_mat4 identity;
+        qu_mat4_identity(&identity);
+        renderer->apply_transform(&identity);
+    } else {
+        renderer->apply_transform(graphics__get_modelview(priv.current_surface));
+    }
+
+    renderer->apply_surface(priv.current_surface);
+    renderer->apply_texture(priv.current_texture);
+
+    // Set default viewport.
+    qu_vec2i window_size = qu_get_window_size();
+    renderer->exec_resize(window_size.x, window_size.y);
+
+    renderer->apply_blend_mode(priv.blend_mode);
+}
+
+static void initialize_renderer(void)
+{
+    QU_LOGD("Initializing renderer...\n");
+
+    int renderer_impl_count = QU_ARRAY_SIZE(supported_renderer_impl_list);
+
+    if (renderer_impl_count == 0) {
+        QU_HALT("renderer_impl_count == 0");
+    }
+
+    for (int i = 0; i < renderer_impl_count; i++) {
+        priv.renderer = supported_renderer_impl_list[i];
+
+        QU_HALT_IF(!priv.renderer->query);
+
+        if (priv.renderer->query()) {
+            QU_LOGD("Selected graphics implementation #%d.\n", i);
+            break;
+        }
+    }
+
+    QU_HALT_IF(!priv.renderer->initialize);
+    QU_HALT_IF(!priv.renderer->terminate);
+    QU_HALT_IF(!priv.renderer->query_features);
+    QU_HALT_IF(!priv.renderer->upload_vertex_data);
+    QU_HALT_IF(!priv.renderer->upload_index_data);
+
+    QU_HALT_IF(!priv.renderer->apply_projection);
+    QU_HALT_IF(!priv.renderer->apply_transform);
+    QU_HALT_IF(!priv.renderer->apply_surface);
+    QU_HALT_IF(!priv.renderer->apply_texture);
+    QU_HALT_IF(!priv.renderer->apply_clear_color);
+    QU_HALT_IF(!priv.renderer->apply_draw_color);
+    QU_HALT_IF(!priv.renderer->apply_brush);
+    QU_HALT_IF(!priv.renderer->apply_vertex_format);
+    QU_HALT_IF(!priv.renderer->apply_blend_mode);
+
+    QU_HALT_IF(!priv.renderer->exec_resize);
+    QU_HALT_IF(!priv.renderer->exec_clear);
+    QU_HALT_IF(!priv.renderer->exec_draw);
+    QU_HALT_IF(!priv.renderer->exec_draw_indexed);
+    QU_HALT_IF(!priv.renderer->exec_draw_instanced);
+
+    QU_HALT_IF(!priv.renderer->load_texture);
+    QU_HALT_IF(!priv.renderer->update_texture_region);
+    QU_HALT_IF(!priv.renderer->unload_texture);
+    QU_HALT_IF(!priv.renderer->set_texture_smooth);
+    QU_HALT_IF(!priv.renderer->set_texture_mipmaps);
+
+    QU_HALT_IF(!priv.renderer->create_surface);
+    QU_HALT_IF(!priv.renderer->destroy_surface);
+    QU_HALT_IF(!priv.renderer->set_surface_antialiasing_level);
+
+    QU_HALT_IF(!priv.renderer->enable_gpu_timers);
+    QU_HALT_IF(!priv.renderer->end_gpu_frame);
+
+    if (priv.params.graphics_flags & QU_GRAPHICS_RENDERER_STATS) {
+        graphics__install_renderer_stats();
+    }
+
+    if (priv.params.graphics_flags & QU_GRAPHICS_FRAME_CAPTURE) {
+        graphics__install_frame_capture();
+    }
+
+    priv.renderer->initialize();
+    priv.renderer->upload_index_data(priv.quad_indices, 6 * QU__MAX_QUADS_PER_DRAW);
+    priv.renderer_features = priv.renderer->query_features();
+
+    if (priv.params.graphics_flags & QU_GRAPHICS_GPU_TIMERS) {
+        graphics__enable_gpu_timers();
+    }
+
+    qu_texture_obj *texture = qu_handle_list_get_first(priv.textures);
+
+    while (texture) {
+        if (texture->atlas_page) {
+            // Drawn from the page texture.
+        } else if (texture->loading) {
+            // Uploaded once decoded.
+        } else if (!texture->pixels) {
+            graphics__restore_texture(texture);
+        } else {
+            priv.renderer->load_texture(texture);
+        }
+
+        texture = qu_handle_list_get_next(priv.textures);
+    }
+
+    qu_surface_obj **surface = qu_handle_list_get_first(priv.surfaces);
+
+    while (surface) {
+        priv.renderer->create_surface(*surface);
+        surface = qu_handle_list_get_next(priv.surfaces);
+    }
+
+    graphics__apply_renderer_state(priv.renderer);
+
+    if (qu_get_window_flags() & QU_WINDOW_USE_CANVAS) {
+        priv.renderer->create_surface(&priv.canvas);
+        priv.renderer->set_texture_smooth(&priv.canvas.texture,
+            priv.params.canvas_flags & QU_CANVAS_SMOOTH);
+    }
+
+    QU_LOGD("Renderer is initialized.\n");
+}
+
+static void terminate_renderer(void)
+{
+    qu_texture_obj *texture = qu_handle_list_get_first(priv.textures);
+
+    while (texture) {
+        priv.renderer->unload_texture(texture);
+        texture = qu_handle_list_get_next(priv.textures);
+    }
+
+    qu_surface_obj **surface = qu_handle_list_get_first(priv.surfaces);
+
+    while (surface) {
+        priv.renderer->destroy_surface(*surface);
+        surface = qu_handle_list_get_next(priv.surfaces);
+    }
+
+    graphics__clear_surface_pool();
+
+    if (priv.canvas_enabled) {
+        priv.renderer->destroy_surface(&priv.canvas);
+    }
+
+    priv.renderer->terminate();
+
+    priv.renderer = NULL;
+}
 
 //------------------------------------------------------------------------------
+// Render thread
 
-static void graphics__update_canvas_coords(int w_display, int h_display)
+enum qu__renderer_call_type
 {
-    float ard = w_display / (float) h_display;
-    float arc = priv.canvas.texture.width / (float) priv.canvas.texture.height;
+    QU__RENDERER_CALL_LOAD_TEXTURE,
+    QU__RENDERER_CALL_UPDATE_TEXTURE_REGION,
+    QU__RENDERER_CALL_UNLOAD_TEXTURE,
+    QU__RENDERER_CALL_SET_TEXTURE_SMOOTH,
+    QU__RENDERER_CALL_SET_TEXTURE_MIPMAPS,
+    QU__RENDERER_CALL_CREATE_SURFACE,
+    QU__RENDERER_CALL_DESTROY_SURFACE,
+    QU__RENDERER_CALL_SET_SURFACE_ANTIALIASING_LEVEL,
+};
 
-    if (ard > arc) {
-        priv.canvas_ax = (w_display / 2.f) - ((arc / ard) * w_display / 2.f);
-        priv.canvas_ay = 0.f;
-        priv.canvas_bx = (w_display / 2.f) + ((arc / ard) * w_display / 2.f);
-        priv.canvas_by = h_display;
-    } else {
-        priv.canvas_ax = 0.f;
-        priv.canvas_ay = (h_display / 2.f) - ((ard / arc) * h_display / 2.f);
-        priv.canvas_bx = w_display;
-        priv.canvas_by = (h_display / 2.f) + ((ard / arc) * h_display / 2.f);
+struct qu__renderer_call
+{
+    enum qu__renderer_call_type type;
+    qu_texture_obj *texture;
+    qu_surface_obj *surface;
+    int value;
+    int x, y, w, h;
+    unsigned char const *pixels;
+};
+
+static intptr_t graphics__render_thread_main(void *arg)
+{
+    struct qu__render_thread *thread = &priv.render_thread;
+
+    is_render_thread = true;
+
+    if (!qu_gl_make_context_current(true)) {
+        QU_HALT("Render thread failed to acquire graphics context.");
+    }
+
+    pl_lock_mutex(thread->mutex);
+
+    while (true) {
+        while (!thread->job && !thread->quit) {
+            pl_wait_cond(thread->cond, thread->mutex);
+        }
+
+        if (!thread->job) {
+            break;
+        }
+
+        pl_unlock_mutex(thread->mutex);
+        thread->job(thread->job_arg);
+        pl_lock_mutex(thread->mutex);
+
+        thread->job = NULL;
+        pl_broadcast_cond(thread->cond);
     }
+
+    pl_unlock_mutex(thread->mutex);
+
+    qu_gl_make_context_current(false);
+
+    return 0;
 }
 
-static void graphics__flush_canvas(void)
+// Blocks until the render thread has nothing to do.
+// Since only the main thread posts jobs, it stays idle until the next one.
+static void graphics__wait_render_thread(void)
 {
-    graphics__append_render_command(&(struct qu__render_command_info) {
-        .command = QU__RENDER_COMMAND_SET_SURFACE,
-        .args.surface.surface = &priv.display,
+    struct qu__render_thread *thread = &priv.render_thread;
+
+    if (!thread->thread || is_render_thread) {
+        return;
+    }
+
+    pl_lock_mutex(thread->mutex);
+
+    while (thread->job) {
+        pl_wait_cond(thread->cond, thread->mutex);
+    }
+
+    pl_unlock_mutex(thread->mutex);
+}
+
+static void graphics__post_render_job(void (*job)(void *), void *arg)
+{
+    struct qu__render_thread *thread = &priv.render_thread;
+
+    pl_lock_mutex(thread->mutex);
+
+    while (thread->job) {
+        pl_wait_cond(thread->cond, thread->mutex);
+    }
+
+    thread->job = job;
+    thread->job_arg = arg;
+    pl_broadcast_cond(thread->cond);
+
+    pl_unlock_mutex(thread->mutex);
+}
+
+// Calls the function on the thread which owns graphics context
+// and waits for it to return.
+static void graphics__invoke(void (*job)(void *), void *arg)
+{
+    if (!priv.render_thread.thread || is_render_thread) {
+        job(arg);
+        return;
+    }
+
+    graphics__post_render_job(job, arg);
+    graphics__wait_render_thread();
+}
+
+static void graphics__execute_renderer_call(void *arg)
+{
+    struct qu__renderer_call const *call = arg;
+    qu_renderer_impl const *renderer = priv.render_thread.renderer;
+
+    switch (call->type) {
+    case QU__RENDERER_CALL_LOAD_TEXTURE:
+        renderer->load_texture(call->texture);
+        break;
+    case QU__RENDERER_CALL_UPDATE_TEXTURE_REGION:
+        renderer->update_texture_region(call->texture, call->x, call->y, call->w, call->h, call->pixels);
+        break;
+    case QU__RENDERER_CALL_UNLOAD_TEXTURE:
+        renderer->unload_texture(call->texture);
+        break;
+    case QU__RENDERER_CALL_SET_TEXTURE_SMOOTH:
+        renderer->set_texture_smooth(call->texture, call->value);
+        break;
+    case QU__RENDERER_CALL_SET_TEXTURE_MIPMAPS:
+        renderer->set_texture_mipmaps(call->texture, call->value);
+        break;
+    case QU__RENDERER_CALL_CREATE_SURFACE:
+        renderer->create_surface(call->surface);
+        break;
+    case QU__RENDERER_CALL_DESTROY_SURFACE:
+        renderer->destroy_surface(call->surface);
+        break;
+    case QU__RENDERER_CALL_SET_SURFACE_ANTIALIASING_LEVEL:
+        renderer->set_surface_antialiasing_level(call->surface, call->value);
+        break;
+    }
+}
+
+static void proxy_load_texture(qu_texture_obj *texture)
+{
+    graphics__invoke(graphics__execute_renderer_call, &(struct qu__renderer_call) {
+        .type = QU__RENDERER_CALL_LOAD_TEXTURE,
+        .texture = texture,
+    });
+}
+
+static void proxy_update_texture_region(qu_texture_obj *texture, int x, int y, int w, int h,
+                                        unsigned char const *pixels)
+{
+    graphics__invoke(graphics__execute_renderer_call, &(struct qu__renderer_call) {
+        .type = QU__RENDERER_CALL_UPDATE_TEXTURE_REGION,
+        .texture = texture,
+        .x = x,
+        .y = y,
+        .w = w,
+        .h = h,
+        .pixels = pixels,
     });
+}
 
-    graphics__append_render_command(&(struct qu__render_command_info) {
-        .command = QU__RENDER_COMMAND_CLEAR,
-        .args.clear.color = QU_COLOR(0, 0, 0),
+static void proxy_unload_texture(qu_texture_obj *texture)
+{
+    graphics__invoke(graphics__execute_renderer_call, &(struct qu__renderer_call) {
+        .type = QU__RENDERER_CALL_UNLOAD_TEXTURE,
+        .texture = texture,
     });
+}
 
-    float vertices[] = {
-        priv.canvas_ax, priv.canvas_ay, 0.f, 1.f,
-        priv.canvas_bx, priv.canvas_ay, 1.f, 1.f,
-        priv.canvas_bx, priv.canvas_by, 1.f, 0.f,
-        priv.canvas_ax, priv.canvas_by, 0.f, 0.f,
-    };
+static void proxy_set_texture_smooth(qu_texture_obj *texture, bool smooth)
+{
+    graphics__invoke(graphics__execute_renderer_call, &(struct qu__renderer_call) {
+        .type = QU__RENDERER_CALL_SET_TEXTURE_SMOOTH,
+        .texture = texture,
+        .value = smooth,
+    });
+}
 
-    graphics__append_render_command(&(struct qu__render_command_info) {
-        .command = QU__RENDER_COMMAND_DRAW,
-        .args.draw = {
-            .texture = &priv.canvas.texture,
-            .color = QU_COLOR(255, 255, 255),
-            .brush = QU_BRUSH_TEXTURED,
-            .render_mode = QU_RENDER_MODE_TRIANGLE_FAN,
-            .vertex_format = QU_VERTEX_FORMAT_4XYST,
-            .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_4XYST, vertices, 16),
-            .total_vertices = 4,
-        },
+static void proxy_set_texture_mipmaps(qu_texture_obj *texture, bool mipmaps)
+{
+    graphics__invoke(graphics__execute_renderer_call, &(struct qu__renderer_call) {
+        .type = QU__RENDERER_CALL_SET_TEXTURE_MIPMAPS,
+        .texture = texture,
+        .value = mipmaps,
     });
 }
 
-static void texture_dtor(void *ptr)
+static void proxy_create_surface(qu_surface_obj *surface)
 {
-    qu_texture_obj *texture = ptr;
+    graphics__invoke(graphics__execute_renderer_call, &(struct qu__renderer_call) {
+        .type = QU__RENDERER_CALL_CREATE_SURFACE,
+        .surface = surface,
+    });
+}
 
-    pl_free(texture->pixels);
+static void proxy_destroy_surface(qu_surface_obj *surface)
+{
+    graphics__invoke(graphics__execute_renderer_call, &(struct qu__renderer_call) {
+        .type = QU__RENDERER_CALL_DESTROY_SURFACE,
+        .surface = surface,
+    });
+}
 
-    if (!priv.renderer) {
-        return;
+static void proxy_set_surface_antialiasing_level(qu_surface_obj *surface, int level)
+{
+    graphics__invoke(graphics__execute_renderer_call, &(struct qu__renderer_call) {
+        .type = QU__RENDERER_CALL_SET_SURFACE_ANTIALIASING_LEVEL,
+        .surface = surface,
+        .value = level,
+    });
+}
+
+// Command execution happens on the render thread anyway, so
+// only resource functions have to be replaced.
+static void graphics__install_renderer_proxy(void)
+{
+    struct qu__render_thread *thread = &priv.render_thread;
+
+    thread->renderer = priv.renderer;
+    thread->proxy = *priv.renderer;
+
+    thread->proxy.load_texture = proxy_load_texture;
+    thread->proxy.update_texture_region = proxy_update_texture_region;
+    thread->proxy.unload_texture = proxy_unload_texture;
+    thread->proxy.set_texture_smooth = proxy_set_texture_smooth;
+    thread->proxy.set_texture_mipmaps = proxy_set_texture_mipmaps;
+    thread->proxy.create_surface = proxy_create_surface;
+    thread->proxy.destroy_surface = proxy_destroy_surface;
+    thread->proxy.set_surface_antialiasing_level = proxy_set_surface_antialiasing_level;
+
+    priv.renderer = &thread->proxy;
+}
+
+static void graphics__initialize_renderer_job(void *arg)
+{
+    initialize_renderer();
+    graphics__install_renderer_proxy();
+}
+
+static void graphics__terminate_renderer_job(void *arg)
+{
+    terminate_renderer();
+}
+
+static void graphics__execute_frame_job(void *arg)
+{
+    graphics__execute_texture_uploads(&priv.render_thread.uploads);
+    graphics__execute_recorder(&priv.render_thread.recorder);
+
+    if (priv.render_thread.present) {
+        qu_swap_buffers();
+        graphics__finish_stats_frame();
+        graphics__finish_gpu_timer_frame();
+        graphics__finish_frame_capture();
     }
+}
 
-    // This won't be called on surface textures.
-    priv.renderer->unload_texture(texture);
+// Hands recorded frame over to the render thread. Recording continues
+// to the buffers of the frame which was executed before.
+static void graphics__submit_frame(bool present)
+{
+    struct qu__render_thread *thread = &priv.render_thread;
+
+    graphics__wait_render_thread();
+
+    struct qu__render_command_buffer command_buffer = thread->recorder.command_buffer;
+    thread->recorder.command_buffer = priv.recorder.command_buffer;
+    priv.recorder.command_buffer = command_buffer;
+
+    for (int i = 0; i < QU_TOTAL_VERTEX_FORMATS; i++) {
+        struct qu__vertex_buffer vertex_buffer = thread->recorder.vertex_buffers[i];
+        thread->recorder.vertex_buffers[i] = priv.recorder.vertex_buffers[i];
+        priv.recorder.vertex_buffers[i] = vertex_buffer;
+    }
+
+    struct qu__texture_upload_buffer uploads = thread->uploads;
+    thread->uploads = thread->pending_uploads;
+    thread->pending_uploads = uploads;
+
+    thread->recorder.sort_draws = priv.recorder.sort_draws;
+    thread->recorder.culled_draws = priv.recorder.culled_draws;
+    thread->present = present;
+
+    priv.recorder.culled_draws = 0;
+
+    graphics__post_render_job(graphics__execute_frame_job, NULL);
 }
 
-static void surface_dtor(void *ptr)
+// Main thread releases graphics context, so the render thread can take it.
+static bool graphics__start_render_thread(void)
 {
-    if (!priv.renderer) {
-        return;
+    struct qu__render_thread *thread = &priv.render_thread;
+
+    if (!qu_gl_make_context_current(false)) {
+        QU_LOGW("Render thread is not supported, rendering on the main thread.\n");
+        return false;
+    }
+
+    thread->mutex = pl_create_mutex();
+    thread->cond = pl_create_cond();
+
+    QU_HALT_IF(!thread->mutex || !thread->cond);
+
+    graphics__initialize_recorder(&thread->recorder, NULL);
+
+    thread->thread = pl_create_thread("render", graphics__render_thread_main, NULL);
+
+    if (!thread->thread) {
+        QU_HALT("Failed to create render thread.");
     }
 
-    priv.renderer->destroy_surface((qu_surface_obj *) ptr);
+    QU_LOGI("Render thread is started.\n");
+
+    return true;
+}
+
+static void graphics__stop_render_thread(void)
+{
+    struct qu__render_thread *thread = &priv.render_thread;
+
+    pl_lock_mutex(thread->mutex);
+    thread->quit = true;
+    pl_broadcast_cond(thread->cond);
+    pl_unlock_mutex(thread->mutex);
+
+    pl_wait_thread(thread->thread);
+
+    graphics__terminate_recorder(&thread->recorder);
+
+    pl_free(thread->uploads.uploads);
+    pl_free(thread->uploads.pixels);
+    pl_free(thread->pending_uploads.uploads);
+    pl_free(thread->pending_uploads.pixels);
+
+    pl_destroy_cond(thread->cond);
+    pl_destroy_mutex(thread->mutex);
+
+    memset(thread, 0, sizeof(*thread));
+
+    // Return context to the main thread, core module destroys it.
+    qu_gl_make_context_current(true);
 }
 
 //------------------------------------------------------------------------------
+// Asynchronous texture loading
+
+static void graphics__push_texture_load(struct qu__texture_load_queue *queue,
+                                        struct qu__texture_load *load)
+{
+    load->next = NULL;
+
+    if (queue->tail) {
+        queue->tail->next = load;
+    } else {
+        queue->head = load;
+    }
+
+    queue->tail = load;
+}
+
+static struct qu__texture_load *graphics__pop_texture_load(struct qu__texture_load_queue *queue)
+{
+    struct qu__texture_load *load = queue->head;
+
+    if (load) {
+        queue->head = load->next;
+
+        if (!queue->head) {
+            queue->tail = NULL;
+        }
+    }
+
+    return load;
+}
+
+static void graphics__free_texture_loads(struct qu__texture_load_queue *queue)
+{
+    struct qu__texture_load *load;
+
+    while ((load = graphics__pop_texture_load(queue))) {
+        pl_free(load->texture.pixels);
+        pl_free(load->path);
+        pl_free(load);
+    }
+}
+
+static intptr_t graphics__texture_loader_main(void *arg)
+{
+    struct qu__texture_loader *loader = &priv.texture_loader;
+
+    pl_lock_mutex(loader->mutex);
+
+    while (true) {
+        while (!loader->pending.head && !loader->quit) {
+            pl_wait_cond(loader->cond, loader->mutex);
+        }
+
+        if (loader->quit) {
+            break;
+        }
+
+        struct qu__texture_load *load = graphics__pop_texture_load(&loader->pending);
+
+        pl_unlock_mutex(loader->mutex);
+        load->decoded = graphics__decode_texture(&load->texture, qu_open_file_from_path(load->path));
+        pl_lock_mutex(loader->mutex);
+
+        graphics__push_texture_load(&loader->decoded, load);
+    }
+
+    pl_unlock_mutex(loader->mutex);
+
+    return 0;
+}
 
-static void initialize_renderer(void)
+// Worker threads are started on the first asynchronous load.
+static bool graphics__start_texture_loader(void)
 {
-    QU_LOGD("Initializing renderer...\n");
+    struct qu__texture_loader *loader = &priv.texture_loader;
 
-    int renderer_impl_count = QU_ARRAY_SIZE(supported_renderer_impl_list);
+    if (loader->mutex) {
+        return true;
+    }
 
-    if (renderer_impl_count == 0) {
-        QU_HALT("renderer_impl_count == 0");
+    loader->mutex = pl_create_mutex();
+    loader->cond = pl_create_cond();
+
+    if (!loader->mutex || !loader->cond) {
+        pl_destroy_cond(loader->cond);
+        pl_destroy_mutex(loader->mutex);
+        memset(loader, 0, sizeof(*loader));
+        return false;
     }
 
-    for (int i = 0; i < renderer_impl_count; i++) {
-        priv.renderer = supported_renderer_impl_list[i];
+    int total_threads = 0;
 
-        QU_HALT_IF(!priv.renderer->query);
+    for (int i = 0; i < QU__TEXTURE_LOADER_THREADS; i++) {
+        loader->threads[i] = pl_create_thread("texture loader", graphics__texture_loader_main, NULL);
 
-        if (priv.renderer->query()) {
-            QU_LOGD("Selected graphics implementation #%d.\n", i);
-            break;
+        if (loader->threads[i]) {
+            total_threads++;
         }
     }
 
-    QU_HALT_IF(!priv.renderer->initialize);
-    QU_HALT_IF(!priv.renderer->terminate);
-    QU_HALT_IF(!priv.renderer->upload_vertex_data);
-
-    QU_HALT_IF(!priv.renderer->apply_projection);
-    QU_HALT_IF(!priv.renderer->apply_transform);
-    QU_HALT_IF(!priv.renderer->apply_surface);
-    QU_HALT_IF(!priv.renderer->apply_texture);
-    QU_HALT_IF(!priv.renderer->apply_clear_color);
-    QU_HALT_IF(!priv.renderer->apply_draw_color);
-    QU_HALT_IF(!priv.renderer->apply_brush);
-    QU_HALT_IF(!priv.renderer->apply_vertex_format);
-    QU_HALT_IF(!priv.renderer->apply_blend_mode);
+    // Nobody would decode queued textures.
+    if (total_threads == 0) {
+        QU_LOGW("Failed to start texture loader, textures are loaded synchronously.\n");
+        pl_destroy_cond(loader->cond);
+        pl_destroy_mutex(loader->mutex);
+        memset(loader, 0, sizeof(*loader));
+        return false;
+    }
 
-    QU_HALT_IF(!priv.renderer->exec_resize);
-    QU_HALT_IF(!priv.renderer->exec_clear);
-    QU_HALT_IF(!priv.renderer->exec_draw);
+    QU_LOGI("Texture loader is started.\n");
 
-    QU_HALT_IF(!priv.renderer->load_texture);
-    QU_HALT_IF(!priv.renderer->unload_texture);
-    QU_HALT_IF(!priv.renderer->set_texture_smooth);
+    return true;
+}
 
-    QU_HALT_IF(!priv.renderer->create_surface);
-    QU_HALT_IF(!priv.renderer->destroy_surface);
-    QU_HALT_IF(!priv.renderer->set_surface_antialiasing_level);
+static void graphics__stop_texture_loader(void)
+{
+    struct qu__texture_loader *loader = &priv.texture_loader;
 
-    priv.renderer->initialize();
+    if (!loader->mutex) {
+        return;
+    }
 
-    qu_texture_obj *texture = qu_handle_list_get_first(priv.textures);
+    pl_lock_mutex(loader->mutex);
+    loader->quit = true;
+    pl_broadcast_cond(loader->cond);
+    pl_unlock_mutex(loader->mutex);
 
-    while (texture) {
-        priv.renderer->load_texture(texture);
-        texture = qu_handle_list_get_next(priv.textures);
+    for (int i = 0; i < QU__TEXTURE_LOADER_THREADS; i++) {
+        if (loader->threads[i]) {
+            pl_wait_thread(loader->threads[i]);
+        }
     }
 
-    qu_surface_obj *surface = qu_handle_list_get_first(priv.surfaces);
+    graphics__free_texture_loads(&loader->pending);
+    graphics__free_texture_loads(&loader->decoded);
 
-    while (surface) {
-        priv.renderer->create_surface(surface);
-        surface = qu_handle_list_get_next(priv.surfaces);
+    pl_destroy_cond(loader->cond);
+    pl_destroy_mutex(loader->mutex);
+
+    memset(loader, 0, sizeof(*loader));
+}
+
+// Textures created from images can be placed into atlas.
+static void graphics__upload_image_texture(qu_texture_obj *texture, unsigned int flags)
+{
+    if ((flags & QU_TEXTURE_ATLAS) && !texture->compression
+        && graphics__add_texture_to_atlas(texture)) {
+        pl_free(texture->pixels);
+        texture->pixels = NULL;
+
+        // Pages keep their pixels, so the source isn't needed.
+        pl_free(texture->source_path);
+        texture->source_path = NULL;
+        texture->source_buffer = NULL;
+    } else {
+        priv.renderer->load_texture(texture);
+
+        // Source is only kept for GPU-only textures.
+        if (texture->source_path || texture->source_buffer) {
+            pl_free(texture->pixels);
+            texture->pixels = NULL;
+        }
     }
+}
 
-    priv.renderer->apply_clear_color(priv.clear_color);
-    priv.renderer->apply_draw_color(priv.draw_color);
-    priv.renderer->apply_brush(priv.brush);
-    priv.renderer->apply_vertex_format(priv.vertex_format);
-    priv.renderer->apply_projection(&priv.current_surface->projection);
-    priv.renderer->apply_transform(&priv.current_surface->modelview[0]);
-    priv.renderer->apply_surface(priv.current_surface);
-    priv.renderer->apply_texture(priv.current_texture);
+static void graphics__finish_texture_load(struct qu__texture_load *load)
+{
+    qu_texture_obj *texture = qu_handle_list_get(priv.textures, load->texture_id);
 
-    // Set default viewport.
-    qu_vec2i window_size = qu_get_window_size();
-    priv.renderer->exec_resize(window_size.x, window_size.y);
+    if (!texture) {
+        // Deleted while being loaded.
+        pl_free(load->texture.pixels);
+    } else if (!load->decoded) {
+        QU_LOGE("Failed to load texture \"%s\".\n", load->path);
+        qu_handle_list_remove(priv.textures, load->texture_id);
+    } else {
+        // Atlas may add a page to the texture list, so a copy is uploaded.
+        qu_texture_obj copy = *texture;
+
+        copy.width = load->texture.width;
+        copy.height = load->texture.height;
+        copy.channels = load->texture.channels;
+        copy.compression = load->texture.compression;
+        copy.pixels = load->texture.pixels;
+        copy.loading = false;
+
+        // Mipmaps might have been requested before the format was known.
+        if (copy.compression) {
+            copy.mipmaps = false;
+        }
 
-    // Enable alpha blend by default.
-    priv.renderer->apply_blend_mode(QU_BLEND_MODE_ALPHA);
+        graphics__upload_image_texture(&copy, load->texture_flags);
 
-    if (qu_get_window_flags() & QU_WINDOW_USE_CANVAS) {
-        priv.renderer->create_surface(&priv.canvas);
-        priv.renderer->set_texture_smooth(&priv.canvas.texture,
-            priv.params.canvas_flags & QU_CANVAS_SMOOTH);
+        *((qu_texture_obj *) qu_handle_list_get(priv.textures, load->texture_id)) = copy;
     }
 
-    QU_LOGD("Renderer is initialized.\n");
+    pl_free(load->path);
+    pl_free(load);
+
+    priv.texture_loader.total_loads--;
 }
 
-static void terminate_renderer(void)
+// At least one texture is uploaded per frame, more if they fit into the budget.
+static void graphics__finish_texture_loads(void)
 {
-    qu_texture_obj *texture = qu_handle_list_get_first(priv.textures);
+    struct qu__texture_loader *loader = &priv.texture_loader;
 
-    while (texture) {
-        priv.renderer->unload_texture(texture);
-        texture = qu_handle_list_get_next(priv.textures);
+    if (!loader->total_loads) {
+        return;
     }
 
-    qu_surface_obj *surface = qu_handle_list_get_first(priv.surfaces);
+    uint64_t start = pl_get_ticks_highp();
+    bool waited = false;
 
-    while (surface) {
-        priv.renderer->destroy_surface(surface);
-        surface = qu_handle_list_get_next(priv.surfaces);
-    }
+    while (true) {
+        pl_lock_mutex(loader->mutex);
+        struct qu__texture_load *load = graphics__pop_texture_load(&loader->decoded);
+        pl_unlock_mutex(loader->mutex);
 
-    if (priv.canvas_enabled) {
-        priv.renderer->destroy_surface(&priv.canvas);
-    }
+        if (!load) {
+            break;
+        }
 
-    priv.renderer->terminate();
+        // Texture list may be reallocated, and commands under execution point into it.
+        if (!waited) {
+            graphics__wait_render_thread();
+            waited = true;
+        }
 
-    priv.renderer = NULL;
+        graphics__finish_texture_load(load);
+
+        if ((pl_get_ticks_highp() - start) >= QU__TEXTURE_UPLOAD_BUDGET_NS) {
+            break;
+        }
+    }
 }
 
 //------------------------------------------------------------------------------
 
 void qu_initialize_graphics(void)
 {
-    QU_ALLOC_ARRAY(priv.command_buffer.data, QU__RENDER_COMMAND_BUFFER_INITIAL_CAPACITY);
-    priv.command_buffer.size = 0;
-    priv.command_buffer.capacity = QU__RENDER_COMMAND_BUFFER_INITIAL_CAPACITY;
-
-    for (int i = 0; i < QU_TOTAL_VERTEX_FORMATS; i++) {
-        QU_ALLOC_ARRAY(priv.vertex_buffers[i].data, QU__VERTEX_BUFFER_INITIAL_CAPACITY);
-        priv.vertex_buffers[i].size = 0;
-        priv.vertex_buffers[i].capacity = QU__VERTEX_BUFFER_INITIAL_CAPACITY;
-    }
+    graphics__initialize_recorder(&priv.recorder, &priv.display);
     
     priv.textures = qu_create_handle_list(sizeof(qu_texture_obj), texture_dtor);
-    priv.surfaces = qu_create_handle_list(sizeof(qu_surface_obj), surface_dtor);
+    priv.surfaces = qu_create_handle_list(sizeof(qu_surface_obj *), surface_dtor);
+    priv.draw_contexts = qu_create_handle_list(sizeof(struct qu__draw_context *), draw_context_dtor);
 
-    QU_ALLOC_ARRAY(priv.circle_vertices, 2 * QU__CIRCLE_VERTEX_COUNT);
+    QU_ALLOC_ARRAY(priv.quad_indices, 6 * QU__MAX_QUADS_PER_DRAW);
+
+    for (int i = 0; i < QU__MAX_QUADS_PER_DRAW; i++) {
+        uint16_t *indices = &priv.quad_indices[6 * i];
+
+        indices[0] = 4 * i + 0;
+        indices[1] = 4 * i + 1;
+        indices[2] = 4 * i + 2;
+        indices[3] = 4 * i + 2;
+        indices[4] = 4 * i + 3;
+        indices[5] = 4 * i + 0;
+    }
 
     priv.clear_color = QU_COLOR(0, 0, 0);
     priv.draw_color = QU_COLOR(255, 255, 255);
 
+    // Enable alpha blend by default.
+    priv.blend_mode = QU_BLEND_MODE_ALPHA;
+
     priv.brush = QU_BRUSH_SOLID;
     priv.vertex_format = QU_VERTEX_FORMAT_2XY;
 
@@ -712,10 +4635,17 @@ void qu_initialize_graphics(void)
 
     qu_mat4_ortho(&priv.display.projection, 0.f, window_size.x, window_size.y, 0.f);
     qu_mat4_identity(&priv.display.modelview[0]);
+    graphics__initialize_recorded_state(&priv.display);
+
+    priv.culling.surface = &priv.display;
+    qu_mat4_identity(&priv.culling.transform);
+    priv.culling.transform_known = true;
 
     priv.current_texture = NULL;
     priv.current_surface = &priv.display;
 
+    priv.cpu_transforms = priv.params.graphics_flags & QU_GRAPHICS_CPU_TRANSFORMS;
+
     // Create texture for canvas if needed.
     if (qu_get_window_flags() & QU_WINDOW_USE_CANVAS) {
         qu_vec2i canvas_size = qu_get_canvas_size();
@@ -728,20 +4658,28 @@ void qu_initialize_graphics(void)
                 .height = canvas_size.y,
             },
             .sample_count = qu_get_window_aa_level(),
+            .id = QU__CANVAS_SURFACE_ID,
         };
 
         qu_mat4_ortho(&priv.canvas.projection, 0.f, canvas_size.x, canvas_size.y, 0.f);
         qu_mat4_identity(&priv.canvas.modelview[0]);
+        graphics__initialize_recorded_state(&priv.canvas);
 
         graphics__append_render_command(&(struct qu__render_command_info) {
             .command = QU__RENDER_COMMAND_SET_SURFACE,
             .args.surface.surface = &priv.canvas,
         });
 
+        priv.recorder.target_surface = &priv.canvas;
+
         graphics__update_canvas_coords(window_size.x, window_size.y);
     }
 
-    initialize_renderer();
+    if ((priv.params.graphics_flags & QU_GRAPHICS_RENDER_THREAD) && graphics__start_render_thread()) {
+        graphics__invoke(graphics__initialize_renderer_job, NULL);
+    } else {
+        initialize_renderer();
+    }
 
     priv.initialized = true;
     QU_LOGI("Initialized.\n");
@@ -749,57 +4687,135 @@ void qu_initialize_graphics(void)
 
 void qu_terminate_graphics(void)
 {
-    terminate_renderer();
+    graphics__stop_texture_loader();
 
-    pl_free(priv.command_buffer.data);
+    if (priv.render_thread.thread) {
+        graphics__invoke(graphics__terminate_renderer_job, NULL);
+        graphics__stop_render_thread();
+    } else {
+        terminate_renderer();
+    }
 
-    for (int i = 0; i < QU_TOTAL_VERTEX_FORMATS; i++) {
-        pl_free(priv.vertex_buffers[i].data);
+    graphics__terminate_recorder(&priv.recorder);
+    qu_destroy_handle_list(priv.draw_contexts);
+
+    // Pages are freed along with other textures.
+    for (int i = 0; i < priv.total_atlas_pages; i++) {
+        pl_free(priv.atlas_pages[i].nodes);
     }
 
+    pl_free(priv.atlas_pages);
+    priv.total_atlas_pages = 0;
+
+    pl_free(priv.dirty_textures);
+
     qu_destroy_handle_list(priv.textures);
     qu_destroy_handle_list(priv.surfaces);
 
-    pl_free(priv.circle_vertices);
+    pl_free(priv.surface_pool.entries);
+    pl_free(priv.surface_pool.transient_surfaces);
+
+    pl_free(priv.quad_indices);
+    pl_free(priv.sort_entries);
+    pl_destroy_mutex(priv.renderer_stats.mutex);
+    pl_destroy_mutex(priv.gpu_timers.mutex);
+    graphics__terminate_frame_capture();
 
     memset(&priv, 0, sizeof(priv));
 
     QU_LOGI("Terminated.\n");
 }
 
-void qu_flush_graphics(void)
+static void graphics__flush(bool present)
 {
     if (priv.canvas_enabled) {
         graphics__flush_canvas();
     }
 
-    for (int i = 0; i < QU_TOTAL_VERTEX_FORMATS; i++) {
-        graphics__upload_vertex_data(i);
+    graphics__finish_texture_loads();
+    graphics__upload_dirty_textures();
+
+    if (priv.render_thread.thread) {
+        graphics__submit_frame(present);
+    } else {
+        graphics__execute_recorder(&priv.recorder);
+
+        if (present) {
+            qu_swap_buffers();
+            graphics__finish_stats_frame();
+            graphics__finish_gpu_timer_frame();
+            graphics__finish_frame_capture();
+        }
     }
 
-    graphics__execute_command_buffer();
+    // Pending path is only changed by synchronous jobs, so it's safe to read.
+    if (present && priv.frame_capture.pending_path) {
+        graphics__invoke(graphics__begin_frame_capture_job, NULL);
+    }
 
     if (priv.canvas_enabled) {
         graphics__append_render_command(&(struct qu__render_command_info) {
             .command = QU__RENDER_COMMAND_SET_SURFACE,
             .args.surface.surface = &priv.canvas,
         });
+
+        priv.recorder.target_surface = &priv.canvas;
+    }
+
+    if (present) {
+        graphics__update_surface_pool();
     }
 }
 
-void qu_event_context_lost(void)
+void qu_flush_graphics(void)
+{
+    graphics__flush(false);
+}
+
+void qu_present_graphics(void)
+{
+    graphics__flush(true);
+}
+
+static void graphics__lose_context(void *arg)
 {
     terminate_renderer();
     
     priv.renderer = &qu_null_renderer_impl;
     priv.renderer->initialize();
+    priv.renderer_features = priv.renderer->query_features();
+
+    if (priv.render_thread.thread) {
+        graphics__install_renderer_proxy();
+    }
 }
 
-void qu_event_context_restored(void)
+static void graphics__restore_context(void *arg)
 {
+    // Surfaces deleted while context was lost have no renderer objects.
+    graphics__clear_surface_pool();
+
     priv.renderer->terminate();
 
     initialize_renderer();
+
+    if (priv.render_thread.thread) {
+        graphics__install_renderer_proxy();
+    }
+}
+
+// Executed on the render thread after the frame it's working on is done.
+void qu_event_context_lost(void)
+{
+    graphics__invoke(graphics__lose_context, NULL);
+}
+
+void qu_event_context_restored(void)
+{
+    graphics__invoke(graphics__restore_context, NULL);
+
+    // Renderer state is reapplied from the executed surface.
+    priv.culling.transform_known = false;
 }
 
 void qu_event_window_resize(int width, int height)
@@ -809,6 +4825,15 @@ void qu_event_window_resize(int width, int height)
         return;
     }
 
+    // Updated here rather than in graphics__exec_resize() because both are
+    // used while recording, which may happen in parallel with execution.
+    priv.display.texture.width = width;
+    priv.display.texture.height = height;
+
+    if (priv.canvas_enabled) {
+        graphics__update_canvas_coords(width, height);
+    }
+
     graphics__append_render_command(&(struct qu__render_command_info) {
         .command = QU__RENDER_COMMAND_RESIZE,
         .args.resize = {
@@ -914,6 +4939,18 @@ void qu_set_canvas_flags(unsigned int flags)
     priv.params.canvas_flags = flags;
 }
 
+unsigned int qu_get_graphics_flags(void)
+{
+    return priv.params.graphics_flags;
+}
+
+void qu_set_graphics_flags(unsigned int flags)
+{
+    if (!priv.initialized) {
+        priv.params.graphics_flags = flags;
+    }
+}
+
 void qu_set_view(float x, float y, float w, float h, float rotation)
 {
     graphics__append_render_command(&(struct qu__render_command_info) {
@@ -937,6 +4974,11 @@ void qu_reset_view(void)
 
 void qu_push_matrix(void)
 {
+    if (priv.cpu_transforms) {
+        graphics__push_matrix(graphics__get_recorder()->target_surface);
+        return;
+    }
+
     graphics__append_render_command(&(struct qu__render_command_info) {
         .command = QU__RENDER_COMMAND_PUSH_MATRIX,
     });
@@ -944,6 +4986,11 @@ void qu_push_matrix(void)
 
 void qu_pop_matrix(void)
 {
+    if (priv.cpu_transforms) {
+        graphics__pop_matrix(graphics__get_recorder()->target_surface);
+        return;
+    }
+
     graphics__append_render_command(&(struct qu__render_command_info) {
         .command = QU__RENDER_COMMAND_POP_MATRIX,
     });
@@ -951,6 +4998,11 @@ void qu_pop_matrix(void)
 
 void qu_translate(float x, float y)
 {
+    if (priv.cpu_transforms) {
+        qu_mat4_translate(graphics__get_modelview(graphics__get_recorder()->target_surface), x, y, 0.f);
+        return;
+    }
+
     graphics__append_render_command(&(struct qu__render_command_info) {
         .command = QU__RENDER_COMMAND_TRANSLATE,
         .args.transform = {
@@ -962,6 +5014,11 @@ void qu_translate(float x, float y)
 
 void qu_scale(float x, float y)
 {
+    if (priv.cpu_transforms) {
+        qu_mat4_scale(graphics__get_modelview(graphics__get_recorder()->target_surface), x, y, 1.f);
+        return;
+    }
+
     graphics__append_render_command(&(struct qu__render_command_info) {
         .command = QU__RENDER_COMMAND_SCALE,
         .args.transform = {
@@ -973,6 +5030,11 @@ void qu_scale(float x, float y)
 
 void qu_rotate(float degrees)
 {
+    if (priv.cpu_transforms) {
+        qu_mat4_rotate(graphics__get_modelview(graphics__get_recorder()->target_surface), QU_DEG2RAD(degrees), 0.f, 0.f, 1.f);
+        return;
+    }
+
     graphics__append_render_command(&(struct qu__render_command_info) {
         .command = QU__RENDER_COMMAND_ROTATE,
         .args.transform = {
@@ -981,6 +5043,67 @@ void qu_rotate(float degrees)
     });
 }
 
+void qu_set_draw_layer(int layer)
+{
+    struct qu__recorder *recorder = graphics__get_recorder();
+
+    recorder->draw_layer = QU_MAX(-32768, QU_MIN(layer, 32767));
+    recorder->sort_draws = true;
+}
+
+void qu_get_frame_stats(qu_frame_stats *stats)
+{
+    if (!priv.renderer_stats.mutex) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    pl_lock_mutex(priv.renderer_stats.mutex);
+    *stats = priv.renderer_stats.last;
+    pl_unlock_mutex(priv.renderer_stats.mutex);
+}
+
+char const *qu_get_renderer_function_name(qu_renderer_function function)
+{
+    if (function < 0 || function >= QU_TOTAL_RENDERER_FUNCTIONS) {
+        return NULL;
+    }
+
+    return renderer_function_names[function];
+}
+
+bool qu_capture_frames(char const *path, int count)
+{
+    if (!path || count < 1) {
+        return false;
+    }
+
+    struct qu__capture_request request = {
+        .path = path,
+        .count = count,
+    };
+
+    graphics__invoke(graphics__request_frame_capture_job, &request);
+
+    return request.accepted;
+}
+
+int qu_replay_frames(char const *path, double *frame_times, int max_frames)
+{
+    struct qu__replay_request request = {
+        .path = path,
+        .frame_times = frame_times,
+        .max_frames = frame_times ? max_frames : 0,
+    };
+
+    graphics__invoke(graphics__replay_frames_job, &request);
+
+    // Renderer state is reapplied from the executed surface.
+    priv.culling.transform_known = false;
+
+    return request.total_frames;
+}
+
 void qu_set_blend_mode(qu_blend_mode mode)
 {
     if (mode.color_src_factor < 0 || mode.color_src_factor >= 10) {
@@ -1027,16 +5150,22 @@ void qu_clear(qu_color color)
 
 void qu_draw_point(float x, float y, qu_color color)
 {
-    float const vertex[] = { x, y };
+    if (graphics__cull_rect(x, y, x, y)) {
+        return;
+    }
+
+    float vertex[] = { x, y, 0.f, 0.f, 0.f };
+
+    graphics__set_vertex_color(vertex, 1, color);
 
     graphics__append_render_command(&(struct qu__render_command_info) {
         .command = QU__RENDER_COMMAND_DRAW,
         .args.draw = {
-            .color = color,
+            .color = QU_COLOR(255, 255, 255),
             .brush = QU_BRUSH_SOLID,
-            .vertex_format = QU_VERTEX_FORMAT_2XY,
+            .vertex_format = QU_VERTEX_FORMAT_5XYCST,
             .render_mode = QU_RENDER_MODE_POINTS,
-            .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_2XY, vertex, 2),
+            .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_5XYCST, vertex, 5),
             .total_vertices = 1,
         },
     });
@@ -1044,19 +5173,25 @@ void qu_draw_point(float x, float y, qu_color color)
 
 void qu_draw_line(float ax, float ay, float bx, float by, qu_color color)
 {
-    float const vertices[] = {
-        ax, ay,
-        bx, by,
+    if (graphics__cull_rect(ax, ay, bx, by)) {
+        return;
+    }
+
+    float vertices[] = {
+        ax, ay, 0.f, 0.f, 0.f,
+        bx, by, 0.f, 0.f, 0.f,
     };
 
+    graphics__set_vertex_color(vertices, 2, color);
+
     graphics__append_render_command(&(struct qu__render_command_info) {
         .command = QU__RENDER_COMMAND_DRAW,
         .args.draw = {
-            .color = color,
+            .color = QU_COLOR(255, 255, 255),
             .brush = QU_BRUSH_SOLID,
-            .vertex_format = QU_VERTEX_FORMAT_2XY,
+            .vertex_format = QU_VERTEX_FORMAT_5XYCST,
             .render_mode = QU_RENDER_MODE_LINES,
-            .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_2XY, vertices, 4),
+            .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_5XYCST, vertices, 10),
             .total_vertices = 2,
         },
     });
@@ -1067,37 +5202,43 @@ void qu_draw_triangle(float ax, float ay, float bx, float by, float cx, float cy
     int outline_alpha = (outline >> 24) & 255;
     int fill_alpha = (fill >> 24) & 255;
     
-    float const vertices[] = {
-        ax, ay,
-        bx, by,
-        cx, cy,
+    float vertices[] = {
+        ax, ay, 0.f, 0.f, 0.f,
+        bx, by, 0.f, 0.f, 0.f,
+        cx, cy, 0.f, 0.f, 0.f,
     };
 
-    unsigned int first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_2XY, vertices, 6);
-    
+    if (graphics__cull_vertices(vertices, 3, 5)) {
+        return;
+    }
+
     if (fill_alpha > 0) {
+        graphics__set_vertex_color(vertices, 3, fill);
+
         graphics__append_render_command(&(struct qu__render_command_info) {
             .command = QU__RENDER_COMMAND_DRAW,
             .args.draw = {
-                .color = fill,
+                .color = QU_COLOR(255, 255, 255),
                 .brush = QU_BRUSH_SOLID,
-                .vertex_format = QU_VERTEX_FORMAT_2XY,
+                .vertex_format = QU_VERTEX_FORMAT_5XYCST,
                 .render_mode = QU_RENDER_MODE_TRIANGLES,
-                .first_vertex = first_vertex,
+                .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_5XYCST, vertices, 15),
                 .total_vertices = 3,
             },
         });
     }
 
     if (outline_alpha > 0) {
+        graphics__set_vertex_color(vertices, 3, outline);
+
         graphics__append_render_command(&(struct qu__render_command_info) {
             .command = QU__RENDER_COMMAND_DRAW,
             .args.draw = {
-                .color = outline,
+                .color = QU_COLOR(255, 255, 255),
                 .brush = QU_BRUSH_SOLID,
-                .vertex_format = QU_VERTEX_FORMAT_2XY,
+                .vertex_format = QU_VERTEX_FORMAT_5XYCST,
                 .render_mode = QU_RENDER_MODE_LINE_LOOP,
-                .first_vertex = first_vertex,
+                .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_5XYCST, vertices, 15),
                 .total_vertices = 3,
             },
         });
@@ -1108,39 +5249,53 @@ void qu_draw_rectangle(float x, float y, float w, float h, qu_color outline, qu_
 {
     int outline_alpha = (outline >> 24) & 255;
     int fill_alpha = (fill >> 24) & 255;
-    
-    float const vertices[] = {
-        x,          y,
-        x + w,      y,
-        x + w,      y + h,
-        x,          y + h,
-    };
 
-    unsigned int first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_2XY, vertices, 8);
-    
+    if (graphics__cull_rect(x, y, x + w, y + h)) {
+        return;
+    }
+
     if (fill_alpha > 0) {
+        float vertices[] = {
+            x,          y,          0.f,    0.f,    0.f,
+            x + w,      y,          0.f,    0.f,    0.f,
+            x + w,      y + h,      0.f,    0.f,    0.f,
+            x,          y + h,      0.f,    0.f,    0.f,
+        };
+
+        graphics__set_vertex_color(vertices, 4, fill);
+
         graphics__append_render_command(&(struct qu__render_command_info) {
             .command = QU__RENDER_COMMAND_DRAW,
             .args.draw = {
-                .color = fill,
+                .color = QU_COLOR(255, 255, 255),
                 .brush = QU_BRUSH_SOLID,
-                .vertex_format = QU_VERTEX_FORMAT_2XY,
-                .render_mode = QU_RENDER_MODE_TRIANGLE_FAN,
-                .first_vertex = first_vertex,
+                .vertex_format = QU_VERTEX_FORMAT_5XYCST,
+                .render_mode = QU_RENDER_MODE_TRIANGLES,
+                .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_5XYCST, vertices, 20),
                 .total_vertices = 4,
+                .indexed = true,
             },
         });
     }
 
     if (outline_alpha > 0) {
+        float vertices[] = {
+            x,          y,          0.f,    0.f,    0.f,
+            x + w,      y,          0.f,    0.f,    0.f,
+            x + w,      y + h,      0.f,    0.f,    0.f,
+            x,          y + h,      0.f,    0.f,    0.f,
+        };
+
+        graphics__set_vertex_color(vertices, 4, outline);
+
         graphics__append_render_command(&(struct qu__render_command_info) {
             .command = QU__RENDER_COMMAND_DRAW,
             .args.draw = {
-                .color = outline,
+                .color = QU_COLOR(255, 255, 255),
                 .brush = QU_BRUSH_SOLID,
-                .vertex_format = QU_VERTEX_FORMAT_2XY,
+                .vertex_format = QU_VERTEX_FORMAT_5XYCST,
                 .render_mode = QU_RENDER_MODE_LINE_LOOP,
-                .first_vertex = first_vertex,
+                .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_5XYCST, vertices, 20),
                 .total_vertices = 4,
             },
         });
@@ -1152,48 +5307,79 @@ void qu_draw_circle(float x, float y, float radius, qu_color outline, qu_color f
     int outline_alpha = (outline >> 24) & 255;
     int fill_alpha = (fill >> 24) & 255;
 
+    if (graphics__cull_rect(x - radius, y - radius, x + radius, y + radius)) {
+        return;
+    }
+
     int total_vertices = QU__CIRCLE_VERTEX_COUNT;
-    float *vertices = priv.circle_vertices;
+    float vertices[5 * QU__CIRCLE_VERTEX_COUNT];
 
     float angle = QU_DEG2RAD(360.f / total_vertices);
     
     for (int i = 0; i < total_vertices; i++) {
-        vertices[2 * i + 0] = x + (radius * cosf(i * angle));
-        vertices[2 * i + 1] = y + (radius * sinf(i * angle));
+        vertices[5 * i + 0] = x + (radius * cosf(i * angle));
+        vertices[5 * i + 1] = y + (radius * sinf(i * angle));
+        vertices[5 * i + 3] = 0.f;
+        vertices[5 * i + 4] = 0.f;
     }
 
-    unsigned int first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_2XY,
-                                                             vertices, 2 * total_vertices);
-    
     if (fill_alpha > 0) {
+        graphics__set_vertex_color(vertices, total_vertices, fill);
+
         graphics__append_render_command(&(struct qu__render_command_info) {
             .command = QU__RENDER_COMMAND_DRAW,
             .args.draw = {
-                .color = fill,
+                .color = QU_COLOR(255, 255, 255),
                 .brush = QU_BRUSH_SOLID,
-                .vertex_format = QU_VERTEX_FORMAT_2XY,
+                .vertex_format = QU_VERTEX_FORMAT_5XYCST,
                 .render_mode = QU_RENDER_MODE_TRIANGLE_FAN,
-                .first_vertex = first_vertex,
+                .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_5XYCST,
+                                                             vertices, 5 * total_vertices),
                 .total_vertices = total_vertices,
             },
         });
     }
 
     if (outline_alpha > 0) {
+        graphics__set_vertex_color(vertices, total_vertices, outline);
+
         graphics__append_render_command(&(struct qu__render_command_info) {
             .command = QU__RENDER_COMMAND_DRAW,
             .args.draw = {
-                .color = outline,
+                .color = QU_COLOR(255, 255, 255),
                 .brush = QU_BRUSH_SOLID,
-                .vertex_format = QU_VERTEX_FORMAT_2XY,
+                .vertex_format = QU_VERTEX_FORMAT_5XYCST,
                 .render_mode = QU_RENDER_MODE_LINE_LOOP,
-                .first_vertex = first_vertex,
+                .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_5XYCST,
+                                                             vertices, 5 * total_vertices),
                 .total_vertices = total_vertices,
             },
         });
     }
 }
 
+static qu_texture graphics__add_image_texture(qu_texture_obj *texture)
+{
+    // Texture list may be reallocated, and commands under execution point into it.
+    graphics__wait_render_thread();
+
+    graphics__upload_image_texture(texture, priv.texture_flags);
+
+    return (qu_texture) {
+        .id = qu_handle_list_add(priv.textures, texture),
+    };
+}
+
+unsigned int qu_get_texture_flags(void)
+{
+    return priv.texture_flags;
+}
+
+void qu_set_texture_flags(unsigned int flags)
+{
+    priv.texture_flags = flags;
+}
+
 qu_texture qu_create_texture(int width, int height, int channels)
 {
     qu_texture_obj texture = {
@@ -1237,56 +5423,108 @@ qu_texture qu_create_texture_from_image(qu_image image)
 
     memcpy(texture.pixels, pixels, size.x * size.y * channels);
 
-    priv.renderer->load_texture(&texture);
-
-    return (qu_texture) {
-        .id = qu_handle_list_add(priv.textures, &texture),
-    };
+    return graphics__add_image_texture(&texture);
 }
 
 qu_texture qu_load_texture(char const *path)
 {
-    qu_file *file = qu_open_file_from_path(path);
+    qu_texture_obj texture = { 0 };
 
-    if (!file) {
+    if (!graphics__decode_texture(&texture, qu_open_file_from_path(path))) {
         return (qu_texture) { .id = 0 };
     }
 
-    qu_image_loader *loader = qu_open_image_loader(file);
+    if (priv.texture_flags & QU_TEXTURE_GPU_ONLY) {
+        texture.source_path = qu_strdup(path);
+    }
 
-    if (!loader) {
-        qu_close_file(file);
+    return graphics__add_image_texture(&texture);
+}
+
+qu_texture qu_load_texture_from_memory(void *buffer, size_t size)
+{
+    qu_texture_obj texture = { 0 };
+
+    if (!graphics__decode_texture(&texture, qu_open_file_from_buffer(buffer, size))) {
+        return (qu_texture) { .id = 0 };
+    }
+
+    if (priv.texture_flags & QU_TEXTURE_GPU_ONLY) {
+        texture.source_buffer = buffer;
+        texture.source_size = size;
+    }
+
+    return graphics__add_image_texture(&texture);
+}
+
+qu_texture qu_load_texture_async(char const *path)
+{
+    if (!graphics__start_texture_loader()) {
+        return qu_load_texture(path);
+    }
+
+    struct qu__texture_load *load = pl_calloc(1, sizeof(*load));
+
+    if (!load) {
+        return (qu_texture) { .id = 0 };
+    }
+
+    load->path = qu_strdup(path);
+    load->texture_flags = priv.texture_flags;
+
+    if (!load->path) {
+        pl_free(load);
         return (qu_texture) { .id = 0 };
     }
 
     qu_texture_obj texture = {
-        .width = loader->width,
-        .height = loader->height,
-        .channels = loader->channels,
-        .pixels = pl_malloc(loader->width * loader->height * loader->channels),
+        .loading = true,
     };
 
-    if (!texture.pixels) {
-        qu_close_image_loader(loader);
-        qu_close_file(file);
-        return (qu_texture) { .id = 0 };
+    if (priv.texture_flags & QU_TEXTURE_GPU_ONLY) {
+        texture.source_path = qu_strdup(path);
+
+        if (!texture.source_path) {
+            pl_free(load->path);
+            pl_free(load);
+            return (qu_texture) { .id = 0 };
+        }
     }
 
-    qu_result status = qu_image_loader_load(loader, texture.pixels);
+    // Texture list may be reallocated, and commands under execution point into it.
+    graphics__wait_render_thread();
 
-    qu_close_image_loader(loader);
-    qu_close_file(file);
+    // Texture is released by the handle list if it can't be added.
+    load->texture_id = qu_handle_list_add(priv.textures, &texture);
 
-    if (status != QU_SUCCESS) {
-        pl_free(texture.pixels);
+    if (!load->texture_id) {
+        pl_free(load->path);
+        pl_free(load);
         return (qu_texture) { .id = 0 };
     }
 
-    priv.renderer->load_texture(&texture);
+    struct qu__texture_loader *loader = &priv.texture_loader;
 
-    return (qu_texture) {
-        .id = qu_handle_list_add(priv.textures, &texture),
-    };
+    pl_lock_mutex(loader->mutex);
+    graphics__push_texture_load(&loader->pending, load);
+    pl_broadcast_cond(loader->cond);
+    pl_unlock_mutex(loader->mutex);
+
+    loader->total_loads++;
+
+    return (qu_texture) { .id = load->texture_id };
+}
+
+bool qu_is_texture_loaded(qu_texture texture)
+{
+    qu_texture_obj *texture_p = qu_handle_list_get(priv.textures, texture.id);
+
+    return texture_p && !texture_p->loading;
+}
+
+int qu_get_pending_texture_loads(void)
+{
+    return priv.texture_loader.total_loads;
 }
 
 void qu_delete_texture(qu_texture texture)
@@ -1298,12 +5536,30 @@ void qu_set_texture_smooth(qu_texture texture, bool smooth)
 {
     qu_texture_obj *texture_p = qu_handle_list_get(priv.textures, texture.id);
 
-    if (texture_p) {
+    if (!texture_p || texture_p->atlas_page) {
         return;
     }
 
     texture_p->smooth = smooth;
-    priv.renderer->set_texture_smooth(texture_p, smooth);
+
+    if (!texture_p->loading) {
+        priv.renderer->set_texture_smooth(texture_p, smooth);
+    }
+}
+
+void qu_set_texture_mipmaps(qu_texture texture, bool mipmaps)
+{
+    qu_texture_obj *texture_p = qu_handle_list_get(priv.textures, texture.id);
+
+    if (!texture_p || texture_p->atlas_page || texture_p->compression) {
+        return;
+    }
+
+    texture_p->mipmaps = mipmaps;
+
+    if (!texture_p->loading) {
+        priv.renderer->set_texture_mipmaps(texture_p, mipmaps);
+    }
 }
 
 void qu_update_texture(qu_texture handle, qu_image image)
@@ -1326,15 +5582,33 @@ void qu_update_texture(qu_texture handle, qu_image image)
         return;
     }
 
+    if (texture->atlas_page) {
+        qu_texture_obj *page_texture = qu_handle_list_get(priv.textures, texture->atlas_page);
+
+        graphics__blit_atlas_image(page_texture, texture->atlas_x, texture->atlas_y,
+                                   texture->width, texture->height, qu_get_image_pixels(image));
+
+        graphics__invalidate_texture(texture->atlas_page, page_texture,
+                                     texture->atlas_x - QU__ATLAS_PADDING,
+                                     texture->atlas_y - QU__ATLAS_PADDING,
+                                     texture->width + 2 * QU__ATLAS_PADDING,
+                                     texture->height + 2 * QU__ATLAS_PADDING);
+        return;
+    }
+
+    if (!texture->pixels || texture->compression) {
+        return;
+    }
+
     memcpy(texture->pixels, qu_get_image_pixels(image), texture->width * texture->height * texture->channels);
-    priv.renderer->load_texture(texture);
+    graphics__invalidate_texture(handle.id, texture, 0, 0, texture->width, texture->height);
 }
 
 void qu_update_texture_ex(qu_texture texture, int x, int y, int w, int h, uint8_t const *pixels)
 {
     qu_texture_obj *texture_p = qu_handle_list_get(priv.textures, texture.id);
 
-    if (!texture_p || !texture_p->pixels) {
+    if (!texture_p) {
         return;
     }
 
@@ -1346,26 +5620,40 @@ void qu_update_texture_ex(qu_texture texture, int x, int y, int w, int h, uint8_
         h = texture_p->height;
     }
 
+    if (x < 0 || y < 0 || w <= 0 || h <= 0
+        || (x + w) > texture_p->width || (y + h) > texture_p->height) {
+        return;
+    }
+
+    int px = x;
+    int py = y;
+    qu_texture_obj *page_p = graphics__get_texture_page(texture_p, &px, &py);
+
+    if (!page_p || !page_p->pixels || page_p->compression) {
+        return;
+    }
+
     for (int i = 0; i < h; i++) {
         for (int j = 0; j < w; j++) {
-            size_t nc = texture_p->channels;
-            size_t di = (y + i) * texture_p->width * nc + (x + j) * nc;
+            size_t nc = page_p->channels;
+            size_t di = (py + i) * page_p->width * nc + (px + j) * nc;
             size_t si = i * w * nc + j * nc;
 
             for (size_t k = 0; k < nc; k++) {
-                texture_p->pixels[di + k] = pixels[si + k];
+                page_p->pixels[di + k] = pixels[si + k];
             }
         }
     }
 
-    priv.renderer->load_texture(texture_p);
+    int32_t page_id = (page_p != texture_p) ? texture_p->atlas_page : texture.id;
+    graphics__invalidate_texture(page_id, page_p, px, py, w, h);
 }
 
 void qu_resize_texture(qu_texture handle, int width, int height)
 {
     qu_texture_obj *texture = qu_handle_list_get(priv.textures, handle.id);
 
-    if (!texture) {
+    if (!texture || !texture->pixels || texture->compression) {
         return;
     }
 
@@ -1392,6 +5680,8 @@ void qu_resize_texture(qu_texture handle, int width, int height)
     texture->height = height;
     texture->pixels = pixels;
 
+    // Whole texture is uploaded now.
+    texture->total_dirty_rects = 0;
     priv.renderer->load_texture(texture);
 }
 
@@ -1399,27 +5689,39 @@ void qu_draw_texture(qu_texture texture, float x, float y, float w, float h)
 {
     qu_texture_obj *texture_p = qu_handle_list_get(priv.textures, texture.id);
 
-    if (!texture_p) {
+    if (!texture_p || texture_p->loading || graphics__cull_rect(x, y, x + w, y + h)) {
         return;
     }
 
-    float const vertices[] = {
-        x,      y,      0.f,    0.f,
-        x + w,  y,      1.f,    0.f,
-        x + w,  y + h,  1.f,    1.f,
-        x,      y + h,  0.f,    1.f,
+    int px = 0;
+    int py = 0;
+    qu_texture_obj *page_p = graphics__get_texture_page(texture_p, &px, &py);
+
+    float s0 = px / (float) page_p->width;
+    float t0 = py / (float) page_p->height;
+    float s1 = (px + texture_p->width) / (float) page_p->width;
+    float t1 = (py + texture_p->height) / (float) page_p->height;
+
+    float vertices[] = {
+        x,      y,      0.f,    s0,     t0,
+        x + w,  y,      0.f,    s1,     t0,
+        x + w,  y + h,  0.f,    s1,     t1,
+        x,      y + h,  0.f,    s0,     t1,
     };
 
+    graphics__set_vertex_color(vertices, 4, QU_COLOR(255, 255, 255));
+
     graphics__append_render_command(&(struct qu__render_command_info) {
         .command = QU__RENDER_COMMAND_DRAW,
         .args.draw = {
-            .texture = texture_p,
+            .texture = page_p,
             .color = QU_COLOR(255, 255, 255),
             .brush = QU_BRUSH_TEXTURED,
-            .vertex_format = QU_VERTEX_FORMAT_4XYST,
-            .render_mode = QU_RENDER_MODE_TRIANGLE_FAN,
-            .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_4XYST, vertices, 16),
+            .vertex_format = QU_VERTEX_FORMAT_5XYCST,
+            .render_mode = QU_RENDER_MODE_TRIANGLES,
+            .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_5XYCST, vertices, 20),
             .total_vertices = 4,
+            .indexed = true,
         },
     });
 }
@@ -1428,41 +5730,91 @@ void qu_draw_subtexture(qu_texture texture, float x, float y, float w, float h,
 {
     qu_texture_obj *texture_p = qu_handle_list_get(priv.textures, texture.id);
 
-    if (!texture_p) {
+    if (!texture_p || texture_p->loading || graphics__cull_rect(x, y, x + w, y + h)) {
         return;
     }
 
-    float s = rx / texture_p->width;
-    float t = ry / texture_p->height;
-    float u = rw / texture_p->width;
-    float v = rh / texture_p->height;
+    int px = 0;
+    int py = 0;
+    qu_texture_obj *page_p = graphics__get_texture_page(texture_p, &px, &py);
 
-    float const vertices[] = {
-        x,      y,      s,      t,
-        x + w,  y,      s + u,  t,
-        x + w,  y + h,  s + u,  t + v,
-        x,      y + h,  s,      t + v,
+    float s = (px + rx) / page_p->width;
+    float t = (py + ry) / page_p->height;
+    float u = rw / page_p->width;
+    float v = rh / page_p->height;
+
+    float vertices[] = {
+        x,      y,      0.f,    s,      t,
+        x + w,  y,      0.f,    s + u,  t,
+        x + w,  y + h,  0.f,    s + u,  t + v,
+        x,      y + h,  0.f,    s,      t + v,
     };
 
+    graphics__set_vertex_color(vertices, 4, QU_COLOR(255, 255, 255));
+
     graphics__append_render_command(&(struct qu__render_command_info) {
         .command = QU__RENDER_COMMAND_DRAW,
         .args.draw = {
-            .texture = texture_p,
+            .texture = page_p,
             .color = QU_COLOR(255, 255, 255),
             .brush = QU_BRUSH_TEXTURED,
-            .vertex_format = QU_VERTEX_FORMAT_4XYST,
-            .render_mode = QU_RENDER_MODE_TRIANGLE_FAN,
-            .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_4XYST, vertices, 16),
+            .vertex_format = QU_VERTEX_FORMAT_5XYCST,
+            .render_mode = QU_RENDER_MODE_TRIANGLES,
+            .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_5XYCST, vertices, 20),
             .total_vertices = 4,
+            .indexed = true,
         },
     });
 }
 
-void qu_draw_font(qu_texture texture, qu_color color, float const *data, int count)
+// Sprite quad is generated by the vertex shader, so sprite data
+// is copied as is and no vertex positions are calculated here.
+// Only translation can be baked into sprite position.
+static void graphics__draw_sprites_instanced(qu_texture_obj *texture_p, int px, int py,
+                                             qu_sprite const *sprites, int count)
 {
-    qu_texture_obj *texture_p = qu_handle_list_get(priv.textures, texture.id);
+    float dx = 0.f;
+    float dy = 0.f;
 
-    if (!texture_p) {
+    if (priv.cpu_transforms) {
+        qu_mat4 const *matrix = graphics__get_modelview(graphics__get_recorder()->target_surface);
+
+        dx = matrix->m[12];
+        dy = matrix->m[13];
+    }
+
+    unsigned int first_instance;
+    float *v = graphics__reserve_vertex_data(QU_VERTEX_FORMAT_SPRITE, 12 * count, &first_instance);
+    int total_visible = 0;
+
+    for (int i = 0; i < count; i++) {
+        qu_sprite const *sprite = &sprites[i];
+
+        if (graphics__cull_sprite(sprite)) {
+            continue;
+        }
+
+        graphics__write_color(&v[0], sprite->color);
+
+        v[1] = sprite->x + dx;
+        v[2] = sprite->y + dy;
+        v[3] = sprite->w;
+        v[4] = sprite->h;
+        v[5] = sprite->ox;
+        v[6] = sprite->oy;
+        v[7] = sprite->rot;
+        v[8] = sprite->rx + px;
+        v[9] = sprite->ry + py;
+        v[10] = sprite->rw;
+        v[11] = sprite->rh;
+
+        v += 12;
+        total_visible++;
+    }
+
+    graphics__release_vertex_data(QU_VERTEX_FORMAT_SPRITE, 12 * (count - total_visible));
+
+    if (total_visible == 0) {
         return;
     }
 
@@ -1470,52 +5822,202 @@ void qu_draw_font(qu_texture texture, qu_color color, float const *data, int cou
         .command = QU__RENDER_COMMAND_DRAW,
         .args.draw = {
             .texture = texture_p,
-            .color = color,
-            .brush = QU_BRUSH_TEXTURED,
-            .vertex_format = QU_VERTEX_FORMAT_4XYST,
-            .render_mode = QU_RENDER_MODE_TRIANGLES,
-            .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_4XYST, data, count * 4),
-            .total_vertices = count,
+            .color = QU_COLOR(255, 255, 255),
+            .brush = QU_BRUSH_SPRITE,
+            .vertex_format = QU_VERTEX_FORMAT_SPRITE,
+            .render_mode = QU_RENDER_MODE_TRIANGLE_STRIP,
+            .first_vertex = first_instance,
+            .total_vertices = total_visible,
+            .instanced = true,
         },
     });
 }
 
+void qu_draw_sprites(qu_texture texture, qu_sprite const *sprites, int count)
+{
+    qu_texture_obj *texture_p = qu_handle_list_get(priv.textures, texture.id);
+
+    if (!texture_p || texture_p->loading || count <= 0) {
+        return;
+    }
+
+    int px = 0;
+    int py = 0;
+
+    texture_p = graphics__get_texture_page(texture_p, &px, &py);
+
+    if (priv.renderer_features & QU_RENDERER_FEATURE_BIT_INSTANCING) {
+        if (!priv.cpu_transforms || graphics__is_translation(graphics__get_modelview(graphics__get_recorder()->target_surface))) {
+            graphics__draw_sprites_instanced(texture_p, px, py, sprites, count);
+            return;
+        }
+    }
+
+    float tw = 1.f / texture_p->width;
+    float th = 1.f / texture_p->height;
+
+    for (int i = 0; i < count; i += QU__MAX_QUADS_PER_DRAW) {
+        int total_sprites = QU_MIN(count - i, QU__MAX_QUADS_PER_DRAW);
+
+        unsigned int first_vertex;
+        float *data = graphics__reserve_vertex_data(QU_VERTEX_FORMAT_5XYCST, 20 * total_sprites, &first_vertex);
+        float *v = data;
+        int total_visible = 0;
+
+        for (int j = 0; j < total_sprites; j++) {
+            qu_sprite const *sprite = &sprites[i + j];
+
+            if (graphics__cull_sprite(sprite)) {
+                continue;
+            }
+
+            float s0 = (px + sprite->rx) * tw;
+            float t0 = (py + sprite->ry) * th;
+            float s1 = (px + sprite->rx + sprite->rw) * tw;
+            float t1 = (py + sprite->ry + sprite->rh) * th;
+
+            float ax = -sprite->ox;
+            float ay = -sprite->oy;
+            float bx = ax + sprite->w;
+            float by = ay + sprite->h;
+
+            if (sprite->rot == 0.f) {
+                v[0] = sprite->x + ax;  v[1] = sprite->y + ay;  v[3] = s0;  v[4] = t0;
+                v[5] = sprite->x + bx;  v[6] = sprite->y + ay;  v[8] = s1;  v[9] = t0;
+                v[10] = sprite->x + bx; v[11] = sprite->y + by; v[13] = s1; v[14] = t1;
+                v[15] = sprite->x + ax; v[16] = sprite->y + by; v[18] = s0; v[19] = t1;
+            } else {
+                float angle = QU_DEG2RAD(sprite->rot);
+                float c = cosf(angle);
+                float d = sinf(angle);
+
+                v[0] = sprite->x + ax * c - ay * d;     v[1] = sprite->y + ax * d + ay * c;
+                v[5] = sprite->x + bx * c - ay * d;     v[6] = sprite->y + bx * d + ay * c;
+                v[10] = sprite->x + bx * c - by * d;    v[11] = sprite->y + bx * d + by * c;
+                v[15] = sprite->x + ax * c - by * d;    v[16] = sprite->y + ax * d + by * c;
+
+                v[3] = s0;  v[4] = t0;
+                v[8] = s1;  v[9] = t0;
+                v[13] = s1; v[14] = t1;
+                v[18] = s0; v[19] = t1;
+            }
+
+            graphics__set_vertex_color(v, 4, sprite->color);
+
+            v += 20;
+            total_visible++;
+        }
+
+        graphics__release_vertex_data(QU_VERTEX_FORMAT_5XYCST, 20 * (total_sprites - total_visible));
+
+        if (total_visible == 0) {
+            continue;
+        }
+
+        graphics__transform_vertex_data(QU_VERTEX_FORMAT_5XYCST, data, 20 * total_visible);
+
+        graphics__append_render_command(&(struct qu__render_command_info) {
+            .command = QU__RENDER_COMMAND_DRAW,
+            .args.draw = {
+                .texture = texture_p,
+                .color = QU_COLOR(255, 255, 255),
+                .brush = QU_BRUSH_TEXTURED,
+                .vertex_format = QU_VERTEX_FORMAT_5XYCST,
+                .render_mode = QU_RENDER_MODE_TRIANGLES,
+                .first_vertex = first_vertex,
+                .total_vertices = 4 * total_visible,
+                .indexed = true,
+            },
+        });
+    }
+}
+
+void qu_draw_font(qu_texture texture, qu_color color, float const *data, int count)
+{
+    qu_texture_obj *texture_p = qu_handle_list_get(priv.textures, texture.id);
+
+    if (!texture_p || count <= 0 || graphics__cull_vertices(data, count, 4)) {
+        return;
+    }
+
+    // Each glyph is a quad of 4 vertices.
+    for (int i = 0; i < count; i += 4 * QU__MAX_QUADS_PER_DRAW) {
+        int total_vertices = QU_MIN(count - i, 4 * QU__MAX_QUADS_PER_DRAW);
+
+        graphics__append_render_command(&(struct qu__render_command_info) {
+            .command = QU__RENDER_COMMAND_DRAW,
+            .args.draw = {
+                .texture = texture_p,
+                .color = color,
+                .brush = QU_BRUSH_TEXTURED,
+                .vertex_format = QU_VERTEX_FORMAT_4XYST,
+                .render_mode = QU_RENDER_MODE_TRIANGLES,
+                .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_4XYST,
+                                                             data + 4 * i, 4 * total_vertices),
+                .total_vertices = total_vertices,
+                .indexed = true,
+            },
+        });
+    }
+}
+
 qu_surface qu_create_surface(int width, int height)
 {
-    qu_surface_obj surface = {
-        .texture = {
-            .width = width,
-            .height = height,
-        },
-    };
+    return graphics__create_surface(width, height, 1);
+}
+
+qu_surface qu_create_transient_surface(int width, int height, int antialiasing_level)
+{
+    struct qu__surface_pool *pool = &priv.surface_pool;
+    qu_surface surface = graphics__create_surface(width, height, antialiasing_level);
 
-    qu_mat4_ortho(&surface.projection, 0.f, width, height, 0.f);
-    qu_mat4_identity(&surface.modelview[0]);
+    if (!surface.id) {
+        return surface;
+    }
 
-    priv.renderer->create_surface(&surface);
+    if (pool->total_transient_surfaces == pool->transient_surfaces_capacity) {
+        int next_capacity = QU_MAX(16, 2 * pool->transient_surfaces_capacity);
+        int32_t *next_data = pl_realloc(pool->transient_surfaces, sizeof(int32_t) * next_capacity);
 
-    return (qu_surface) {
-        .id = qu_handle_list_add(priv.surfaces, &surface),
-    };
+        QU_HALT_IF(!next_data);
+
+        pool->transient_surfaces = next_data;
+        pool->transient_surfaces_capacity = next_capacity;
+    }
+
+    pool->transient_surfaces[pool->total_transient_surfaces++] = surface.id;
+
+    return surface;
 }
 
 void qu_delete_surface(qu_surface surface)
 {
+    qu_surface_obj *surface_p = graphics__get_surface(surface.id);
+
+    if (surface_p == priv.recorder.target_surface) {
+        priv.recorder.target_surface = priv.canvas_enabled ? &priv.canvas : &priv.display;
+    }
+
+    if (surface_p == priv.culling.surface) {
+        priv.culling.surface = priv.canvas_enabled ? &priv.canvas : &priv.display;
+    }
+
     qu_handle_list_remove(priv.surfaces, surface.id);
 }
 
 void qu_set_surface_smooth(qu_surface surface, bool smooth)
 {
-    qu_surface_obj *surface_p = qu_handle_list_get(priv.surfaces, surface.id);
+    qu_surface_obj *surface_p = graphics__get_surface(surface.id);
 
     if (surface_p) {
         priv.renderer->set_texture_smooth(&surface_p->texture, smooth);
+        surface_p->texture.smooth = smooth;
     }
 }
 
 void qu_set_surface_antialiasing_level(qu_surface surface, int level)
 {
-    qu_surface_obj *surface_p = qu_handle_list_get(priv.surfaces, surface.id);
+    qu_surface_obj *surface_p = graphics__get_surface(surface.id);
 
     if (surface_p) {
         priv.renderer->set_surface_antialiasing_level(surface_p, level);
@@ -1524,7 +6026,7 @@ void qu_set_surface_antialiasing_level(qu_surface surface, int level)
 
 void qu_set_surface(qu_surface surface)
 {
-    qu_surface_obj *surface_p = qu_handle_list_get(priv.surfaces, surface.id);
+    qu_surface_obj *surface_p = graphics__get_surface(surface.id);
 
     if (!surface_p) {
         return;
@@ -1534,41 +6036,132 @@ void qu_set_surface(qu_surface surface)
         .command = QU__RENDER_COMMAND_SET_SURFACE,
         .args.surface.surface = surface_p,
     });
+
+    // Draw contexts keep their own modelview stack.
+    if (!thread_draw_context) {
+        priv.recorder.target_surface = surface_p;
+    }
 }
 
 void qu_reset_surface(void)
 {
+    qu_surface_obj *surface_p = priv.canvas_enabled ? &priv.canvas : &priv.display;
+
     graphics__append_render_command(&(struct qu__render_command_info) {
         .command = QU__RENDER_COMMAND_SET_SURFACE,
-        .args.surface.surface = priv.canvas_enabled ? &priv.canvas : &priv.display,
+        .args.surface.surface = surface_p,
     });
+
+    // Draw contexts keep their own modelview stack.
+    if (!thread_draw_context) {
+        priv.recorder.target_surface = surface_p;
+    }
 }
 
 void qu_draw_surface(qu_surface surface, float x, float y, float w, float h)
 {
-    qu_surface_obj *surface_p = qu_handle_list_get(priv.surfaces, surface.id);
+    qu_surface_obj *surface_p = graphics__get_surface(surface.id);
 
-    if (!surface_p) {
+    if (!surface_p || graphics__cull_rect(x, y, x + w, y + h)) {
         return;
     }
 
-    float const vertices[] = {
-        x,      y,      0.f,    0.f,
-        x + w,  y,      1.f,    0.f,
-        x + w,  y + h,  1.f,    1.f,
-        x,      y + h,  0.f,    1.f,
+    float vertices[] = {
+        x,      y,      0.f,    0.f,    0.f,
+        x + w,  y,      0.f,    1.f,    0.f,
+        x + w,  y + h,  0.f,    1.f,    1.f,
+        x,      y + h,  0.f,    0.f,    1.f,
     };
 
+    graphics__set_vertex_color(vertices, 4, QU_COLOR(255, 255, 255));
+
     graphics__append_render_command(&(struct qu__render_command_info) {
         .command = QU__RENDER_COMMAND_DRAW,
         .args.draw = {
             .texture = &surface_p->texture,
             .color = QU_COLOR(255, 255, 255),
             .brush = QU_BRUSH_TEXTURED,
-            .vertex_format = QU_VERTEX_FORMAT_4XYST,
-            .render_mode = QU_RENDER_MODE_TRIANGLE_FAN,
-            .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_4XYST, vertices, 16),
+            .vertex_format = QU_VERTEX_FORMAT_5XYCST,
+            .render_mode = QU_RENDER_MODE_TRIANGLES,
+            .first_vertex = graphics__append_vertex_data(QU_VERTEX_FORMAT_5XYCST, vertices, 20),
             .total_vertices = 4,
+            .indexed = true,
         },
     });
 }
+
+double qu_get_surface_gpu_time(qu_surface surface)
+{
+    return graphics__get_gpu_time(surface.id);
+}
+
+double qu_get_canvas_gpu_time(void)
+{
+    return graphics__get_gpu_time(QU__CANVAS_SURFACE_ID);
+}
+
+double qu_get_display_gpu_time(void)
+{
+    return graphics__get_gpu_time(0);
+}
+
+qu_draw_context qu_create_draw_context(void)
+{
+    struct qu__draw_context *context = pl_calloc(1, sizeof(*context));
+
+    if (!context) {
+        return (qu_draw_context) { .id = 0 };
+    }
+
+    graphics__initialize_recorder(&context->recorder, &context->transform);
+
+    return (qu_draw_context) {
+        .id = qu_handle_list_add(priv.draw_contexts, &context),
+    };
+}
+
+void qu_delete_draw_context(qu_draw_context context)
+{
+    qu_handle_list_remove(priv.draw_contexts, context.id);
+}
+
+void qu_begin_draw_context(qu_draw_context context)
+{
+    struct qu__draw_context **context_p = qu_handle_list_get(priv.draw_contexts, context.id);
+
+    if (!context_p) {
+        return;
+    }
+
+    struct qu__recorder *recorder = &(*context_p)->recorder;
+
+    recorder->command_buffer.size = 0;
+
+    for (int i = 0; i < QU_TOTAL_VERTEX_FORMATS; i++) {
+        recorder->vertex_buffers[i].size = 0;
+    }
+
+    recorder->sort_draws = false;
+    recorder->draw_layer = 0;
+
+    qu_mat4_identity(&(*context_p)->transform.modelview[0]);
+    (*context_p)->transform.modelview_index = 0;
+
+    thread_draw_context = *context_p;
+}
+
+void qu_end_draw_context(void)
+{
+    thread_draw_context = NULL;
+}
+
+void qu_submit_draw_context(qu_draw_context context)
+{
+    struct qu__draw_context **context_p = qu_handle_list_get(priv.draw_contexts, context.id);
+
+    if (!context_p || *context_p == thread_draw_context) {
+        return;
+    }
+
+    graphics__submit_recorder(&(*context_p)->recorder);
+}
@@ -26,6 +26,7 @@
 //------------------------------------------------------------------------------
 
 #include "qu_math.h"
+#include "qu_resource_loader.h"
 
 //------------------------------------------------------------------------------
 
@@ -46,6 +47,9 @@ typedef enum qu_vertex_attribute
     QU_VERTEX_ATTRIBUTE_POSITION,
     QU_VERTEX_ATTRIBUTE_COLOR,
     QU_VERTEX_ATTRIBUTE_TEXCOORD,
+    QU_VERTEX_ATTRIBUTE_SPRITE_RECT, // x, y, w, h
+    QU_VERTEX_ATTRIBUTE_SPRITE_ORIGIN, // ox, oy, rotation (in degrees)
+    QU_VERTEX_ATTRIBUTE_SPRITE_TEXRECT, // rx, ry, rw, rh (in texels)
     QU_TOTAL_VERTEX_ATTRIBUTES,
 } qu_vertex_attribute;
 
@@ -54,12 +58,17 @@ typedef enum qu_vertex_attribute_bits
     QU_VERTEX_ATTRIBUTE_BIT_POSITION = (1 << QU_VERTEX_ATTRIBUTE_POSITION),
     QU_VERTEX_ATTRIBUTE_BIT_COLOR = (1 << QU_VERTEX_ATTRIBUTE_COLOR),
     QU_VERTEX_ATTRIBUTE_BIT_TEXCOORD = (1 << QU_VERTEX_ATTRIBUTE_TEXCOORD),
+    QU_VERTEX_ATTRIBUTE_BIT_SPRITE_RECT = (1 << QU_VERTEX_ATTRIBUTE_SPRITE_RECT),
+    QU_VERTEX_ATTRIBUTE_BIT_SPRITE_ORIGIN = (1 << QU_VERTEX_ATTRIBUTE_SPRITE_ORIGIN),
+    QU_VERTEX_ATTRIBUTE_BIT_SPRITE_TEXRECT = (1 << QU_VERTEX_ATTRIBUTE_SPRITE_TEXRECT),
 } qu_vertex_attribute_bits;
 
 typedef enum qu_vertex_format
 {
     QU_VERTEX_FORMAT_2XY,
     QU_VERTEX_FORMAT_4XYST,
+    QU_VERTEX_FORMAT_5XYCST, // color is packed to RGBA8 and takes one slot
+    QU_VERTEX_FORMAT_SPRITE, // per-instance sprite data (instancing only)
     QU_TOTAL_VERTEX_FORMATS,
 } qu_vertex_format;
 
@@ -69,9 +78,29 @@ typedef enum qu_brush
     QU_BRUSH_SOLID, // single color
     QU_BRUSH_TEXTURED, // textured
     QU_BRUSH_FONT,
+    QU_BRUSH_SPRITE, // instanced textured quads (instancing only)
     QU_TOTAL_BRUSHES,
 } qu_brush;
 
+typedef enum qu_renderer_feature_bits
+{
+    QU_RENDERER_FEATURE_BIT_INSTANCING = (1 << 0),
+    QU_RENDERER_FEATURE_BIT_BC1 = (1 << 1),
+    QU_RENDERER_FEATURE_BIT_BC3 = (1 << 2),
+    QU_RENDERER_FEATURE_BIT_BC7 = (1 << 3),
+    QU_RENDERER_FEATURE_BIT_GPU_TIMERS = (1 << 4),
+} qu_renderer_feature_bits;
+
+#define QU_MAX_DIRTY_RECTS 4
+
+typedef struct qu_dirty_rect
+{
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+} qu_dirty_rect;
+
 typedef struct qu_texture_obj
 {
     int width;
@@ -80,6 +109,33 @@ typedef struct qu_texture_obj
     unsigned char *pixels;
     uintptr_t priv[4];
     bool smooth;
+    bool mipmaps;
+
+    // Compressed textures keep blocks in place of pixels
+    // and can't be updated.
+    qu_image_compression compression;
+
+    // Textures placed into atlas have no pixels of their own
+    // and are drawn from the page texture at given offset.
+    int32_t atlas_page;
+    int atlas_x;
+    int atlas_y;
+
+    // Modified regions which are uploaded before the next flush.
+    qu_dirty_rect dirty_rects[QU_MAX_DIRTY_RECTS];
+    int total_dirty_rects;
+
+    // GPU-only textures have no pixels after upload and are decoded
+    // again from their source when graphics context is restored.
+    char *source_path;
+    void const *source_buffer;
+    size_t source_size;
+
+    // Asynchronously loaded textures can't be drawn until uploaded.
+    bool loading;
+
+    // Identifies the texture (or surface) in frame capture.
+    uint32_t capture_id;
 } qu_texture_obj;
 
 typedef struct qu_surface_obj
@@ -90,18 +146,43 @@ typedef struct qu_surface_obj
     qu_mat4 modelview[32];
     int modelview_index;
 
+    // Same as above, but updated as commands are recorded rather than
+    // executed. Used to cull draws which are outside of the view.
+    qu_mat4 recorded_projection;
+    qu_mat4 recorded_modelview[32];
+    int recorded_modelview_index;
+
     int sample_count;
 
+    // Handle of the surface, zero for display.
+    int32_t id;
+
     uintptr_t priv[4];
 } qu_surface_obj;
 
+#define QU_MAX_GPU_TIMERS 64
+
+typedef struct qu_gpu_timer
+{
+    int32_t surface_id;
+    double time;
+} qu_gpu_timer;
+
+typedef struct qu_gpu_timings
+{
+    int total_timers;
+    qu_gpu_timer timers[QU_MAX_GPU_TIMERS];
+} qu_gpu_timings;
+
 typedef struct qu_renderer_impl
 {
     bool (*query)(void);
     void (*initialize)(void);
     void (*terminate)(void);
+    unsigned int (*query_features)(void);
 
     void (*upload_vertex_data)(qu_vertex_format vertex_format, float const *data, size_t size);
+    void (*upload_index_data)(uint16_t const *data, size_t size);
 
     void (*apply_projection)(qu_mat4 const *projection);
     void (*apply_transform)(qu_mat4 const *transform);
@@ -116,14 +197,26 @@ typedef struct qu_renderer_impl
     void (*exec_resize)(int width, int height);
     void (*exec_clear)(void);
     void (*exec_draw)(qu_render_mode render_mode, unsigned int first_vertex, unsigned int total_vertices);
+    void (*exec_draw_indexed)(qu_render_mode render_mode, unsigned int first_vertex,
+                              unsigned int first_index, unsigned int total_indices);
+    void (*exec_draw_instanced)(qu_render_mode render_mode, unsigned int total_vertices,
+                                unsigned int first_instance, unsigned int total_instances);
 
     void (*load_texture)(qu_texture_obj *texture);
+    // Region is read from `pixels` if they are given (tightly packed),
+    // otherwise from the pixel array of the texture.
+    void (*update_texture_region)(qu_texture_obj *texture, int x, int y, int w, int h,
+                                  unsigned char const *pixels);
     void (*unload_texture)(qu_texture_obj *texture);
     void (*set_texture_smooth)(qu_texture_obj *texture, bool smooth);
+    void (*set_texture_mipmaps)(qu_texture_obj *texture, bool mipmaps);
 
     void (*create_surface)(qu_surface_obj *surface);
     void (*destroy_surface)(qu_surface_obj *surface);
     void (*set_surface_antialiasing_level)(qu_surface_obj *surface, int level);
+
+    void (*enable_gpu_timers)(void);
+    bool (*end_gpu_frame)(qu_gpu_timings *timings);
 } qu_renderer_impl;
 
 //------------------------------------------------------------------------------
@@ -138,6 +231,7 @@ extern qu_renderer_impl const qu_null_renderer_impl;
 void qu_initialize_graphics(void);
 void qu_terminate_graphics(void);
 void qu_flush_graphics(void);
+void qu_present_graphics(void);
 void qu_event_context_lost(void);
 void qu_event_context_restored(void);
 void qu_event_window_resize(int width, int height);
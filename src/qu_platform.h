@@ -31,6 +31,7 @@
 
 typedef struct pl_thread pl_thread;
 typedef struct pl_mutex pl_mutex;
+typedef struct pl_cond pl_cond;
 
 //------------------------------------------------------------------------------
 
@@ -39,6 +40,10 @@ void *pl_calloc(size_t count, size_t size);
 void *pl_realloc(void *data, size_t size);
 void pl_free(void *data);
 
+#ifdef QU_ALLOCATION_COUNTER
+uint64_t pl_get_allocation_count(void);
+#endif
+
 uint32_t pl_get_ticks_mediump(void);
 uint64_t pl_get_ticks_highp(void);
 
@@ -51,6 +56,11 @@ void pl_destroy_mutex(pl_mutex *mutex);
 void pl_lock_mutex(pl_mutex *mutex);
 void pl_unlock_mutex(pl_mutex *mutex);
 
+pl_cond *pl_create_cond(void);
+void pl_destroy_cond(pl_cond *cond);
+void pl_wait_cond(pl_cond *cond, pl_mutex *mutex);
+void pl_broadcast_cond(pl_cond *cond);
+
 void pl_sleep(double seconds);
 
 void *pl_open_dll(char const *path);
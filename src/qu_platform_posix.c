@@ -45,6 +45,9 @@ struct pl_thread
     char name[THREAD_NAME_LENGTH];
     intptr_t (*func)(void *);
     void *arg;
+    pthread_mutex_t lock;
+    bool detached;
+    bool finished;
 };
 
 struct pl_mutex
@@ -52,20 +55,42 @@ struct pl_mutex
     pthread_mutex_t id;
 };
 
+struct pl_cond
+{
+    pthread_cond_t id;
+};
+
 //------------------------------------------------------------------------------
 
+#ifdef QU_ALLOCATION_COUNTER
+
+// Total number of allocations, for benchmarks.
+static uint64_t allocation_count;
+
+#define COUNT_ALLOCATION() \
+    __atomic_add_fetch(&allocation_count, 1, __ATOMIC_RELAXED)
+
+#else
+
+#define COUNT_ALLOCATION()
+
+#endif
+
 void *pl_malloc(size_t size)
 {
+    COUNT_ALLOCATION();
     return malloc(size);
 }
 
 void *pl_calloc(size_t count, size_t size)
 {
+    COUNT_ALLOCATION();
     return calloc(count, size);
 }
 
 void *pl_realloc(void *data, size_t size)
 {
+    COUNT_ALLOCATION();
     return realloc(data, size);
 }
 
@@ -74,6 +99,15 @@ void pl_free(void *data)
     free(data);
 }
 
+#ifdef QU_ALLOCATION_COUNTER
+
+uint64_t pl_get_allocation_count(void)
+{
+    return __atomic_load_n(&allocation_count, __ATOMIC_RELAXED);
+}
+
+#endif
+
 //------------------------------------------------------------------------------
 // Clock
 
@@ -96,11 +130,27 @@ uint64_t pl_get_ticks_highp(void)
 //------------------------------------------------------------------------------
 // Threads
 
+static void thread_free(pl_thread *thread)
+{
+    pthread_mutex_destroy(&thread->lock);
+    pl_free(thread);
+}
+
+// Info struct of joinable thread is freed in pl_wait_thread(),
+// detached thread frees it by itself.
 static void *thread_main(void *thread_ptr)
 {
     pl_thread *thread = thread_ptr;
     intptr_t retval = thread->func(thread->arg);
-    pl_free(thread);
+
+    pthread_mutex_lock(&thread->lock);
+    bool detached = thread->detached;
+    thread->finished = true;
+    pthread_mutex_unlock(&thread->lock);
+
+    if (detached) {
+        thread_free(thread);
+    }
 
     return (void *) retval;
 }
@@ -123,11 +173,13 @@ pl_thread *pl_create_thread(char const *name, intptr_t (*func)(void *), void *ar
     thread->func = func;
     thread->arg = arg;
 
+    pthread_mutex_init(&thread->lock, NULL);
+
     int error = pthread_create(&thread->id, NULL, thread_main, thread);
 
     if (error) {
         QU_LOGE("Error (code %d) occured while attempting to create thread \'%s\'.\n", error, thread->name);
-        pl_free(thread);
+        thread_free(thread);
 
         return NULL;
     }
@@ -146,6 +198,15 @@ void pl_detach_thread(pl_thread *thread)
     if (error) {
         QU_LOGE("Failed to detach thread \'%s\', error code: %d.\n", thread->name, error);
     }
+
+    pthread_mutex_lock(&thread->lock);
+    bool finished = thread->finished;
+    thread->detached = true;
+    pthread_mutex_unlock(&thread->lock);
+
+    if (finished) {
+        thread_free(thread);
+    }
 }
 
 intptr_t pl_wait_thread(pl_thread *thread)
@@ -157,6 +218,8 @@ intptr_t pl_wait_thread(pl_thread *thread)
         QU_LOGE("Failed to join thread \'%s\', error code: %d.\n", thread->name, error);
     }
 
+    thread_free(thread);
+
     return (intptr_t) retval;
 }
 
@@ -203,6 +266,50 @@ void pl_unlock_mutex(pl_mutex *mutex)
     pthread_mutex_unlock(&mutex->id);
 }
 
+pl_cond *pl_create_cond(void)
+{
+    pl_cond *cond = pl_calloc(1, sizeof(pl_cond));
+
+    if (!cond) {
+        return NULL;
+    }
+
+    int error = pthread_cond_init(&cond->id, NULL);
+
+    if (error) {
+        QU_LOGE("Failed to create condition variable, error code: %d.\n", error);
+        pl_free(cond);
+        return NULL;
+    }
+
+    return cond;
+}
+
+void pl_destroy_cond(pl_cond *cond)
+{
+    if (!cond) {
+        return;
+    }
+
+    int error = pthread_cond_destroy(&cond->id);
+
+    if (error) {
+        QU_LOGE("Failed to destroy condition variable, error code: %d.\n", error);
+    }
+
+    pl_free(cond);
+}
+
+void pl_wait_cond(pl_cond *cond, pl_mutex *mutex)
+{
+    pthread_cond_wait(&cond->id, &mutex->id);
+}
+
+void pl_broadcast_cond(pl_cond *cond)
+{
+    pthread_cond_broadcast(&cond->id);
+}
+
 void pl_sleep(double seconds)
 {
     uint64_t s = (uint64_t) floor(seconds);
@@ -58,20 +58,46 @@ struct pl_mutex
     CRITICAL_SECTION cs;
 };
 
+struct pl_cond
+{
+    CONDITION_VARIABLE cv;
+};
+
 //------------------------------------------------------------------------------
 
+#ifdef QU_ALLOCATION_COUNTER
+
+// Total number of allocations, for benchmarks.
+static LONG64 volatile allocation_count;
+
+#define COUNT_ALLOCATION() \
+    InterlockedIncrement64(&allocation_count)
+
+#else
+
+#define COUNT_ALLOCATION()
+
+#endif
+
 void *pl_malloc(size_t size)
 {
+    COUNT_ALLOCATION();
     return HeapAlloc(GetProcessHeap(), 0, size);
 }
 
 void *pl_calloc(size_t count, size_t size)
 {
-    return HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, size);
+    if (size && count > SIZE_MAX / size) {
+        return NULL;
+    }
+
+    COUNT_ALLOCATION();
+    return HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, count * size);
 }
 
 void *pl_realloc(void *data, size_t size)
 {
+    COUNT_ALLOCATION();
     return HeapReAlloc(GetProcessHeap(), 0, data, size);
 }
 
@@ -80,6 +106,15 @@ void pl_free(void *data)
     HeapFree(GetProcessHeap(), 0, data);
 }
 
+#ifdef QU_ALLOCATION_COUNTER
+
+uint64_t pl_get_allocation_count(void)
+{
+    return (uint64_t) InterlockedCompareExchange64(&allocation_count, 0, 0);
+}
+
+#endif
+
 //------------------------------------------------------------------------------
 // Clock
 
@@ -229,6 +264,34 @@ void pl_unlock_mutex(pl_mutex *mutex)
     LeaveCriticalSection(&mutex->cs);
 }
 
+pl_cond *pl_create_cond(void)
+{
+    pl_cond *cond = pl_calloc(1, sizeof(*cond));
+
+    if (!cond) {
+        return NULL;
+    }
+
+    InitializeConditionVariable(&cond->cv);
+
+    return cond;
+}
+
+void pl_destroy_cond(pl_cond *cond)
+{
+    pl_free(cond);
+}
+
+void pl_wait_cond(pl_cond *cond, pl_mutex *mutex)
+{
+    SleepConditionVariableCS(&cond->cv, &mutex->cs, INFINITE);
+}
+
+void pl_broadcast_cond(pl_cond *cond)
+{
+    WakeAllConditionVariable(&cond->cv);
+}
+
 void pl_sleep(double seconds)
 {
     DWORD milliseconds = (DWORD) (seconds * 1000);
@@ -121,6 +121,9 @@ struct vertex_attribute_desc
 {
     char const *name;
     unsigned int size;
+    GLenum type;
+    GLboolean normalized;
+    unsigned int bytes;
 };
 
 struct vertex_format_desc
@@ -159,10 +162,11 @@ static struct shader_desc const shader_desc[TOTAL_SHADERS] = {
         .src = {
             "#version 100\n"
             "precision mediump float;\n"
+            "varying vec4 v_color;\n"
             "uniform vec4 u_color;\n"
             "void main()\n"
             "{\n"
-            "    gl_FragColor = u_color;\n"
+            "    gl_FragColor = u_color * v_color;\n"
             "}\n"
         },
     },
@@ -172,12 +176,13 @@ static struct shader_desc const shader_desc[TOTAL_SHADERS] = {
         .src = {
             "#version 100\n"
             "precision mediump float;\n"
+            "varying vec4 v_color;\n"
             "varying vec2 v_texCoord;\n"
             "uniform sampler2D u_texture;\n"
             "uniform vec4 u_color;\n"
             "void main()\n"
             "{\n"
-            "    gl_FragColor = texture2D(u_texture, v_texCoord) * u_color;\n"
+            "    gl_FragColor = texture2D(u_texture, v_texCoord) * u_color * v_color;\n"
             "}\n"
         },
     },
@@ -187,13 +192,14 @@ static struct shader_desc const shader_desc[TOTAL_SHADERS] = {
         .src = {
             "#version 100\n"
             "precision mediump float;\n"
+            "varying vec4 v_color;\n"
             "varying vec2 v_texCoord;\n"
             "uniform sampler2D u_texture;\n"
             "uniform vec4 u_color;\n"
             "void main()\n"
             "{\n"
             "    float alpha = texture2D(u_texture, v_texCoord).r;\n"
-            "    gl_FragColor = vec4(u_color.rgb, alpha);\n"
+            "    gl_FragColor = vec4(u_color.rgb * v_color.rgb, alpha * v_color.a);\n"
             "}\n"
         },
     },
@@ -224,9 +230,27 @@ static char const *uniform_names[TOTAL_UNIFORMS] = {
 };
 
 static struct vertex_attribute_desc const vertex_attribute_desc[QU_TOTAL_VERTEX_ATTRIBUTES] = {
-    [QU_VERTEX_ATTRIBUTE_POSITION] = { .name = "a_position", .size = 2 },
-    [QU_VERTEX_ATTRIBUTE_COLOR] = { .name = "a_color", .size = 4 },
-    [QU_VERTEX_ATTRIBUTE_TEXCOORD] = {.name = "a_texCoord", .size = 2 },
+    [QU_VERTEX_ATTRIBUTE_POSITION] = {
+        .name = "a_position",
+        .size = 2,
+        .type = GL_FLOAT,
+        .normalized = GL_FALSE,
+        .bytes = 2 * sizeof(GLfloat),
+    },
+    [QU_VERTEX_ATTRIBUTE_COLOR] = {
+        .name = "a_color",
+        .size = 4,
+        .type = GL_UNSIGNED_BYTE,
+        .normalized = GL_TRUE,
+        .bytes = 4 * sizeof(GLubyte),
+    },
+    [QU_VERTEX_ATTRIBUTE_TEXCOORD] = {
+        .name = "a_texCoord",
+        .size = 2,
+        .type = GL_FLOAT,
+        .normalized = GL_FALSE,
+        .bytes = 2 * sizeof(GLfloat),
+    },
 };
 
 static struct vertex_format_desc const vertex_format_desc[QU_TOTAL_VERTEX_FORMATS] = {
@@ -238,6 +262,12 @@ static struct vertex_format_desc const vertex_format_desc[QU_TOTAL_VERTEX_FORMAT
         .attributes = QU_VERTEX_ATTRIBUTE_BIT_POSITION | QU_VERTEX_ATTRIBUTE_BIT_TEXCOORD,
         .stride = 4,
     },
+    [QU_VERTEX_FORMAT_5XYCST] = {
+        .attributes = QU_VERTEX_ATTRIBUTE_BIT_POSITION
+                    | QU_VERTEX_ATTRIBUTE_BIT_COLOR
+                    | QU_VERTEX_ATTRIBUTE_BIT_TEXCOORD,
+        .stride = 5,
+    },
 };
 
 //------------------------------------------------------------------------------
@@ -259,6 +289,24 @@ static GLenum const texture_format_map[4] = {
     GL_RGBA,
 };
 
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM_EXT
+#define GL_COMPRESSED_RGBA_BPTC_UNORM_EXT 0x8E8C
+#endif
+
+static GLenum const compressed_format_map[QU_TOTAL_IMAGE_COMPRESSIONS] = {
+    [QU_IMAGE_COMPRESSION_BC1] = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
+    [QU_IMAGE_COMPRESSION_BC3] = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+    [QU_IMAGE_COMPRESSION_BC7] = GL_COMPRESSED_RGBA_BPTC_UNORM_EXT,
+};
+
 static GLenum const blend_factor_map[10] = {
     GL_ZERO,
     GL_ONE,
@@ -287,11 +335,20 @@ struct program_info
     unsigned int dirty_uniforms;
 };
 
+// Vertex buffers are used as rings: each upload is written after
+// the previous one. When the end is reached, buffer storage is orphaned,
+// since ES 2.0 has neither fences nor unsynchronized mapping.
+#define STREAM_FRAMES           3
+
 struct vertex_format_info
 {
     GLuint array;
     GLuint buffer;
-    GLuint buffer_size;
+    GLsizeiptr buffer_size;
+    unsigned int base_vertex;
+
+    GLintptr stream_offset;
+    unsigned int stream_base;
 };
 
 struct priv
@@ -302,11 +359,20 @@ struct priv
 
     struct program_info programs[QU_TOTAL_BRUSHES];
     struct vertex_format_info vertex_formats[QU_TOTAL_VERTEX_FORMATS];
+    qu_vertex_format vertex_format;
+    GLuint index_buffer;
 
     qu_mat4 projection;
     qu_mat4 modelview;
     GLfloat color[4];
 
+    // GL_UNPACK_ROW_LENGTH is not available, so texture
+    // regions are copied here before uploading.
+    unsigned char *region_buffer;
+    size_t region_buffer_size;
+
+    unsigned int features;
+
     void (*vertex_format_initialize)(qu_vertex_format);
     void (*vertex_format_terminate)(qu_vertex_format);
     void (*vertex_format_update)(qu_vertex_format);
@@ -388,7 +454,10 @@ static GLuint build_program(char const *name, GLuint vs, GLuint fs)
     CHECK_GL(glAttachShader(program, fs));
 
     for (int j = 0; j < QU_TOTAL_VERTEX_ATTRIBUTES; j++) {
-        CHECK_GL(glBindAttribLocation(program, j, vertex_attribute_desc[j].name));
+        // Sprite attributes are only used for instancing.
+        if (vertex_attribute_desc[j].name) {
+            CHECK_GL(glBindAttribLocation(program, j, vertex_attribute_desc[j].name));
+        }
     }
 
     CHECK_GL(glLinkProgram(program));
@@ -433,6 +502,31 @@ static void update_uniforms(void)
     info->dirty_uniforms = 0;
 }
 
+// OpenGL ES 2.0 can't draw elements with base vertex,
+// so attribute pointers are offset to the first vertex instead.
+static void vertex_format_set_base(qu_vertex_format format, unsigned int base_vertex)
+{
+    struct vertex_format_info *info = &priv.vertex_formats[format];
+    struct vertex_format_desc const *desc = &vertex_format_desc[format];
+
+    CHECK_GL(glBindBuffer(GL_ARRAY_BUFFER, info->buffer));
+
+    GLsizei stride = sizeof(float) * desc->stride;
+    unsigned int offset = stride * base_vertex;
+
+    for (int i = 0; i < QU_TOTAL_VERTEX_ATTRIBUTES; i++) {
+        if (desc->attributes & (1 << i)) {
+            struct vertex_attribute_desc const *attribute = &vertex_attribute_desc[i];
+
+            CHECK_GL(glVertexAttribPointer(i, attribute->size, attribute->type, attribute->normalized,
+                                           stride, (void *) (intptr_t) offset));
+            offset += attribute->bytes;
+        }
+    }
+
+    info->base_vertex = base_vertex;
+}
+
 static void vertex_format_initialize(qu_vertex_format format)
 {
 }
@@ -447,23 +541,17 @@ static void vertex_format_update(qu_vertex_format format)
 
 static void vertex_format_apply(qu_vertex_format format)
 {
-    struct vertex_format_info *info = &priv.vertex_formats[format];
     struct vertex_format_desc const *desc = &vertex_format_desc[format];
 
-    unsigned int offset = 0;
-
     for (int i = 0; i < QU_TOTAL_VERTEX_ATTRIBUTES; i++) {
         if (desc->attributes & (1 << i)) {
-            GLsizei size = vertex_attribute_desc[i].size;
-            GLsizei stride = sizeof(float) * desc->stride;
-
             CHECK_GL(glEnableVertexAttribArray(i));
-            CHECK_GL(glVertexAttribPointer(i, size, GL_FLOAT, GL_FALSE, stride, (void *) (intptr_t) offset));
-            offset += sizeof(float) * size;
         } else {
             CHECK_GL(glDisableVertexAttribArray(i));
         }
     }
+
+    vertex_format_set_base(format, 0);
 }
 
 static void vao_vertex_format_initialize(qu_vertex_format format)
@@ -473,6 +561,7 @@ static void vao_vertex_format_initialize(qu_vertex_format format)
 
     CHECK_GL(glGenVertexArraysOES(1, &info->array));
     CHECK_GL(glBindVertexArrayOES(info->array));
+    CHECK_GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, priv.index_buffer));
 
     for (int i = 0; i < QU_TOTAL_VERTEX_ATTRIBUTES; i++) {
         if (desc->attributes & (1 << i)) {
@@ -491,21 +580,13 @@ static void vao_vertex_format_terminate(qu_vertex_format format)
 static void vao_vertex_format_update(qu_vertex_format format)
 {
     struct vertex_format_info *info = &priv.vertex_formats[format];
-    struct vertex_format_desc const *desc = &vertex_format_desc[format];
 
     CHECK_GL(glBindVertexArrayOES(info->array));
 
-    unsigned int offset = 0;
+    vertex_format_set_base(format, 0);
 
-    for (int i = 0; i < QU_TOTAL_VERTEX_ATTRIBUTES; i++) {
-        if (desc->attributes & (1 << i)) {
-            GLsizei size = vertex_attribute_desc[i].size;
-            GLsizei stride = sizeof(float) * desc->stride;
-
-            CHECK_GL(glVertexAttribPointer(i, size, GL_FLOAT, GL_FALSE, stride, (void *) (intptr_t) offset));
-            offset += sizeof(float) * size;
-        }
-    }
+    // Restore vertex array of the format that is currently in use.
+    CHECK_GL(glBindVertexArrayOES(priv.vertex_formats[priv.vertex_format].array));
 }
 
 static void vao_vertex_format_apply(qu_vertex_format format)
@@ -619,9 +700,24 @@ static void es2_initialize(void)
         QU_LOGI("GL_OES_vertex_array_object is not supported, won't use VAOs.\n");
     }
 
+    // WebGL exposes S3TC under its own name.
+    if (check_extension("GL_EXT_texture_compression_s3tc")
+        || check_extension("GL_WEBGL_compressed_texture_s3tc")) {
+        priv.features |= QU_RENDERER_FEATURE_BIT_BC1 | QU_RENDERER_FEATURE_BIT_BC3;
+        QU_LOGI("S3TC texture compression is supported.\n");
+    }
+
+    if (check_extension("GL_EXT_texture_compression_bptc")) {
+        priv.features |= QU_RENDERER_FEATURE_BIT_BC7;
+        QU_LOGI("BPTC texture compression is supported.\n");
+    }
+
     CHECK_GL(glEnable(GL_BLEND));
     CHECK_GL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
 
+    // Formats without per-vertex color read this value instead.
+    CHECK_GL(glVertexAttrib4f(QU_VERTEX_ATTRIBUTE_COLOR, 1.f, 1.f, 1.f, 1.f));
+
     GLuint shaders[TOTAL_SHADERS];
     
     for (int i = 0; i < TOTAL_SHADERS; i++) {
@@ -629,6 +725,11 @@ static void es2_initialize(void)
     }
 
     for (int i = 0; i < QU_TOTAL_BRUSHES; i++) {
+        // Sprite brush is only used for instancing.
+        if (!program_desc[i].name) {
+            continue;
+        }
+
         GLuint vs = shaders[program_desc[i].vert];
         GLuint fs = shaders[program_desc[i].frag];
 
@@ -645,6 +746,9 @@ static void es2_initialize(void)
 
     priv.used_program = -1;
 
+    CHECK_GL(glGenBuffers(1, &priv.index_buffer));
+    CHECK_GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, priv.index_buffer));
+
     for (int i = 0; i < QU_TOTAL_VERTEX_FORMATS; i++) {
         struct vertex_format_info *info = &priv.vertex_formats[i];
         CHECK_GL(glGenBuffers(1, &info->buffer));
@@ -661,28 +765,55 @@ static void es2_terminate(void)
         priv.vertex_format_terminate(i);
     }
 
+    CHECK_GL(glDeleteBuffers(1, &priv.index_buffer));
+
     for (int i = 0; i < QU_TOTAL_BRUSHES; i++) {
         CHECK_GL(glDeleteProgram(priv.programs[i].id));
     }
 
+    pl_free(priv.region_buffer);
+    priv.region_buffer = NULL;
+    priv.region_buffer_size = 0;
+
     QU_LOGI("Terminated.\n");
 }
 
+static unsigned int es2_query_features(void)
+{
+    return priv.features;
+}
+
 static void es2_upload_vertex_data(qu_vertex_format format, float const *data, size_t size)
 {
     struct vertex_format_info *info = &priv.vertex_formats[format];
 
+    GLsizeiptr stride = sizeof(float) * vertex_format_desc[format].stride;
+    GLsizeiptr bytes = sizeof(float) * size;
+
     CHECK_GL(glBindBuffer(GL_ARRAY_BUFFER, info->buffer));
 
-    if (size < info->buffer_size) {
-        CHECK_GL(glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * size, data));
-    } else {
-        CHECK_GL(glBufferData(GL_ARRAY_BUFFER, sizeof(float) * size, data, GL_STREAM_DRAW));
+    // Offset should be a multiple of vertex size, so that
+    // the region can be addressed with base vertex.
+    GLintptr offset = ((info->stream_offset + stride - 1) / stride) * stride;
+
+    if (offset + bytes > info->buffer_size) {
+        info->buffer_size = QU_MAX(info->buffer_size, STREAM_FRAMES * bytes);
+        CHECK_GL(glBufferData(GL_ARRAY_BUFFER, info->buffer_size, NULL, GL_STREAM_DRAW));
+
+        priv.vertex_format_update(format);
+        offset = 0;
     }
 
-    priv.vertex_format_update(format);
+    CHECK_GL(glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, data));
+
+    info->stream_offset = offset + bytes;
+    info->stream_base = (unsigned int) (offset / stride);
+}
 
-    info->buffer_size = size;
+static void es2_upload_index_data(uint16_t const *data, size_t size)
+{
+    CHECK_GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, priv.index_buffer));
+    CHECK_GL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * size, data, GL_STATIC_DRAW));
 }
 
 static void es2_apply_projection(qu_mat4 const *projection)
@@ -779,6 +910,7 @@ static void es2_apply_vertex_format(qu_vertex_format format)
     CHECK_GL(glBindBuffer(GL_ARRAY_BUFFER, info->buffer));
 
     priv.vertex_format_apply(format);
+    priv.vertex_format = format;
 }
 
 static void es2_apply_blend_mode(qu_blend_mode mode)
@@ -807,9 +939,51 @@ static void es2_exec_clear(void)
 
 static void es2_exec_draw(qu_render_mode mode, unsigned int first_vertex, unsigned int total_vertices)
 {
+    struct vertex_format_info *info = &priv.vertex_formats[priv.vertex_format];
+
+    if (info->base_vertex != 0) {
+        vertex_format_set_base(priv.vertex_format, 0);
+    }
+
+    first_vertex += info->stream_base;
+
     CHECK_GL(glDrawArrays(mode_map[mode], (GLint) first_vertex, (GLsizei) total_vertices));
 }
 
+static void es2_exec_draw_indexed(qu_render_mode mode, unsigned int first_vertex,
+                                  unsigned int first_index, unsigned int total_indices)
+{
+    first_vertex += priv.vertex_formats[priv.vertex_format].stream_base;
+
+    if (priv.vertex_formats[priv.vertex_format].base_vertex != first_vertex) {
+        vertex_format_set_base(priv.vertex_format, first_vertex);
+    }
+
+    CHECK_GL(glDrawElements(mode_map[mode], (GLsizei) total_indices, GL_UNSIGNED_SHORT,
+                            (void *) (intptr_t) (sizeof(uint16_t) * first_index)));
+}
+
+static void es2_exec_draw_instanced(qu_render_mode mode, unsigned int total_vertices,
+                                    unsigned int first_instance, unsigned int total_instances)
+{
+    // Not supported.
+}
+
+// Texture should be bound.
+// OpenGL ES 2.0 can't have mipmaps on NPOT textures.
+static void es2_update_texture_mipmaps(qu_texture_obj const *texture)
+{
+    bool pot = (texture->width & (texture->width - 1)) == 0
+        && (texture->height & (texture->height - 1)) == 0;
+
+    if (texture->mipmaps && pot) {
+        CHECK_GL(glGenerateMipmap(GL_TEXTURE_2D));
+        CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+    } else {
+        CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    }
+}
+
 static void es2_load_texture(qu_texture_obj *texture)
 {
     GLuint id = texture->priv[0];
@@ -821,23 +995,92 @@ static void es2_load_texture(qu_texture_obj *texture)
 
     CHECK_GL(glBindTexture(GL_TEXTURE_2D, id));
 
-    GLenum internal_format = texture_format_map[texture->channels - 1];
-    GLenum format = internal_format;
-
-    CHECK_GL(glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        internal_format,
-        texture->width,
-        texture->height,
-        0,
-        format,
-        GL_UNSIGNED_BYTE,
-        texture->pixels
-    ));
+    if (texture->compression) {
+        GLsizei size = (GLsizei) qu_get_compressed_image_size(texture->compression,
+                                                              texture->width, texture->height);
+
+        CHECK_GL(glCompressedTexImage2D(
+            GL_TEXTURE_2D,
+            0,
+            compressed_format_map[texture->compression],
+            texture->width,
+            texture->height,
+            0,
+            size,
+            texture->pixels
+        ));
+    } else {
+        GLenum internal_format = texture_format_map[texture->channels - 1];
+        GLenum format = internal_format;
+
+        CHECK_GL(glTexImage2D(
+            GL_TEXTURE_2D,
+            0,
+            internal_format,
+            texture->width,
+            texture->height,
+            0,
+            format,
+            GL_UNSIGNED_BYTE,
+            texture->pixels
+        ));
+    }
 
     CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
-    CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    es2_update_texture_mipmaps(texture);
+
+    if (priv.bound_texture) {
+        CHECK_GL(glBindTexture(GL_TEXTURE_2D, priv.bound_texture->priv[0]));
+    } else {
+        CHECK_GL(glBindTexture(GL_TEXTURE_2D, 0));
+    }
+}
+
+static void es2_update_texture_region(qu_texture_obj *texture, int x, int y, int w, int h,
+                                     unsigned char const *pixels)
+{
+    GLuint id = texture->priv[0];
+
+    if (id == 0) {
+        es2_load_texture(texture);
+        return;
+    }
+
+    if (!pixels) {
+        size_t row_size = w * texture->channels;
+        size_t stride = texture->width * texture->channels;
+
+        pixels = texture->pixels + (y * stride) + (x * texture->channels);
+
+        // Rows are not contiguous unless the region spans full width.
+        if (row_size != stride) {
+            size_t required_size = row_size * h;
+
+            if (priv.region_buffer_size < required_size) {
+                unsigned char *next_buffer = pl_realloc(priv.region_buffer, required_size);
+
+                if (!next_buffer) {
+                    es2_load_texture(texture);
+                    return;
+                }
+
+                priv.region_buffer = next_buffer;
+                priv.region_buffer_size = required_size;
+            }
+
+            for (int i = 0; i < h; i++) {
+                memcpy(priv.region_buffer + (i * row_size), pixels + (i * stride), row_size);
+            }
+
+            pixels = priv.region_buffer;
+        }
+    }
+
+    CHECK_GL(glBindTexture(GL_TEXTURE_2D, id));
+
+    GLenum format = texture_format_map[texture->channels - 1];
+
+    CHECK_GL(glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, format, GL_UNSIGNED_BYTE, pixels));
 
     if (priv.bound_texture) {
         CHECK_GL(glBindTexture(GL_TEXTURE_2D, priv.bound_texture->priv[0]));
@@ -872,6 +1115,22 @@ static void es2_set_texture_smooth(qu_texture_obj *texture, bool smooth)
     }
 }
 
+static void es2_set_texture_mipmaps(qu_texture_obj *texture, bool mipmaps)
+{
+    GLuint id = (GLuint) texture->priv[0];
+
+    CHECK_GL(glBindTexture(GL_TEXTURE_2D, id));
+
+    texture->mipmaps = mipmaps;
+    es2_update_texture_mipmaps(texture);
+
+    if (priv.bound_texture) {
+        CHECK_GL(glBindTexture(GL_TEXTURE_2D, priv.bound_texture->priv[0]));
+    } else {
+        CHECK_GL(glBindTexture(GL_TEXTURE_2D, 0));
+    }
+}
+
 static void es2_create_surface(qu_surface_obj *surface)
 {
     GLsizei width = surface->texture.width;
@@ -959,13 +1218,24 @@ static void es2_set_surface_antialiasing_level(qu_surface_obj *surface, int leve
     }
 }
 
+static void es2_enable_gpu_timers(void)
+{
+}
+
+static bool es2_end_gpu_frame(qu_gpu_timings *timings)
+{
+    return false;
+}
+
 //------------------------------------------------------------------------------
 
 qu_renderer_impl const qu_es2_renderer_impl = {
     .query = es2_query,
     .initialize = es2_initialize,
     .terminate = es2_terminate,
+    .query_features = es2_query_features,
     .upload_vertex_data = es2_upload_vertex_data,
+    .upload_index_data = es2_upload_index_data,
     .apply_projection = es2_apply_projection,
     .apply_transform = es2_apply_transform,
     .apply_surface = es2_apply_surface,
@@ -978,10 +1248,16 @@ qu_renderer_impl const qu_es2_renderer_impl = {
     .exec_resize = es2_exec_resize,
 	.exec_clear = es2_exec_clear,
 	.exec_draw = es2_exec_draw,
+	.exec_draw_indexed = es2_exec_draw_indexed,
+	.exec_draw_instanced = es2_exec_draw_instanced,
     .load_texture = es2_load_texture,
+    .update_texture_region = es2_update_texture_region,
     .unload_texture = es2_unload_texture,
     .set_texture_smooth = es2_set_texture_smooth,
+    .set_texture_mipmaps = es2_set_texture_mipmaps,
     .create_surface = es2_create_surface,
     .destroy_surface = es2_destroy_surface,
     .set_surface_antialiasing_level = es2_set_surface_antialiasing_level,
+    .enable_gpu_timers = es2_enable_gpu_timers,
+    .end_gpu_frame = es2_end_gpu_frame,
 };
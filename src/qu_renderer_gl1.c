@@ -155,6 +155,10 @@ struct priv
     GLuint bound_texture;
     qu_surface_obj const *bound_surface;
     float const *vertex_data[QU_TOTAL_VERTEX_FORMATS];
+    uint16_t const *index_data;
+    qu_vertex_format vertex_format;
+    float const *vertex_pointer;
+    GLfloat draw_color[4];
 };
 
 static struct ext ext;
@@ -170,6 +174,49 @@ static void color_conv(GLfloat *dst, qu_color color)
     dst[3] = ((color >> 0x18) & 0xFF) / 255.f;
 }
 
+static void set_vertex_pointers(unsigned int first_vertex)
+{
+    qu_vertex_format format = priv.vertex_format;
+    float const *data = priv.vertex_data[format];
+
+    switch (format) {
+    case QU_VERTEX_FORMAT_2XY:
+        data += 2 * first_vertex;
+        break;
+    case QU_VERTEX_FORMAT_4XYST:
+        data += 4 * first_vertex;
+        break;
+    case QU_VERTEX_FORMAT_5XYCST:
+        data += 5 * first_vertex;
+        break;
+    default:
+        break;
+    }
+
+    if (priv.vertex_pointer == data) {
+        return;
+    }
+
+    switch (format) {
+    case QU_VERTEX_FORMAT_2XY:
+        CHECK_GL(glVertexPointer(2, GL_FLOAT, 0, data));
+        break;
+    case QU_VERTEX_FORMAT_4XYST:
+        CHECK_GL(glVertexPointer(2, GL_FLOAT, sizeof(float) * 4, data + 0));
+        CHECK_GL(glTexCoordPointer(2, GL_FLOAT, sizeof(float) * 4, data + 2));
+        break;
+    case QU_VERTEX_FORMAT_5XYCST:
+        CHECK_GL(glVertexPointer(2, GL_FLOAT, sizeof(float) * 5, data + 0));
+        CHECK_GL(glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(float) * 5, data + 2));
+        CHECK_GL(glTexCoordPointer(2, GL_FLOAT, sizeof(float) * 5, data + 3));
+        break;
+    default:
+        break;
+    }
+
+    priv.vertex_pointer = data;
+}
+
 static void load_gl_functions(void)
 {
     ext.glBlendFuncSeparate = qu_gl_get_proc_address("glBlendFuncSeparate");
@@ -243,6 +290,19 @@ static void surface_remove_multisample_buffer(qu_surface_obj *surface)
     CHECK_GL(ext.glDeleteRenderbuffersEXT(1, &ms_color));
 }
 
+// Framebuffer of the bound surface is bound again after it's changed
+// outside of apply_surface().
+static void restore_bound_surface(void)
+{
+    GLuint fbo = 0;
+
+    if (priv.bound_surface) {
+        fbo = priv.bound_surface->priv[priv.bound_surface->sample_count > 1 ? 2 : 0];
+    }
+
+    CHECK_GL(ext.glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo));
+}
+
 //------------------------------------------------------------------------------
 
 static bool gl1_query(void)
@@ -292,12 +352,22 @@ static void gl1_terminate(void)
     QU_LOGI("Terminated.\n");
 }
 
+static unsigned int gl1_query_features(void)
+{
+    return 0;
+}
+
 static void gl1_upload_vertex_data(qu_vertex_format vertex_format, float const *data, size_t size)
 {
     // Don't actually upload anything.
     priv.vertex_data[vertex_format] = data;
 }
 
+static void gl1_upload_index_data(uint16_t const *data, size_t size)
+{
+    priv.index_data = data;
+}
+
 static void gl1_apply_projection(qu_mat4 const *projection)
 {
     CHECK_GL(glMatrixMode(GL_PROJECTION));
@@ -371,10 +441,8 @@ static void gl1_apply_clear_color(qu_color color)
 
 static void gl1_apply_draw_color(qu_color color)
 {
-    GLfloat v[4];
-
-    color_conv(v, color);
-    CHECK_GL(glColor4fv(v));
+    color_conv(priv.draw_color, color);
+    CHECK_GL(glColor4fv(priv.draw_color));
 }
 
 static void gl1_apply_brush(qu_brush brush)
@@ -388,20 +456,30 @@ static void gl1_apply_vertex_format(qu_vertex_format vertex_format)
         CHECK_GL(glEnableClientState(GL_VERTEX_ARRAY));
         CHECK_GL(glDisableClientState(GL_COLOR_ARRAY));
         CHECK_GL(glDisableClientState(GL_TEXTURE_COORD_ARRAY));
-        
-        CHECK_GL(glVertexPointer(2, GL_FLOAT, 0, priv.vertex_data[vertex_format]));
+
+        // Current color is undefined after drawing with color array.
+        CHECK_GL(glColor4fv(priv.draw_color));
         break;
     case QU_VERTEX_FORMAT_4XYST:
         CHECK_GL(glEnableClientState(GL_VERTEX_ARRAY));
         CHECK_GL(glDisableClientState(GL_COLOR_ARRAY));
         CHECK_GL(glEnableClientState(GL_TEXTURE_COORD_ARRAY));
 
-        CHECK_GL(glVertexPointer(2, GL_FLOAT, sizeof(float) * 4, priv.vertex_data[vertex_format] + 0));
-        CHECK_GL(glTexCoordPointer(2, GL_FLOAT, sizeof(float) * 4, priv.vertex_data[vertex_format] + 2));
+        CHECK_GL(glColor4fv(priv.draw_color));
+        break;
+    case QU_VERTEX_FORMAT_5XYCST:
+        CHECK_GL(glEnableClientState(GL_VERTEX_ARRAY));
+        CHECK_GL(glEnableClientState(GL_COLOR_ARRAY));
+        CHECK_GL(glEnableClientState(GL_TEXTURE_COORD_ARRAY));
         break;
     default:
         break;
     }
+
+    // Pointers are set right before drawing, since vertex data
+    // may move in memory between uploads.
+    priv.vertex_format = vertex_format;
+    priv.vertex_pointer = NULL;
 }
 
 static void gl1_apply_blend_mode(qu_blend_mode mode)
@@ -430,9 +508,97 @@ static void gl1_exec_clear(void)
 
 static void gl1_exec_draw(qu_render_mode render_mode, unsigned int first_vertex, unsigned int total_vertices)
 {
+    set_vertex_pointers(0);
+
     CHECK_GL(glDrawArrays(mode_map[render_mode], (GLint) first_vertex, (GLsizei) total_vertices));
 }
 
+static void gl1_exec_draw_indexed(qu_render_mode render_mode, unsigned int first_vertex,
+                                  unsigned int first_index, unsigned int total_indices)
+{
+    // OpenGL 1.5 has no base vertex, so pointers are offset instead.
+    set_vertex_pointers(first_vertex);
+
+    CHECK_GL(glDrawElements(mode_map[render_mode], (GLsizei) total_indices, GL_UNSIGNED_SHORT,
+                            priv.index_data + first_index));
+}
+
+static void gl1_exec_draw_instanced(qu_render_mode render_mode, unsigned int total_vertices,
+                                    unsigned int first_instance, unsigned int total_instances)
+{
+    // Not supported.
+}
+
+// Each pixel of the next level is an average of 2x2 block.
+static void gl1_downsample(unsigned char const *src, int sw, int sh,
+                           unsigned char *dst, int dw, int dh, int channels)
+{
+    for (int y = 0; y < dh; y++) {
+        int y0 = 2 * y;
+        int y1 = QU_MIN(y0 + 1, sh - 1);
+
+        for (int x = 0; x < dw; x++) {
+            int x0 = 2 * x;
+            int x1 = QU_MIN(x0 + 1, sw - 1);
+
+            for (int c = 0; c < channels; c++) {
+                int sum = src[(y0 * sw + x0) * channels + c]
+                        + src[(y0 * sw + x1) * channels + c]
+                        + src[(y1 * sw + x0) * channels + c]
+                        + src[(y1 * sw + x1) * channels + c];
+
+                dst[(y * dw + x) * channels + c] = (unsigned char) ((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+// Texture should be bound. Mipmap chain is built on CPU
+// with box filter, since glGenerateMipmap() is not available.
+static void gl1_update_texture_mipmaps(qu_texture_obj const *texture)
+{
+    if (!texture->mipmaps || !texture->pixels) {
+        CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+        return;
+    }
+
+    int w = texture->width;
+    int h = texture->height;
+    int channels = texture->channels;
+
+    // Two consecutive levels are stored at once, odd ones go first.
+    size_t odd_size = (size_t) QU_MAX(1, w / 2) * QU_MAX(1, h / 2) * channels;
+    size_t even_size = (size_t) QU_MAX(1, w / 4) * QU_MAX(1, h / 4) * channels;
+    unsigned char *buffer = pl_malloc(odd_size + even_size);
+
+    if (!buffer) {
+        CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+        return;
+    }
+
+    GLenum format = texture_format_map[channels - 1];
+    unsigned char const *src = texture->pixels;
+
+    for (int level = 1; w > 1 || h > 1; level++) {
+        int dw = QU_MAX(1, w / 2);
+        int dh = QU_MAX(1, h / 2);
+        unsigned char *dst = (level % 2) ? buffer : (buffer + odd_size);
+
+        gl1_downsample(src, w, h, dst, dw, dh, channels);
+
+        CHECK_GL(glTexImage2D(GL_TEXTURE_2D, level, format, dw, dh, 0,
+                              format, GL_UNSIGNED_BYTE, dst));
+
+        src = dst;
+        w = dw;
+        h = dh;
+    }
+
+    pl_free(buffer);
+
+    CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+}
+
 static void gl1_load_texture(qu_texture_obj *texture)
 {
     GLuint id = texture->priv[0];
@@ -459,7 +625,38 @@ static void gl1_load_texture(qu_texture_obj *texture)
     ));
 
     CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
-    CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    gl1_update_texture_mipmaps(texture);
+
+    CHECK_GL(glBindTexture(GL_TEXTURE_2D, priv.bound_texture));
+}
+
+static void gl1_update_texture_region(qu_texture_obj *texture, int x, int y, int w, int h,
+                                   unsigned char const *pixels)
+{
+    GLuint id = texture->priv[0];
+
+    if (id == 0) {
+        gl1_load_texture(texture);
+        return;
+    }
+
+    CHECK_GL(glBindTexture(GL_TEXTURE_2D, id));
+
+    // Otherwise source rectangle is picked from the full pixel array.
+    if (!pixels) {
+        CHECK_GL(glPixelStorei(GL_UNPACK_ROW_LENGTH, texture->width));
+        CHECK_GL(glPixelStorei(GL_UNPACK_SKIP_PIXELS, x));
+        CHECK_GL(glPixelStorei(GL_UNPACK_SKIP_ROWS, y));
+        pixels = texture->pixels;
+    }
+
+    GLenum format = texture_format_map[texture->channels - 1];
+
+    CHECK_GL(glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, format, GL_UNSIGNED_BYTE, pixels));
+
+    CHECK_GL(glPixelStorei(GL_UNPACK_ROW_LENGTH, 0));
+    CHECK_GL(glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0));
+    CHECK_GL(glPixelStorei(GL_UNPACK_SKIP_ROWS, 0));
 
     CHECK_GL(glBindTexture(GL_TEXTURE_2D, priv.bound_texture));
 }
@@ -490,6 +687,22 @@ static void gl1_set_texture_smooth(qu_texture_obj *texture, bool smooth)
     CHECK_GL(glBindTexture(GL_TEXTURE_2D, priv.bound_texture));
 }
 
+static void gl1_set_texture_mipmaps(qu_texture_obj *texture, bool mipmaps)
+{
+    GLuint id = (GLuint) texture->priv[0];
+
+    if (!id) {
+        return;
+    }
+
+    CHECK_GL(glBindTexture(GL_TEXTURE_2D, id));
+
+    texture->mipmaps = mipmaps;
+    gl1_update_texture_mipmaps(texture);
+
+    CHECK_GL(glBindTexture(GL_TEXTURE_2D, priv.bound_texture));
+}
+
 static void gl1_create_surface(qu_surface_obj *surface)
 {
     GLsizei width = surface->texture.width;
@@ -545,11 +758,7 @@ static void gl1_create_surface(qu_surface_obj *surface)
         surface_add_multisample_buffer(surface);
     }
 
-    if (priv.bound_surface) {
-        CHECK_GL(ext.glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, priv.bound_surface->priv[0]));
-    } else {
-        CHECK_GL(ext.glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0));
-    }
+    restore_bound_surface();
 
     CHECK_GL(glBindTexture(GL_TEXTURE_2D, priv.bound_texture));
 }
@@ -580,6 +789,17 @@ static void gl1_set_surface_antialiasing_level(qu_surface_obj *surface, int leve
     if (surface->sample_count > 1) {
         surface_add_multisample_buffer(surface);
     }
+
+    restore_bound_surface();
+}
+
+static void gl1_enable_gpu_timers(void)
+{
+}
+
+static bool gl1_end_gpu_frame(qu_gpu_timings *timings)
+{
+    return false;
 }
 
 //------------------------------------------------------------------------------
@@ -588,7 +808,9 @@ qu_renderer_impl const qu_gl1_renderer_impl = {
     .query = gl1_query,
     .initialize = gl1_initialize,
     .terminate = gl1_terminate,
+    .query_features = gl1_query_features,
     .upload_vertex_data = gl1_upload_vertex_data,
+    .upload_index_data = gl1_upload_index_data,
     .apply_projection = gl1_apply_projection,
     .apply_transform = gl1_apply_transform,
     .apply_surface = gl1_apply_surface,
@@ -601,10 +823,16 @@ qu_renderer_impl const qu_gl1_renderer_impl = {
     .exec_resize = gl1_exec_resize,
 	.exec_clear = gl1_exec_clear,
 	.exec_draw = gl1_exec_draw,
+	.exec_draw_indexed = gl1_exec_draw_indexed,
+	.exec_draw_instanced = gl1_exec_draw_instanced,
     .load_texture = gl1_load_texture,
+    .update_texture_region = gl1_update_texture_region,
     .unload_texture = gl1_unload_texture,
     .set_texture_smooth = gl1_set_texture_smooth,
+    .set_texture_mipmaps = gl1_set_texture_mipmaps,
     .create_surface = gl1_create_surface,
     .destroy_surface = gl1_destroy_surface,
     .set_surface_antialiasing_level = gl1_set_surface_antialiasing_level,
+    .enable_gpu_timers = gl1_enable_gpu_timers,
+    .end_gpu_frame = gl1_end_gpu_frame,
 };
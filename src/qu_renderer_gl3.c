@@ -88,6 +88,7 @@ static void _check_gl(char const *call, char const *file, int line)
 enum shader
 {
     SHADER_VERTEX,
+    SHADER_VERTEX_SPRITE,
     SHADER_SOLID,
     SHADER_TEXTURED,
     SHADER_FONT,
@@ -122,12 +123,16 @@ struct vertex_attribute_desc
 {
     char const *name;
     unsigned int size;
+    GLenum type;
+    GLboolean normalized;
+    unsigned int bytes;
 };
 
 struct vertex_format_desc
 {
     unsigned int attributes;
     unsigned int stride;
+    unsigned int divisor;
 };
 
 //------------------------------------------------------------------------------
@@ -154,15 +159,46 @@ static struct shader_desc const shader_desc[TOTAL_SHADERS] = {
             "}\n"
         },
     },
+    [SHADER_VERTEX_SPRITE] = {
+        .type = GL_VERTEX_SHADER,
+        .name = "SHADER_VERTEX_SPRITE",
+        .src = {
+            "#version 330 core\n"
+            "in vec4 a_color;\n"
+            "in vec4 a_spriteRect;\n"
+            "in vec3 a_spriteOrigin;\n"
+            "in vec4 a_spriteTexRect;\n"
+            "out vec4 v_color;\n"
+            "out vec2 v_texCoord;\n"
+            "uniform sampler2D u_texture;\n"
+            "uniform mat4 u_projection;\n"
+            "uniform mat4 u_modelView;\n"
+            "void main()\n"
+            "{\n"
+            "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+            "    vec2 local = corner * a_spriteRect.zw - a_spriteOrigin.xy;\n"
+            "    float angle = radians(a_spriteOrigin.z);\n"
+            "    float c = cos(angle);\n"
+            "    float s = sin(angle);\n"
+            "    vec2 texel = a_spriteTexRect.xy + corner * a_spriteTexRect.zw;\n"
+            "    v_texCoord = texel / vec2(textureSize(u_texture, 0));\n"
+            "    v_color = a_color;\n"
+            "    vec2 rotated = vec2(local.x * c - local.y * s, local.x * s + local.y * c);\n"
+            "    vec4 position = vec4(a_spriteRect.xy + rotated, 0.0, 1.0);\n"
+            "    gl_Position = u_projection * u_modelView * position;\n"
+            "}\n"
+        },
+    },
     [SHADER_SOLID] = {
         .type = GL_FRAGMENT_SHADER,
         .name = "SHADER_SOLID",
         .src = {
             "#version 330 core\n"
+            "in vec4 v_color;\n"
             "uniform vec4 u_color;\n"
             "void main()\n"
             "{\n"
-            "    gl_FragColor = u_color;\n"
+            "    gl_FragColor = u_color * v_color;\n"
             "}\n"
         },
     },
@@ -171,12 +207,13 @@ static struct shader_desc const shader_desc[TOTAL_SHADERS] = {
         .name = "SHADER_TEXTURED",
         .src = {
             "#version 330 core\n"
+            "in vec4 v_color;\n"
             "in vec2 v_texCoord;\n"
             "uniform sampler2D u_texture;\n"
             "uniform vec4 u_color;\n"
             "void main()\n"
             "{\n"
-            "    gl_FragColor = texture2D(u_texture, v_texCoord) * u_color;\n"
+            "    gl_FragColor = texture2D(u_texture, v_texCoord) * u_color * v_color;\n"
             "}\n"
         },
     },
@@ -185,13 +222,14 @@ static struct shader_desc const shader_desc[TOTAL_SHADERS] = {
         .name = "SHADER_FONT",
         .src = {
             "#version 330 core\n"
+            "in vec4 v_color;\n"
             "in vec2 v_texCoord;\n"
             "uniform sampler2D u_texture;\n"
             "uniform vec4 u_color;\n"
             "void main()\n"
             "{\n"
             "    float alpha = texture2D(u_texture, v_texCoord).r;\n"
-            "    gl_FragColor = vec4(u_color.rgb, alpha);\n"
+            "    gl_FragColor = vec4(u_color.rgb * v_color.rgb, alpha * v_color.a);\n"
             "}\n"
         },
     },
@@ -213,6 +251,11 @@ static struct program_desc const program_desc[QU_TOTAL_BRUSHES] = {
         .vert = SHADER_VERTEX,
         .frag = SHADER_FONT,
     },
+    [QU_BRUSH_SPRITE] = {
+        .name = "BRUSH_SPRITE",
+        .vert = SHADER_VERTEX_SPRITE,
+        .frag = SHADER_TEXTURED,
+    },
 };
 
 static char const *uniform_names[TOTAL_UNIFORMS] = {
@@ -222,9 +265,48 @@ static char const *uniform_names[TOTAL_UNIFORMS] = {
 };
 
 static struct vertex_attribute_desc const vertex_attribute_desc[QU_TOTAL_VERTEX_ATTRIBUTES] = {
-    [QU_VERTEX_ATTRIBUTE_POSITION] = { .name = "a_position", .size = 2 },
-    [QU_VERTEX_ATTRIBUTE_COLOR] = { .name = "a_color", .size = 4 },
-    [QU_VERTEX_ATTRIBUTE_TEXCOORD] = {.name = "a_texCoord", .size = 2 },
+    [QU_VERTEX_ATTRIBUTE_POSITION] = {
+        .name = "a_position",
+        .size = 2,
+        .type = GL_FLOAT,
+        .normalized = GL_FALSE,
+        .bytes = 2 * sizeof(GLfloat),
+    },
+    [QU_VERTEX_ATTRIBUTE_COLOR] = {
+        .name = "a_color",
+        .size = 4,
+        .type = GL_UNSIGNED_BYTE,
+        .normalized = GL_TRUE,
+        .bytes = 4 * sizeof(GLubyte),
+    },
+    [QU_VERTEX_ATTRIBUTE_TEXCOORD] = {
+        .name = "a_texCoord",
+        .size = 2,
+        .type = GL_FLOAT,
+        .normalized = GL_FALSE,
+        .bytes = 2 * sizeof(GLfloat),
+    },
+    [QU_VERTEX_ATTRIBUTE_SPRITE_RECT] = {
+        .name = "a_spriteRect",
+        .size = 4,
+        .type = GL_FLOAT,
+        .normalized = GL_FALSE,
+        .bytes = 4 * sizeof(GLfloat),
+    },
+    [QU_VERTEX_ATTRIBUTE_SPRITE_ORIGIN] = {
+        .name = "a_spriteOrigin",
+        .size = 3,
+        .type = GL_FLOAT,
+        .normalized = GL_FALSE,
+        .bytes = 3 * sizeof(GLfloat),
+    },
+    [QU_VERTEX_ATTRIBUTE_SPRITE_TEXRECT] = {
+        .name = "a_spriteTexRect",
+        .size = 4,
+        .type = GL_FLOAT,
+        .normalized = GL_FALSE,
+        .bytes = 4 * sizeof(GLfloat),
+    },
 };
 
 static struct vertex_format_desc const vertex_format_desc[QU_TOTAL_VERTEX_FORMATS] = {
@@ -236,6 +318,20 @@ static struct vertex_format_desc const vertex_format_desc[QU_TOTAL_VERTEX_FORMAT
         .attributes = QU_VERTEX_ATTRIBUTE_BIT_POSITION | QU_VERTEX_ATTRIBUTE_BIT_TEXCOORD,
         .stride = 4,
     },
+    [QU_VERTEX_FORMAT_5XYCST] = {
+        .attributes = QU_VERTEX_ATTRIBUTE_BIT_POSITION
+                    | QU_VERTEX_ATTRIBUTE_BIT_COLOR
+                    | QU_VERTEX_ATTRIBUTE_BIT_TEXCOORD,
+        .stride = 5,
+    },
+    [QU_VERTEX_FORMAT_SPRITE] = {
+        .attributes = QU_VERTEX_ATTRIBUTE_BIT_COLOR
+                    | QU_VERTEX_ATTRIBUTE_BIT_SPRITE_RECT
+                    | QU_VERTEX_ATTRIBUTE_BIT_SPRITE_ORIGIN
+                    | QU_VERTEX_ATTRIBUTE_BIT_SPRITE_TEXRECT,
+        .stride = 12,
+        .divisor = 1,
+    },
 };
 
 //------------------------------------------------------------------------------
@@ -257,6 +353,12 @@ static GLenum const texture_format_map[4][2] = {
     { GL_RGBA8, GL_RGBA },
 };
 
+static GLenum const compressed_format_map[QU_TOTAL_IMAGE_COMPRESSIONS] = {
+    [QU_IMAGE_COMPRESSION_BC1] = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
+    [QU_IMAGE_COMPRESSION_BC3] = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+    [QU_IMAGE_COMPRESSION_BC7] = GL_COMPRESSED_RGBA_BPTC_UNORM,
+};
+
 static GLenum const texture_swizzle_map[4][4] = {
     { GL_RED, GL_RED, GL_RED, GL_ONE },
     { GL_RED, GL_RED, GL_RED, GL_GREEN },
@@ -292,11 +394,45 @@ struct program_info
     unsigned int dirty_uniforms;
 };
 
+// Vertex buffers are used as rings: each upload is written after
+// the previous one, so draw calls still in flight are never touched.
+// Fence is inserted after each upload to know when its region is free.
+#define STREAM_FRAMES           3
+#define MAX_STREAM_REGIONS      16
+
+struct stream_region
+{
+    GLsync fence;
+    GLintptr begin;
+    GLintptr end;
+};
+
 struct vertex_format_info
 {
     GLuint array;
     GLuint buffer;
-    GLuint buffer_size;
+    GLsizeiptr buffer_size;
+    unsigned int base_vertex;
+
+    GLintptr stream_offset;
+    unsigned int stream_base;
+    struct stream_region pending;
+    struct stream_region regions[MAX_STREAM_REGIONS];
+    int first_region;
+    int total_regions;
+};
+
+// Each surface pass is timed with GL_TIME_ELAPSED query. Results of
+// a frame are read back only when available, so a few frames may be
+// in flight at once. If none of them finish in time, the oldest
+// frame is dropped rather than waited for.
+#define TIMER_FRAMES            4
+
+struct timer_frame
+{
+    GLuint queries[QU_MAX_GPU_TIMERS];
+    int32_t surface_ids[QU_MAX_GPU_TIMERS];
+    int total_queries;
 };
 
 struct ext
@@ -327,10 +463,16 @@ struct ext
     PFNGLBUFFERDATAPROC glBufferData;
     PFNGLBUFFERSUBDATAPROC glBufferSubData;
     PFNGLDELETEBUFFERSPROC glDeleteBuffers;
+    PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+    PFNGLUNMAPBUFFERPROC glUnmapBuffer;
+    PFNGLDRAWELEMENTSBASEVERTEXPROC glDrawElementsBaseVertex;
     PFNGLDISABLEVERTEXATTRIBARRAYPROC glDisableVertexAttribArray;
     PFNGLENABLEVERTEXATTRIBARRAYPROC glEnableVertexAttribArray;
     PFNGLGENBUFFERSPROC glGenBuffers;
+    PFNGLVERTEXATTRIB4FPROC glVertexAttrib4f;
     PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer;
+    PFNGLVERTEXATTRIBDIVISORPROC glVertexAttribDivisor;
+    PFNGLDRAWARRAYSINSTANCEDPROC glDrawArraysInstanced;
 
     PFNGLBINDFRAMEBUFFERPROC glBindFramebuffer;
     PFNGLBINDRENDERBUFFERPROC glBindRenderbuffer;
@@ -344,9 +486,23 @@ struct ext
     PFNGLFRAMEBUFFERTEXTURE2DPROC glFramebufferTexture2D;
     PFNGLRENDERBUFFERSTORAGEPROC glRenderbufferStorage;
     PFNGLRENDERBUFFERSTORAGEMULTISAMPLEPROC glRenderbufferStorageMultisample;
+    PFNGLGENERATEMIPMAPPROC glGenerateMipmap;
+    PFNGLCOMPRESSEDTEXIMAGE2DPROC glCompressedTexImage2D;
+    PFNGLGETSTRINGIPROC glGetStringi;
 
     PFNGLBLENDFUNCSEPARATEPROC glBlendFuncSeparate;
     PFNGLBLENDEQUATIONSEPARATEPROC glBlendEquationSeparate;
+
+    PFNGLFENCESYNCPROC glFenceSync;
+    PFNGLCLIENTWAITSYNCPROC glClientWaitSync;
+    PFNGLDELETESYNCPROC glDeleteSync;
+
+    PFNGLGENQUERIESPROC glGenQueries;
+    PFNGLDELETEQUERIESPROC glDeleteQueries;
+    PFNGLBEGINQUERYPROC glBeginQuery;
+    PFNGLENDQUERYPROC glEndQuery;
+    PFNGLGETQUERYOBJECTIVPROC glGetQueryObjectiv;
+    PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64v;
 };
 
 struct priv
@@ -357,10 +513,20 @@ struct priv
 
     struct program_info programs[QU_TOTAL_BRUSHES];
     struct vertex_format_info vertex_formats[QU_TOTAL_VERTEX_FORMATS];
+    qu_vertex_format vertex_format;
+    GLuint index_buffer;
 
     qu_mat4 projection;
     qu_mat4 modelview;
     GLfloat color[4];
+
+    unsigned int features;
+
+    bool timers_enabled;
+    bool timer_active;
+    struct timer_frame timer_frames[TIMER_FRAMES];
+    int timer_frame;
+    int pending_timer_frames;
 };
 
 //------------------------------------------------------------------------------
@@ -378,6 +544,22 @@ static void color_conv(GLfloat *dst, qu_color color)
     dst[3] = ((color >> 0x18) & 0xFF) / 255.f;
 }
 
+static bool check_extension(char const *extension)
+{
+    GLint total_extensions = 0;
+    CHECK_GL(glGetIntegerv(GL_NUM_EXTENSIONS, &total_extensions));
+
+    for (GLint i = 0; i < total_extensions; i++) {
+        char const *name = (char const *) ext.glGetStringi(GL_EXTENSIONS, i);
+
+        if (name && strcmp(name, extension) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 static void load_gl_functions(void)
 {
     ext.glAttachShader = qu_gl_get_proc_address("glAttachShader");
@@ -402,10 +584,16 @@ static void load_gl_functions(void)
     ext.glBufferData = qu_gl_get_proc_address("glBufferData");
     ext.glBufferSubData = qu_gl_get_proc_address("glBufferSubData");
     ext.glDeleteBuffers = qu_gl_get_proc_address("glDeleteBuffers");
+    ext.glMapBufferRange = qu_gl_get_proc_address("glMapBufferRange");
+    ext.glUnmapBuffer = qu_gl_get_proc_address("glUnmapBuffer");
+    ext.glDrawElementsBaseVertex = qu_gl_get_proc_address("glDrawElementsBaseVertex");
     ext.glDisableVertexAttribArray = qu_gl_get_proc_address("glDisableVertexAttribArray");
     ext.glEnableVertexAttribArray = qu_gl_get_proc_address("glEnableVertexAttribArray");
     ext.glGenBuffers = qu_gl_get_proc_address("glGenBuffers");
+    ext.glVertexAttrib4f = qu_gl_get_proc_address("glVertexAttrib4f");
     ext.glVertexAttribPointer = qu_gl_get_proc_address("glVertexAttribPointer");
+    ext.glVertexAttribDivisor = qu_gl_get_proc_address("glVertexAttribDivisor");
+    ext.glDrawArraysInstanced = qu_gl_get_proc_address("glDrawArraysInstanced");
 
     ext.glBindVertexArray = qu_gl_get_proc_address("glBindVertexArray");
     ext.glDeleteVertexArrays = qu_gl_get_proc_address("glDeleteVertexArrays");
@@ -423,9 +611,23 @@ static void load_gl_functions(void)
     ext.glFramebufferTexture2D = qu_gl_get_proc_address("glFramebufferTexture2D");
     ext.glRenderbufferStorage = qu_gl_get_proc_address("glRenderbufferStorage");
     ext.glRenderbufferStorageMultisample = qu_gl_get_proc_address("glRenderbufferStorageMultisample");
+    ext.glGenerateMipmap = qu_gl_get_proc_address("glGenerateMipmap");
+    ext.glCompressedTexImage2D = qu_gl_get_proc_address("glCompressedTexImage2D");
+    ext.glGetStringi = qu_gl_get_proc_address("glGetStringi");
 
     ext.glBlendFuncSeparate = qu_gl_get_proc_address("glBlendFuncSeparate");
     ext.glBlendEquationSeparate = qu_gl_get_proc_address("glBlendEquationSeparate");
+
+    ext.glFenceSync = qu_gl_get_proc_address("glFenceSync");
+    ext.glClientWaitSync = qu_gl_get_proc_address("glClientWaitSync");
+    ext.glDeleteSync = qu_gl_get_proc_address("glDeleteSync");
+
+    ext.glGenQueries = qu_gl_get_proc_address("glGenQueries");
+    ext.glDeleteQueries = qu_gl_get_proc_address("glDeleteQueries");
+    ext.glBeginQuery = qu_gl_get_proc_address("glBeginQuery");
+    ext.glEndQuery = qu_gl_get_proc_address("glEndQuery");
+    ext.glGetQueryObjectiv = qu_gl_get_proc_address("glGetQueryObjectiv");
+    ext.glGetQueryObjectui64v = qu_gl_get_proc_address("glGetQueryObjectui64v");
 }
 
 static GLuint load_shader(struct shader_desc const *desc)
@@ -481,6 +683,99 @@ static GLuint build_program(char const *name, GLuint vs, GLuint fs)
     return program;
 }
 
+// There is no base instance in OpenGL 3.3,
+// so attribute pointers are offset to the first instance instead.
+// Vertex array of the format must be bound.
+static void vertex_format_set_base(qu_vertex_format format, unsigned int base_vertex)
+{
+    struct vertex_format_info *info = &priv.vertex_formats[format];
+    struct vertex_format_desc const *desc = &vertex_format_desc[format];
+
+    CHECK_GL(ext.glBindBuffer(GL_ARRAY_BUFFER, info->buffer));
+
+    GLsizei stride = sizeof(float) * desc->stride;
+    unsigned int offset = stride * base_vertex;
+
+    for (int i = 0; i < QU_TOTAL_VERTEX_ATTRIBUTES; i++) {
+        if (desc->attributes & (1 << i)) {
+            struct vertex_attribute_desc const *attribute = &vertex_attribute_desc[i];
+
+            CHECK_GL(ext.glVertexAttribPointer(i, attribute->size, attribute->type, attribute->normalized,
+                                               stride, (void *) (intptr_t) offset));
+            offset += attribute->bytes;
+        }
+    }
+
+    info->base_vertex = base_vertex;
+}
+
+static void stream_pop_region(struct vertex_format_info *info, bool wait)
+{
+    struct stream_region *region = &info->regions[info->first_region];
+
+    if (wait) {
+        GLenum result;
+
+        do {
+            result = ext.glClientWaitSync(region->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        } while (result == GL_TIMEOUT_EXPIRED);
+    }
+
+    CHECK_GL(ext.glDeleteSync(region->fence));
+
+    info->first_region = (info->first_region + 1) % MAX_STREAM_REGIONS;
+    info->total_regions--;
+}
+
+// Called when draw calls that use the last uploaded region are issued.
+static void stream_fence_pending(struct vertex_format_info *info)
+{
+    if (info->pending.end == info->pending.begin) {
+        return;
+    }
+
+    if (info->total_regions == MAX_STREAM_REGIONS) {
+        stream_pop_region(info, true);
+    }
+
+    int index = (info->first_region + info->total_regions) % MAX_STREAM_REGIONS;
+
+    info->regions[index] = info->pending;
+    info->regions[index].fence = ext.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    info->total_regions++;
+
+    info->pending.begin = info->pending.end = 0;
+}
+
+// Fences are signaled in order, so it's enough to wait
+// for the most recent region that overlaps given range.
+static void stream_wait_range(struct vertex_format_info *info, GLintptr begin, GLintptr end)
+{
+    int total_waits = 0;
+
+    for (int i = 0; i < info->total_regions; i++) {
+        struct stream_region *region = &info->regions[(info->first_region + i) % MAX_STREAM_REGIONS];
+
+        if (region->begin < end && begin < region->end) {
+            total_waits = i + 1;
+        }
+    }
+
+    for (int i = 0; i < total_waits; i++) {
+        stream_pop_region(info, i == (total_waits - 1));
+    }
+}
+
+static void stream_release(struct vertex_format_info *info)
+{
+    while (info->total_regions > 0) {
+        stream_pop_region(info, false);
+    }
+
+    info->pending.begin = info->pending.end = 0;
+    info->stream_offset = 0;
+}
+
 static void update_uniforms(void)
 {
     if (priv.used_program == -1) {
@@ -510,6 +805,56 @@ static void update_uniforms(void)
     info->dirty_uniforms = 0;
 }
 
+static void timer_begin(int32_t surface_id)
+{
+    struct timer_frame *frame = &priv.timer_frames[priv.timer_frame];
+
+    if (frame->total_queries == QU_MAX_GPU_TIMERS) {
+        return;
+    }
+
+    CHECK_GL(ext.glBeginQuery(GL_TIME_ELAPSED, frame->queries[frame->total_queries]));
+
+    frame->surface_ids[frame->total_queries++] = surface_id;
+    priv.timer_active = true;
+}
+
+static void timer_end(void)
+{
+    if (!priv.timer_active) {
+        return;
+    }
+
+    CHECK_GL(ext.glEndQuery(GL_TIME_ELAPSED));
+    priv.timer_active = false;
+}
+
+static bool timer_read_frame(struct timer_frame *frame, qu_gpu_timings *timings)
+{
+    if (frame->total_queries > 0) {
+        GLint available = GL_FALSE;
+        GLuint last = frame->queries[frame->total_queries - 1];
+
+        CHECK_GL(ext.glGetQueryObjectiv(last, GL_QUERY_RESULT_AVAILABLE, &available));
+
+        if (!available) {
+            return false;
+        }
+    }
+
+    for (int i = 0; i < frame->total_queries; i++) {
+        GLuint64 elapsed = 0;
+        CHECK_GL(ext.glGetQueryObjectui64v(frame->queries[i], GL_QUERY_RESULT, &elapsed));
+
+        timings->timers[i].surface_id = frame->surface_ids[i];
+        timings->timers[i].time = elapsed / 1e9;
+    }
+
+    timings->total_timers = frame->total_queries;
+
+    return true;
+}
+
 static void surface_add_multisample_buffer(qu_surface_obj *surface)
 {
     GLsizei width = surface->texture.width;
@@ -551,6 +896,19 @@ static void surface_remove_multisample_buffer(qu_surface_obj *surface)
     CHECK_GL(ext.glDeleteRenderbuffers(1, &ms_color));
 }
 
+// Framebuffer of the bound surface is bound again after it's changed
+// outside of apply_surface().
+static void restore_bound_surface(void)
+{
+    GLuint fbo = 0;
+
+    if (priv.bound_surface) {
+        fbo = priv.bound_surface->priv[priv.bound_surface->sample_count > 1 ? 2 : 0];
+    }
+
+    CHECK_GL(ext.glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+}
+
 //------------------------------------------------------------------------------
 
 static bool gl3_query(void)
@@ -597,6 +955,8 @@ static void gl3_initialize(void)
 
     priv.used_program = -1;
 
+    CHECK_GL(ext.glGenBuffers(1, &priv.index_buffer));
+
     for (int i = 0; i < QU_TOTAL_VERTEX_FORMATS; i++) {
         struct vertex_format_info *format = &priv.vertex_formats[i];
 
@@ -604,28 +964,57 @@ static void gl3_initialize(void)
         CHECK_GL(ext.glGenBuffers(1, &format->buffer));
 
         CHECK_GL(ext.glBindVertexArray(format->array));
+        CHECK_GL(ext.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, priv.index_buffer));
 
         for (int j = 0; j < QU_TOTAL_VERTEX_ATTRIBUTES; j++) {
             if (vertex_format_desc[i].attributes & (1 << j)) {
                 CHECK_GL(ext.glEnableVertexAttribArray(j));
+                CHECK_GL(ext.glVertexAttribDivisor(j, vertex_format_desc[i].divisor));
             }
         }
     }
 
+    // Formats without per-vertex color read this value instead.
+    CHECK_GL(ext.glVertexAttrib4f(QU_VERTEX_ATTRIBUTE_COLOR, 1.f, 1.f, 1.f, 1.f));
+
     QU_LOGI("GL_VENDOR: %s\n", glGetString(GL_VENDOR));
     QU_LOGI("GL_RENDERER: %s\n", glGetString(GL_RENDERER));
     QU_LOGI("GL_VERSION: %s\n", glGetString(GL_VERSION));
 
+    priv.features = QU_RENDERER_FEATURE_BIT_INSTANCING | QU_RENDERER_FEATURE_BIT_GPU_TIMERS;
+
+    if (check_extension("GL_EXT_texture_compression_s3tc")) {
+        priv.features |= QU_RENDERER_FEATURE_BIT_BC1 | QU_RENDERER_FEATURE_BIT_BC3;
+        QU_LOGI("GL_EXT_texture_compression_s3tc is supported.\n");
+    }
+
+    if (check_extension("GL_ARB_texture_compression_bptc")) {
+        priv.features |= QU_RENDERER_FEATURE_BIT_BC7;
+        QU_LOGI("GL_ARB_texture_compression_bptc is supported.\n");
+    }
+
     QU_LOGI("Initialized.\n");
 }
 
 static void gl3_terminate(void)
 {
+    if (priv.timers_enabled) {
+        timer_end();
+
+        for (int i = 0; i < TIMER_FRAMES; i++) {
+            ext.glDeleteQueries(QU_MAX_GPU_TIMERS, priv.timer_frames[i].queries);
+        }
+    }
+
     for (int i = 0; i < QU_TOTAL_VERTEX_FORMATS; i++) {
+        stream_release(&priv.vertex_formats[i]);
+
         ext.glDeleteVertexArrays(1, &priv.vertex_formats[i].array);
         ext.glDeleteBuffers(1, &priv.vertex_formats[i].buffer);
     }
 
+    ext.glDeleteBuffers(1, &priv.index_buffer);
+
     for (int i = 0; i < QU_TOTAL_BRUSHES; i++) {
         ext.glDeleteProgram(priv.programs[i].id);
     }
@@ -633,34 +1022,69 @@ static void gl3_terminate(void)
     QU_LOGI("Terminated.\n");
 }
 
+static unsigned int gl3_query_features(void)
+{
+    return priv.features;
+}
+
 static void gl3_upload_vertex_data(qu_vertex_format vertex_format, float const *data, size_t size)
 {
     struct vertex_format_info *info = &priv.vertex_formats[vertex_format];
 
+    GLsizeiptr stride = sizeof(float) * vertex_format_desc[vertex_format].stride;
+    GLsizeiptr bytes = sizeof(float) * size;
+
     CHECK_GL(ext.glBindBuffer(GL_ARRAY_BUFFER, info->buffer));
 
-    if (size < info->buffer_size) {
-        CHECK_GL(ext.glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * size, data));
-        return;
+    stream_fence_pending(info);
+
+    if (info->buffer_size < bytes) {
+        // Old storage is orphaned and stays alive until
+        // the draw calls that use it are finished.
+        stream_release(info);
+
+        info->buffer_size = QU_MAX(2 * info->buffer_size, STREAM_FRAMES * bytes);
+        CHECK_GL(ext.glBufferData(GL_ARRAY_BUFFER, info->buffer_size, NULL, GL_STREAM_DRAW));
+
+        CHECK_GL(ext.glBindVertexArray(info->array));
+        vertex_format_set_base(vertex_format, 0);
+
+        // Restore vertex array of the format that is currently in use.
+        CHECK_GL(ext.glBindVertexArray(priv.vertex_formats[priv.vertex_format].array));
     }
 
-    CHECK_GL(ext.glBufferData(GL_ARRAY_BUFFER, sizeof(float) * size, data, GL_STREAM_DRAW));
+    // Offset should be a multiple of vertex size, so that
+    // the region can be addressed with base vertex.
+    GLintptr offset = ((info->stream_offset + stride - 1) / stride) * stride;
 
-    CHECK_GL(ext.glBindVertexArray(info->array));
+    if (offset + bytes > info->buffer_size) {
+        offset = 0;
+    }
 
-    unsigned int offset = 0;
+    stream_wait_range(info, offset, offset + bytes);
 
-    for (int i = 0; i < QU_TOTAL_VERTEX_ATTRIBUTES; i++) {
-        if (vertex_format_desc[vertex_format].attributes & (1 << i)) {
-            GLsizei size = vertex_attribute_desc[i].size;
-            GLsizei stride = sizeof(float) * vertex_format_desc[vertex_format].stride;
+    void *dst = ext.glMapBufferRange(GL_ARRAY_BUFFER, offset, bytes,
+                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
 
-            CHECK_GL(ext.glVertexAttribPointer(i, size, GL_FLOAT, GL_FALSE, stride, (void *) (intptr_t) offset));
-            offset += sizeof(float) * size;
-        }
+    if (dst) {
+        memcpy(dst, data, bytes);
+        CHECK_GL(ext.glUnmapBuffer(GL_ARRAY_BUFFER));
+    } else {
+        CHECK_GL(ext.glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, data));
     }
 
-    info->buffer_size = size;
+    info->stream_offset = offset + bytes;
+    info->stream_base = (unsigned int) (offset / stride);
+    info->pending.begin = offset;
+    info->pending.end = offset + bytes;
+}
+
+static void gl3_upload_index_data(uint16_t const *data, size_t size)
+{
+    // Element array buffer binding is a part of vertex array state,
+    // and all vertex arrays share the same index buffer.
+    CHECK_GL(ext.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, priv.index_buffer));
+    CHECK_GL(ext.glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * size, data, GL_STATIC_DRAW));
 }
 
 static void gl3_apply_projection(qu_mat4 const *projection)
@@ -709,6 +1133,12 @@ static void gl3_apply_surface(qu_surface_obj const *surface)
         return;
     }
 
+    // Resolve above is accounted to the previous surface.
+    if (priv.timers_enabled) {
+        timer_end();
+        timer_begin(surface->id);
+    }
+
     GLsizei width = surface->texture.width;
     GLsizei height = surface->texture.height;
 
@@ -769,6 +1199,7 @@ static void gl3_apply_vertex_format(qu_vertex_format vertex_format)
     struct vertex_format_info *info = &priv.vertex_formats[vertex_format];
 
     CHECK_GL(ext.glBindVertexArray(info->array));
+    priv.vertex_format = vertex_format;
 }
 
 static void gl3_apply_blend_mode(qu_blend_mode mode)
@@ -797,9 +1228,45 @@ static void gl3_exec_clear(void)
 
 static void gl3_exec_draw(qu_render_mode render_mode, unsigned int first_vertex, unsigned int total_vertices)
 {
+    first_vertex += priv.vertex_formats[priv.vertex_format].stream_base;
+
     CHECK_GL(glDrawArrays(mode_map[render_mode], (GLint) first_vertex, (GLsizei) total_vertices));
 }
 
+static void gl3_exec_draw_indexed(qu_render_mode render_mode, unsigned int first_vertex,
+                                  unsigned int first_index, unsigned int total_indices)
+{
+    first_vertex += priv.vertex_formats[priv.vertex_format].stream_base;
+
+    CHECK_GL(ext.glDrawElementsBaseVertex(mode_map[render_mode], (GLsizei) total_indices, GL_UNSIGNED_SHORT,
+                                          (void *) (intptr_t) (sizeof(uint16_t) * first_index),
+                                          (GLint) first_vertex));
+}
+
+static void gl3_exec_draw_instanced(qu_render_mode render_mode, unsigned int total_vertices,
+                                    unsigned int first_instance, unsigned int total_instances)
+{
+    first_instance += priv.vertex_formats[priv.vertex_format].stream_base;
+
+    if (priv.vertex_formats[priv.vertex_format].base_vertex != first_instance) {
+        vertex_format_set_base(priv.vertex_format, first_instance);
+    }
+
+    CHECK_GL(ext.glDrawArraysInstanced(mode_map[render_mode], 0, (GLsizei) total_vertices,
+                                       (GLsizei) total_instances));
+}
+
+// Texture should be bound.
+static void gl3_update_texture_mipmaps(qu_texture_obj const *texture)
+{
+    if (texture->mipmaps) {
+        CHECK_GL(ext.glGenerateMipmap(GL_TEXTURE_2D));
+        CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+    } else {
+        CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    }
+}
+
 static void gl3_load_texture(qu_texture_obj *texture)
 {
     GLuint id = texture->priv[0];
@@ -811,20 +1278,36 @@ static void gl3_load_texture(qu_texture_obj *texture)
 
     CHECK_GL(glBindTexture(GL_TEXTURE_2D, id));
 
-    GLenum internal_format = texture_format_map[texture->channels - 1][0];
-    GLenum format = texture_format_map[texture->channels - 1][1];
-
-    CHECK_GL(glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        internal_format,
-        texture->width,
-        texture->height,
-        0,
-        format,
-        GL_UNSIGNED_BYTE,
-        texture->pixels
-    ));
+    if (texture->compression) {
+        GLsizei size = (GLsizei) qu_get_compressed_image_size(texture->compression,
+                                                              texture->width, texture->height);
+
+        CHECK_GL(ext.glCompressedTexImage2D(
+            GL_TEXTURE_2D,
+            0,
+            compressed_format_map[texture->compression],
+            texture->width,
+            texture->height,
+            0,
+            size,
+            texture->pixels
+        ));
+    } else {
+        GLenum internal_format = texture_format_map[texture->channels - 1][0];
+        GLenum format = texture_format_map[texture->channels - 1][1];
+
+        CHECK_GL(glTexImage2D(
+            GL_TEXTURE_2D,
+            0,
+            internal_format,
+            texture->width,
+            texture->height,
+            0,
+            format,
+            GL_UNSIGNED_BYTE,
+            texture->pixels
+        ));
+    }
 
     if (texture->smooth) {
         CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
@@ -832,7 +1315,7 @@ static void gl3_load_texture(qu_texture_obj *texture)
         CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
     }
 
-    CHECK_GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    gl3_update_texture_mipmaps(texture);
 
     GLenum const *swizzle = texture_swizzle_map[texture->channels - 1];
 
@@ -848,6 +1331,41 @@ static void gl3_load_texture(qu_texture_obj *texture)
     }
 }
 
+static void gl3_update_texture_region(qu_texture_obj *texture, int x, int y, int w, int h,
+                                   unsigned char const *pixels)
+{
+    GLuint id = texture->priv[0];
+
+    if (id == 0) {
+        gl3_load_texture(texture);
+        return;
+    }
+
+    CHECK_GL(glBindTexture(GL_TEXTURE_2D, id));
+
+    // Otherwise source rectangle is picked from the full pixel array.
+    if (!pixels) {
+        CHECK_GL(glPixelStorei(GL_UNPACK_ROW_LENGTH, texture->width));
+        CHECK_GL(glPixelStorei(GL_UNPACK_SKIP_PIXELS, x));
+        CHECK_GL(glPixelStorei(GL_UNPACK_SKIP_ROWS, y));
+        pixels = texture->pixels;
+    }
+
+    GLenum format = texture_format_map[texture->channels - 1][1];
+
+    CHECK_GL(glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, format, GL_UNSIGNED_BYTE, pixels));
+
+    CHECK_GL(glPixelStorei(GL_UNPACK_ROW_LENGTH, 0));
+    CHECK_GL(glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0));
+    CHECK_GL(glPixelStorei(GL_UNPACK_SKIP_ROWS, 0));
+
+    if (priv.bound_texture) {
+        CHECK_GL(glBindTexture(GL_TEXTURE_2D, priv.bound_texture->priv[0]));
+    } else {
+        CHECK_GL(glBindTexture(GL_TEXTURE_2D, 0));
+    }
+}
+
 static void gl3_unload_texture(qu_texture_obj *texture)
 {
     GLuint id = (GLuint) texture->priv[0];
@@ -876,6 +1394,22 @@ static void gl3_set_texture_smooth(qu_texture_obj *data, bool smooth)
     }
 }
 
+static void gl3_set_texture_mipmaps(qu_texture_obj *texture, bool mipmaps)
+{
+    GLuint id = (GLuint) texture->priv[0];
+
+    CHECK_GL(glBindTexture(GL_TEXTURE_2D, id));
+
+    texture->mipmaps = mipmaps;
+    gl3_update_texture_mipmaps(texture);
+
+    if (priv.bound_texture) {
+        CHECK_GL(glBindTexture(GL_TEXTURE_2D, priv.bound_texture->priv[0]));
+    } else {
+        CHECK_GL(glBindTexture(GL_TEXTURE_2D, 0));
+    }
+}
+
 static void gl3_create_surface(qu_surface_obj *surface)
 {
     GLsizei width = surface->texture.width;
@@ -924,11 +1458,7 @@ static void gl3_create_surface(qu_surface_obj *surface)
         surface_add_multisample_buffer(surface);
     }
 
-    if (priv.bound_surface) {
-        CHECK_GL(ext.glBindFramebuffer(GL_FRAMEBUFFER, priv.bound_surface->priv[0]));
-    } else {
-        CHECK_GL(ext.glBindFramebuffer(GL_FRAMEBUFFER, 0));
-    }
+    restore_bound_surface();
 
     if (priv.bound_texture) {
         CHECK_GL(glBindTexture(GL_TEXTURE_2D, priv.bound_texture->priv[0]));
@@ -963,6 +1493,63 @@ static void gl3_set_surface_antialiasing_level(qu_surface_obj *surface, int leve
     if (surface->sample_count > 1) {
         surface_add_multisample_buffer(surface);
     }
+
+    restore_bound_surface();
+}
+
+static void gl3_enable_gpu_timers(void)
+{
+    if (priv.timers_enabled) {
+        return;
+    }
+
+    for (int i = 0; i < TIMER_FRAMES; i++) {
+        CHECK_GL(ext.glGenQueries(QU_MAX_GPU_TIMERS, priv.timer_frames[i].queries));
+    }
+
+    priv.timers_enabled = true;
+
+    if (priv.bound_surface) {
+        timer_begin(priv.bound_surface->id);
+    }
+}
+
+static bool gl3_end_gpu_frame(qu_gpu_timings *timings)
+{
+    if (!priv.timers_enabled) {
+        return false;
+    }
+
+    timer_end();
+    priv.pending_timer_frames++;
+
+    bool collected = false;
+
+    // Collect every finished frame, keeping the most recent one.
+    while (priv.pending_timer_frames > 0) {
+        int oldest = (priv.timer_frame + TIMER_FRAMES - priv.pending_timer_frames + 1) % TIMER_FRAMES;
+
+        if (!timer_read_frame(&priv.timer_frames[oldest], timings)) {
+            break;
+        }
+
+        priv.pending_timer_frames--;
+        collected = true;
+    }
+
+    if (priv.pending_timer_frames == TIMER_FRAMES) {
+        priv.pending_timer_frames--;
+    }
+
+    priv.timer_frame = (priv.timer_frame + 1) % TIMER_FRAMES;
+    priv.timer_frames[priv.timer_frame].total_queries = 0;
+
+    // Next frame starts on the same surface.
+    if (priv.bound_surface) {
+        timer_begin(priv.bound_surface->id);
+    }
+
+    return collected;
 }
 
 //------------------------------------------------------------------------------
@@ -971,7 +1558,9 @@ qu_renderer_impl const qu_gl3_renderer_impl = {
     .query = gl3_query,
     .initialize = gl3_initialize,
     .terminate = gl3_terminate,
+    .query_features = gl3_query_features,
     .upload_vertex_data = gl3_upload_vertex_data,
+    .upload_index_data = gl3_upload_index_data,
     .apply_projection = gl3_apply_projection,
     .apply_transform = gl3_apply_transform,
     .apply_surface = gl3_apply_surface,
@@ -984,10 +1573,16 @@ qu_renderer_impl const qu_gl3_renderer_impl = {
     .exec_resize = gl3_exec_resize,
     .exec_clear = gl3_exec_clear,
     .exec_draw = gl3_exec_draw,
+    .exec_draw_indexed = gl3_exec_draw_indexed,
+    .exec_draw_instanced = gl3_exec_draw_instanced,
     .load_texture = gl3_load_texture,
+    .update_texture_region = gl3_update_texture_region,
     .unload_texture = gl3_unload_texture,
     .set_texture_smooth = gl3_set_texture_smooth,
+    .set_texture_mipmaps = gl3_set_texture_mipmaps,
     .create_surface = gl3_create_surface,
     .destroy_surface = gl3_destroy_surface,
     .set_surface_antialiasing_level = gl3_set_surface_antialiasing_level,
+    .enable_gpu_timers = gl3_enable_gpu_timers,
+    .end_gpu_frame = gl3_end_gpu_frame,
 };
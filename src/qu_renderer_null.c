@@ -38,10 +38,19 @@ static void terminate(void)
     QU_LOGI("Terminated.\n");
 }
 
+static unsigned int query_features(void)
+{
+    return 0;
+}
+
 static void upload_vertex_data(qu_vertex_format format, float const *data, size_t size)
 {
 }
 
+static void upload_index_data(uint16_t const *data, size_t size)
+{
+}
+
 static void apply_projection(qu_mat4 const *projection)
 {
 }
@@ -90,10 +99,25 @@ static void exec_draw(qu_render_mode mode, unsigned int first_vertex, unsigned i
 {
 }
 
+static void exec_draw_indexed(qu_render_mode mode, unsigned int first_vertex,
+                              unsigned int first_index, unsigned int total_indices)
+{
+}
+
+static void exec_draw_instanced(qu_render_mode mode, unsigned int total_vertices,
+                                unsigned int first_instance, unsigned int total_instances)
+{
+}
+
 static void load_texture(qu_texture_obj *texture)
 {
 }
 
+static void update_texture_region(qu_texture_obj *texture, int x, int y, int w, int h,
+                                  unsigned char const *pixels)
+{
+}
+
 static void unload_texture(qu_texture_obj *texture)
 {
 }
@@ -102,6 +126,10 @@ static void set_texture_smooth(qu_texture_obj *texture, bool smooth)
 {
 }
 
+static void set_texture_mipmaps(qu_texture_obj *texture, bool mipmaps)
+{
+}
+
 static void create_surface(qu_surface_obj *surface)
 {
 }
@@ -114,13 +142,24 @@ static void set_surface_antialiasing_level(qu_surface_obj *surface, int level)
 {
 }
 
+static void enable_gpu_timers(void)
+{
+}
+
+static bool end_gpu_frame(qu_gpu_timings *timings)
+{
+    return false;
+}
+
 //------------------------------------------------------------------------------
 
 qu_renderer_impl const qu_null_renderer_impl = {
     .query = query,
     .initialize = initialize,
     .terminate = terminate,
+    .query_features = query_features,
     .upload_vertex_data = upload_vertex_data,
+    .upload_index_data = upload_index_data,
     .apply_projection = apply_projection,
     .apply_transform = apply_transform,
     .apply_surface = apply_surface,
@@ -133,10 +172,16 @@ qu_renderer_impl const qu_null_renderer_impl = {
     .exec_resize = exec_resize,
 	.exec_clear = exec_clear,
 	.exec_draw = exec_draw,
+	.exec_draw_indexed = exec_draw_indexed,
+	.exec_draw_instanced = exec_draw_instanced,
     .load_texture = load_texture,
+    .update_texture_region = update_texture_region,
     .unload_texture = unload_texture,
     .set_texture_smooth = set_texture_smooth,
+    .set_texture_mipmaps = set_texture_mipmaps,
     .create_surface = create_surface,
     .destroy_surface = destroy_surface,
     .set_surface_antialiasing_level = set_surface_antialiasing_level,
+    .enable_gpu_timers = enable_gpu_timers,
+    .end_gpu_frame = end_gpu_frame,
 };
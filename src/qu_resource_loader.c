@@ -89,6 +89,763 @@ static void stbi_loader_close(qu_image_loader *loader)
 {
 }
 
+//------------------------------------------------------------------------------
+// Block compression: BC1, BC3, BC7
+
+static unsigned int read_u16le(unsigned char const *bytes)
+{
+    return bytes[0] | (bytes[1] << 8);
+}
+
+static uint32_t read_u32le(unsigned char const *bytes)
+{
+    return (uint32_t) bytes[0] | ((uint32_t) bytes[1] << 8)
+        | ((uint32_t) bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+}
+
+static uint64_t read_u64le(unsigned char const *bytes)
+{
+    return (uint64_t) read_u32le(bytes) | ((uint64_t) read_u32le(bytes + 4) << 32);
+}
+
+static int const block_sizes[QU_TOTAL_IMAGE_COMPRESSIONS] = {
+    [QU_IMAGE_COMPRESSION_BC1] = 8,
+    [QU_IMAGE_COMPRESSION_BC3] = 16,
+    [QU_IMAGE_COMPRESSION_BC7] = 16,
+};
+
+static void bc1_unpack_color(unsigned int color, unsigned char *rgba)
+{
+    unsigned int r = (color >> 11) & 31;
+    unsigned int g = (color >> 5) & 63;
+    unsigned int b = color & 31;
+
+    rgba[0] = (unsigned char) ((r << 3) | (r >> 2));
+    rgba[1] = (unsigned char) ((g << 2) | (g >> 4));
+    rgba[2] = (unsigned char) ((b << 3) | (b >> 2));
+    rgba[3] = 255;
+}
+
+// BC3 color block always uses four colors.
+static void bc1_decode_block(unsigned char const *block, unsigned char *texels, bool bc3)
+{
+    unsigned char palette[4][4];
+
+    unsigned int c0 = read_u16le(block);
+    unsigned int c1 = read_u16le(block + 2);
+    uint32_t indices = read_u32le(block + 4);
+
+    bc1_unpack_color(c0, palette[0]);
+    bc1_unpack_color(c1, palette[1]);
+
+    for (int c = 0; c < 3; c++) {
+        if (c0 > c1 || bc3) {
+            palette[2][c] = (unsigned char) ((2 * palette[0][c] + palette[1][c]) / 3);
+            palette[3][c] = (unsigned char) ((palette[0][c] + 2 * palette[1][c]) / 3);
+        } else {
+            palette[2][c] = (unsigned char) ((palette[0][c] + palette[1][c]) / 2);
+            palette[3][c] = 0;
+        }
+    }
+
+    palette[2][3] = 255;
+    palette[3][3] = (c0 > c1 || bc3) ? 255 : 0;
+
+    for (int i = 0; i < 16; i++) {
+        memcpy(&texels[4 * i], palette[(indices >> (2 * i)) & 3], 4);
+    }
+}
+
+static void bc3_decode_block(unsigned char const *block, unsigned char *texels)
+{
+    unsigned char alpha[8];
+
+    alpha[0] = block[0];
+    alpha[1] = block[1];
+
+    if (alpha[0] > alpha[1]) {
+        for (int i = 1; i < 7; i++) {
+            alpha[i + 1] = (unsigned char) (((7 - i) * alpha[0] + i * alpha[1]) / 7);
+        }
+    } else {
+        for (int i = 1; i < 5; i++) {
+            alpha[i + 1] = (unsigned char) (((5 - i) * alpha[0] + i * alpha[1]) / 5);
+        }
+
+        alpha[6] = 0;
+        alpha[7] = 255;
+    }
+
+    uint64_t indices = read_u64le(block) >> 16;
+
+    bc1_decode_block(block + 8, texels, true);
+
+    for (int i = 0; i < 16; i++) {
+        texels[4 * i + 3] = alpha[(indices >> (3 * i)) & 7];
+    }
+}
+
+struct bc7_mode
+{
+    int subsets;
+    int partition_bits;
+    int rotation_bits;
+    int index_selection_bits;
+    int color_bits;
+    int alpha_bits;
+    int endpoint_pbits;
+    int shared_pbits;
+    int index_bits;
+    int secondary_index_bits;
+};
+
+static struct bc7_mode const bc7_modes[8] = {
+    { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+    { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+    { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+    { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+    { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+    { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+    { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+    { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+};
+
+// Bit N is set if texel N belongs to the second subset.
+static uint16_t const bc7_partitions2[64] = {
+    0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+    0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+    0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+    0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+    0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+    0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+    0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+    0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+};
+
+static unsigned char const bc7_partitions3[64][16] = {
+    { 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 1, 2, 2, 2, 2 },
+    { 0, 0, 0, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 2, 1 },
+    { 0, 0, 0, 0, 2, 0, 0, 1, 2, 2, 1, 1, 2, 2, 1, 1 },
+    { 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 1, 0, 1, 1, 1 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2 },
+    { 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 2, 2 },
+    { 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1 },
+    { 0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2 },
+    { 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2 },
+    { 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2 },
+    { 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2 },
+    { 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2 },
+    { 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2 },
+    { 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2, 1, 2, 2, 2 },
+    { 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0, 2, 2, 2, 0 },
+    { 0, 0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2 },
+    { 0, 1, 1, 1, 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0 },
+    { 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2 },
+    { 0, 0, 2, 2, 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1 },
+    { 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2, 0, 2, 2, 2 },
+    { 0, 0, 0, 1, 0, 0, 0, 1, 2, 2, 2, 1, 2, 2, 2, 1 },
+    { 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2 },
+    { 0, 0, 0, 0, 1, 1, 0, 0, 2, 2, 1, 0, 2, 2, 1, 0 },
+    { 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1, 0, 0, 0, 0 },
+    { 0, 0, 1, 2, 0, 0, 1, 2, 1, 1, 2, 2, 2, 2, 2, 2 },
+    { 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1, 0, 1, 1, 0 },
+    { 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1 },
+    { 0, 0, 2, 2, 1, 1, 0, 2, 1, 1, 0, 2, 0, 0, 2, 2 },
+    { 0, 1, 1, 0, 0, 1, 1, 0, 2, 0, 0, 2, 2, 2, 2, 2 },
+    { 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1 },
+    { 0, 0, 0, 0, 2, 0, 0, 0, 2, 2, 1, 1, 2, 2, 2, 1 },
+    { 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 2, 2, 2 },
+    { 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 2, 0, 0, 1, 1 },
+    { 0, 0, 1, 1, 0, 0, 1, 2, 0, 0, 2, 2, 0, 2, 2, 2 },
+    { 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0 },
+    { 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0 },
+    { 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0 },
+    { 0, 1, 2, 0, 2, 0, 1, 2, 1, 2, 0, 1, 0, 1, 2, 0 },
+    { 0, 0, 1, 1, 2, 2, 0, 0, 1, 1, 2, 2, 0, 0, 1, 1 },
+    { 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0, 1, 1 },
+    { 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1 },
+    { 0, 0, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2, 1, 1, 2, 2 },
+    { 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 1, 1 },
+    { 0, 2, 2, 0, 1, 2, 2, 1, 0, 2, 2, 0, 1, 2, 2, 1 },
+    { 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 0, 1, 0, 1 },
+    { 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1 },
+    { 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2 },
+    { 0, 2, 2, 2, 0, 1, 1, 1, 0, 2, 2, 2, 0, 1, 1, 1 },
+    { 0, 0, 0, 2, 1, 1, 1, 2, 0, 0, 0, 2, 1, 1, 1, 2 },
+    { 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2 },
+    { 0, 2, 2, 2, 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2 },
+    { 0, 0, 0, 2, 1, 1, 1, 2, 1, 1, 1, 2, 0, 0, 0, 2 },
+    { 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2 },
+    { 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2, 2, 2, 2, 2 },
+    { 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2 },
+    { 0, 0, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2 },
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2 },
+    { 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 1 },
+    { 0, 2, 2, 2, 1, 2, 2, 2, 0, 2, 2, 2, 1, 2, 2, 2 },
+    { 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2 },
+    { 0, 1, 1, 1, 2, 0, 1, 1, 2, 2, 0, 1, 2, 2, 2, 0 },
+};
+
+// Index of the first texel of the second subset.
+static unsigned char const bc7_anchors2[64] = {
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+    15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+     6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+};
+
+// Anchor texels of the second and the third subsets.
+static unsigned char const bc7_anchors3[2][64] = {
+    {
+         3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+         3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+         8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+         3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3,
+    },
+    {
+        15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+        15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+        15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+        15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8,
+    },
+};
+
+static unsigned char const bc7_weights2[4] = { 0, 21, 43, 64 };
+static unsigned char const bc7_weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static unsigned char const bc7_weights4[16] = {
+    0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64,
+};
+
+static unsigned char const *const bc7_weights[5] = {
+    [2] = bc7_weights2,
+    [3] = bc7_weights3,
+    [4] = bc7_weights4,
+};
+
+static unsigned int bc7_read_bits(unsigned char const *block, int *position, int count)
+{
+    unsigned int value = 0;
+
+    for (int i = 0; i < count; i++, (*position)++) {
+        value |= ((block[*position >> 3] >> (*position & 7)) & 1u) << i;
+    }
+
+    return value;
+}
+
+static unsigned char bc7_expand_bits(unsigned int value, int bits)
+{
+    value <<= (8 - bits);
+    return (unsigned char) (value | (value >> bits));
+}
+
+static int bc7_get_subset(int subsets, int partition, int texel)
+{
+    if (subsets == 2) {
+        return (bc7_partitions2[partition] >> texel) & 1;
+    }
+
+    if (subsets == 3) {
+        return bc7_partitions3[partition][texel];
+    }
+
+    return 0;
+}
+
+static bool bc7_is_anchor(int subsets, int partition, int texel)
+{
+    if (texel == 0) {
+        return true;
+    }
+
+    if (subsets == 2) {
+        return texel == bc7_anchors2[partition];
+    }
+
+    if (subsets == 3) {
+        return texel == bc7_anchors3[0][partition] || texel == bc7_anchors3[1][partition];
+    }
+
+    return false;
+}
+
+static void bc7_decode_block(unsigned char const *block, unsigned char *texels)
+{
+    int mode = 0;
+
+    while (mode < 8 && !(block[0] & (1 << mode))) {
+        mode++;
+    }
+
+    // Reserved mode, decoded as transparent black.
+    if (mode == 8) {
+        memset(texels, 0, 64);
+        return;
+    }
+
+    struct bc7_mode const *info = &bc7_modes[mode];
+    int position = mode + 1;
+
+    int partition = bc7_read_bits(block, &position, info->partition_bits);
+    int rotation = bc7_read_bits(block, &position, info->rotation_bits);
+    int index_selection = bc7_read_bits(block, &position, info->index_selection_bits);
+
+    unsigned int endpoints[6][4];
+    int total_endpoints = 2 * info->subsets;
+
+    for (int c = 0; c < 3; c++) {
+        for (int e = 0; e < total_endpoints; e++) {
+            endpoints[e][c] = bc7_read_bits(block, &position, info->color_bits);
+        }
+    }
+
+    for (int e = 0; e < total_endpoints; e++) {
+        endpoints[e][3] = bc7_read_bits(block, &position, info->alpha_bits);
+    }
+
+    int color_bits = info->color_bits;
+    int alpha_bits = info->alpha_bits;
+
+    if (info->endpoint_pbits || info->shared_pbits) {
+        int pbits[6];
+
+        for (int e = 0; e < total_endpoints; e++) {
+            if (info->endpoint_pbits || (e % 2) == 0) {
+                pbits[e] = bc7_read_bits(block, &position, 1);
+            } else {
+                pbits[e] = pbits[e - 1];
+            }
+
+            for (int c = 0; c < 4; c++) {
+                endpoints[e][c] = (endpoints[e][c] << 1) | pbits[e];
+            }
+        }
+
+        color_bits++;
+        alpha_bits += alpha_bits ? 1 : 0;
+    }
+
+    unsigned char colors[6][4];
+
+    for (int e = 0; e < total_endpoints; e++) {
+        for (int c = 0; c < 3; c++) {
+            colors[e][c] = bc7_expand_bits(endpoints[e][c], color_bits);
+        }
+
+        colors[e][3] = alpha_bits ? bc7_expand_bits(endpoints[e][3], alpha_bits) : 255;
+    }
+
+    unsigned int indices[2][16];
+
+    for (int i = 0; i < 16; i++) {
+        int bits = info->index_bits;
+
+        if (bc7_is_anchor(info->subsets, partition, i)) {
+            bits--;
+        }
+
+        indices[0][i] = bc7_read_bits(block, &position, bits);
+    }
+
+    if (info->secondary_index_bits) {
+        for (int i = 0; i < 16; i++) {
+            int bits = info->secondary_index_bits - (i == 0 ? 1 : 0);
+            indices[1][i] = bc7_read_bits(block, &position, bits);
+        }
+    }
+
+    for (int i = 0; i < 16; i++) {
+        int subset = bc7_get_subset(info->subsets, partition, i);
+        unsigned char const *e0 = colors[2 * subset];
+        unsigned char const *e1 = colors[2 * subset + 1];
+
+        unsigned char const *color_weights = bc7_weights[info->index_bits];
+        unsigned char const *alpha_weights = bc7_weights[info->index_bits];
+        unsigned int color_index = indices[0][i];
+        unsigned int alpha_index = indices[0][i];
+
+        if (info->secondary_index_bits) {
+            if (index_selection) {
+                color_weights = bc7_weights[info->secondary_index_bits];
+                color_index = indices[1][i];
+            } else {
+                alpha_weights = bc7_weights[info->secondary_index_bits];
+                alpha_index = indices[1][i];
+            }
+        }
+
+        unsigned char *texel = &texels[4 * i];
+
+        for (int c = 0; c < 4; c++) {
+            unsigned int w = (c < 3) ? color_weights[color_index] : alpha_weights[alpha_index];
+            texel[c] = (unsigned char) (((64 - w) * e0[c] + w * e1[c] + 32) >> 6);
+        }
+
+        if (rotation) {
+            unsigned char t = texel[3];
+            texel[3] = texel[rotation - 1];
+            texel[rotation - 1] = t;
+        }
+    }
+}
+
+static void decompress_image(qu_image_compression compression, int width, int height,
+                             unsigned char const *blocks, unsigned char *pixels)
+{
+    int block_size = block_sizes[compression];
+
+    for (int by = 0; by < height; by += 4) {
+        for (int bx = 0; bx < width; bx += 4) {
+            unsigned char texels[64];
+
+            switch (compression) {
+            case QU_IMAGE_COMPRESSION_BC1:
+                bc1_decode_block(blocks, texels, false);
+                break;
+            case QU_IMAGE_COMPRESSION_BC3:
+                bc3_decode_block(blocks, texels);
+                break;
+            case QU_IMAGE_COMPRESSION_BC7:
+                bc7_decode_block(blocks, texels);
+                break;
+            default:
+                memset(texels, 0, sizeof(texels));
+                break;
+            }
+
+            blocks += block_size;
+
+            // Blocks on the right and bottom edges may be incomplete.
+            int w = QU_MIN(4, width - bx);
+            int h = QU_MIN(4, height - by);
+
+            for (int y = 0; y < h; y++) {
+                size_t offset = 4 * ((size_t) (by + y) * width + bx);
+                memcpy(&pixels[offset], &texels[16 * y], 4 * w);
+            }
+        }
+    }
+}
+
+// Returns zero if the size is invalid or doesn't fit in size_t.
+static size_t multiply_sizes(size_t a, size_t b, size_t c)
+{
+    if (a == 0 || b == 0 || c == 0) {
+        return 0;
+    }
+
+    if (a > SIZE_MAX / b || (a * b) > SIZE_MAX / c) {
+        return 0;
+    }
+
+    return a * b * c;
+}
+
+size_t qu_get_pixel_data_size(int width, int height, int channels)
+{
+    if (width <= 0 || height <= 0 || channels <= 0) {
+        return 0;
+    }
+
+    return multiply_sizes((size_t) width, (size_t) height, (size_t) channels);
+}
+
+size_t qu_get_compressed_image_size(qu_image_compression compression, int width, int height)
+{
+    if (compression <= QU_IMAGE_COMPRESSION_NONE || compression >= QU_TOTAL_IMAGE_COMPRESSIONS) {
+        return 0;
+    }
+
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+
+    size_t blocks_x = ((size_t) width + 3) / 4;
+    size_t blocks_y = ((size_t) height + 3) / 4;
+
+    return multiply_sizes(blocks_x, blocks_y, (size_t) block_sizes[compression]);
+}
+
+//------------------------------------------------------------------------------
+// Common part of container formats
+
+struct container
+{
+    int64_t data_offset;
+    size_t data_size;
+};
+
+static qu_result container_load_compressed(qu_image_loader *loader, void *data)
+{
+    struct container *container = loader->context;
+
+    if (loader->compression == QU_IMAGE_COMPRESSION_NONE) {
+        return QU_FAILURE;
+    }
+
+    if (qu_file_seek(loader->file, container->data_offset, SEEK_SET) == -1) {
+        return QU_FAILURE;
+    }
+
+    if (qu_file_read(data, container->data_size, loader->file) != (int64_t) container->data_size) {
+        return QU_FAILURE;
+    }
+
+    return QU_SUCCESS;
+}
+
+static qu_result container_load(qu_image_loader *loader, unsigned char *pixels)
+{
+    struct container *container = loader->context;
+
+    if (loader->compression == QU_IMAGE_COMPRESSION_NONE) {
+        if (qu_file_seek(loader->file, container->data_offset, SEEK_SET) == -1) {
+            return QU_FAILURE;
+        }
+
+        if (qu_file_read(pixels, container->data_size, loader->file) != (int64_t) container->data_size) {
+            return QU_FAILURE;
+        }
+
+        return QU_SUCCESS;
+    }
+
+    unsigned char *blocks = pl_malloc(container->data_size);
+
+    if (!blocks) {
+        return QU_FAILURE;
+    }
+
+    qu_result result = container_load_compressed(loader, blocks);
+
+    if (result == QU_SUCCESS) {
+        decompress_image(loader->compression, loader->width, loader->height, blocks, pixels);
+    }
+
+    pl_free(blocks);
+
+    return result;
+}
+
+static qu_result container_open(qu_image_loader *loader, int64_t data_offset)
+{
+    if (loader->width <= 0 || loader->height <= 0) {
+        return QU_FAILURE;
+    }
+
+    if (loader->width > QU_MAX_IMAGE_DIMENSION || loader->height > QU_MAX_IMAGE_DIMENSION) {
+        QU_LOGE("Image is too large: %dx%d.\n", loader->width, loader->height);
+        return QU_FAILURE;
+    }
+
+    size_t data_size;
+
+    if (loader->compression == QU_IMAGE_COMPRESSION_NONE) {
+        data_size = qu_get_pixel_data_size(loader->width, loader->height, loader->channels);
+    } else {
+        data_size = qu_get_compressed_image_size(loader->compression, loader->width, loader->height);
+
+        // Decompressed image must fit as well.
+        if (!qu_get_pixel_data_size(loader->width, loader->height, 4)) {
+            data_size = 0;
+        }
+    }
+
+    if (data_size == 0) {
+        return QU_FAILURE;
+    }
+
+    struct container *container = pl_calloc(1, sizeof(*container));
+
+    if (!container) {
+        return QU_FAILURE;
+    }
+
+    container->data_offset = data_offset;
+    container->data_size = data_size;
+
+    // Compressed images are always decompressed to RGBA.
+    if (loader->compression != QU_IMAGE_COMPRESSION_NONE) {
+        loader->channels = 4;
+    }
+
+    loader->context = container;
+
+    return QU_SUCCESS;
+}
+
+static void container_close(qu_image_loader *loader)
+{
+    pl_free(loader->context);
+}
+
+//------------------------------------------------------------------------------
+// Image format: DDS
+// Only base level of BC1, BC3 and BC7 textures is loaded.
+
+#define DDS_HEADER_SIZE             128
+#define DDS_DX10_HEADER_SIZE        20
+#define DDSPF_FOURCC                0x4
+
+#define DXGI_FORMAT_BC1_UNORM       71
+#define DXGI_FORMAT_BC1_UNORM_SRGB  72
+#define DXGI_FORMAT_BC3_UNORM       77
+#define DXGI_FORMAT_BC3_UNORM_SRGB  78
+#define DXGI_FORMAT_BC7_UNORM       98
+#define DXGI_FORMAT_BC7_UNORM_SRGB  99
+
+static qu_image_compression dds_get_dxgi_compression(uint32_t format)
+{
+    switch (format) {
+    case DXGI_FORMAT_BC1_UNORM:
+    case DXGI_FORMAT_BC1_UNORM_SRGB:
+        return QU_IMAGE_COMPRESSION_BC1;
+    case DXGI_FORMAT_BC3_UNORM:
+    case DXGI_FORMAT_BC3_UNORM_SRGB:
+        return QU_IMAGE_COMPRESSION_BC3;
+    case DXGI_FORMAT_BC7_UNORM:
+    case DXGI_FORMAT_BC7_UNORM_SRGB:
+        return QU_IMAGE_COMPRESSION_BC7;
+    }
+
+    return QU_IMAGE_COMPRESSION_NONE;
+}
+
+static qu_result dds_loader_open(qu_image_loader *loader)
+{
+    unsigned char header[DDS_HEADER_SIZE];
+
+    qu_file_seek(loader->file, 0, SEEK_SET);
+
+    if (qu_file_read(header, DDS_HEADER_SIZE, loader->file) < DDS_HEADER_SIZE) {
+        return QU_FAILURE;
+    }
+
+    if (memcmp(header, "DDS ", 4) || read_u32le(header + 4) != 124) {
+        return QU_FAILURE;
+    }
+
+    if (!(read_u32le(header + 80) & DDSPF_FOURCC)) {
+        return QU_FAILURE;
+    }
+
+    int64_t data_offset = DDS_HEADER_SIZE;
+    unsigned char const *fourcc = header + 84;
+
+    if (!memcmp(fourcc, "DXT1", 4)) {
+        loader->compression = QU_IMAGE_COMPRESSION_BC1;
+    } else if (!memcmp(fourcc, "DXT5", 4)) {
+        loader->compression = QU_IMAGE_COMPRESSION_BC3;
+    } else if (!memcmp(fourcc, "DX10", 4)) {
+        unsigned char dx10[DDS_DX10_HEADER_SIZE];
+
+        if (qu_file_read(dx10, DDS_DX10_HEADER_SIZE, loader->file) < DDS_DX10_HEADER_SIZE) {
+            return QU_FAILURE;
+        }
+
+        loader->compression = dds_get_dxgi_compression(read_u32le(dx10));
+        data_offset += DDS_DX10_HEADER_SIZE;
+    }
+
+    if (loader->compression == QU_IMAGE_COMPRESSION_NONE) {
+        QU_LOGE("Unsupported DDS pixel format.\n");
+        return QU_FAILURE;
+    }
+
+    loader->height = (int) read_u32le(header + 12);
+    loader->width = (int) read_u32le(header + 16);
+
+    return container_open(loader, data_offset);
+}
+
+//------------------------------------------------------------------------------
+// Image format: KTX2
+// Only base level of non-supercompressed textures is loaded.
+
+#define KTX2_HEADER_SIZE            104
+
+#define VK_FORMAT_R8_UNORM          9
+#define VK_FORMAT_R8G8_UNORM        16
+#define VK_FORMAT_R8G8B8_UNORM      23
+#define VK_FORMAT_R8G8B8A8_UNORM    37
+#define VK_FORMAT_BC1_RGB_UNORM     131
+#define VK_FORMAT_BC1_RGB_SRGB      132
+#define VK_FORMAT_BC1_RGBA_UNORM    133
+#define VK_FORMAT_BC1_RGBA_SRGB     134
+#define VK_FORMAT_BC3_UNORM         137
+#define VK_FORMAT_BC3_SRGB          138
+#define VK_FORMAT_BC7_UNORM         145
+#define VK_FORMAT_BC7_SRGB          146
+
+static unsigned char const ktx2_identifier[12] = {
+    0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n',
+};
+
+static qu_result ktx2_loader_open(qu_image_loader *loader)
+{
+    unsigned char header[KTX2_HEADER_SIZE];
+
+    qu_file_seek(loader->file, 0, SEEK_SET);
+
+    if (qu_file_read(header, KTX2_HEADER_SIZE, loader->file) < KTX2_HEADER_SIZE) {
+        return QU_FAILURE;
+    }
+
+    if (memcmp(header, ktx2_identifier, sizeof(ktx2_identifier))) {
+        return QU_FAILURE;
+    }
+
+    uint32_t vk_format = read_u32le(header + 12);
+
+    switch (vk_format) {
+    case VK_FORMAT_R8_UNORM:
+        loader->channels = 1;
+        break;
+    case VK_FORMAT_R8G8_UNORM:
+        loader->channels = 2;
+        break;
+    case VK_FORMAT_R8G8B8_UNORM:
+        loader->channels = 3;
+        break;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+        loader->channels = 4;
+        break;
+    case VK_FORMAT_BC1_RGB_UNORM:
+    case VK_FORMAT_BC1_RGB_SRGB:
+    case VK_FORMAT_BC1_RGBA_UNORM:
+    case VK_FORMAT_BC1_RGBA_SRGB:
+        loader->compression = QU_IMAGE_COMPRESSION_BC1;
+        break;
+    case VK_FORMAT_BC3_UNORM:
+    case VK_FORMAT_BC3_SRGB:
+        loader->compression = QU_IMAGE_COMPRESSION_BC3;
+        break;
+    case VK_FORMAT_BC7_UNORM:
+    case VK_FORMAT_BC7_SRGB:
+        loader->compression = QU_IMAGE_COMPRESSION_BC7;
+        break;
+    default:
+        QU_LOGE("Unsupported KTX2 format: %u.\n", (unsigned int) vk_format);
+        return QU_FAILURE;
+    }
+
+    if (read_u32le(header + 44) != 0) {
+        QU_LOGE("Supercompressed KTX2 textures are not supported.\n");
+        return QU_FAILURE;
+    }
+
+    loader->width = (int) read_u32le(header + 20);
+    loader->height = (int) read_u32le(header + 24);
+
+    // First entry of the level index describes the base level.
+    int64_t data_offset = (int64_t) read_u64le(header + 80);
+
+    return container_open(loader, data_offset);
+}
+
 //------------------------------------------------------------------------------
 // Image loader
 
@@ -97,9 +854,22 @@ struct image_loader_callbacks
     qu_result (*open)(qu_image_loader *loader);
     void (*close)(qu_image_loader *loader);
     qu_result (*load)(qu_image_loader *loader, unsigned char *pixels);
+    qu_result (*load_compressed)(qu_image_loader *loader, void *data);
 };
 
 static struct image_loader_callbacks const image_loader_callbacks[] = {
+    [QU_IMAGE_LOADER_DDS] = {
+        .open = dds_loader_open,
+        .load = container_load,
+        .load_compressed = container_load_compressed,
+        .close = container_close,
+    },
+    [QU_IMAGE_LOADER_KTX2] = {
+        .open = ktx2_loader_open,
+        .load = container_load,
+        .load_compressed = container_load_compressed,
+        .close = container_close,
+    },
     [QU_IMAGE_LOADER_STBI] = {
         .open = stbi_loader_open,
         .load = stbi_loader_load,
@@ -114,6 +884,8 @@ qu_image_loader *qu_open_image_loader(qu_file *file)
     loader->file = file;
 
     for (int i = 0; i < QU_TOTAL_IMAGE_LOADERS; i++) {
+        loader->compression = QU_IMAGE_COMPRESSION_NONE;
+
         if (image_loader_callbacks[i].open(loader) == QU_SUCCESS) {
             loader->format = i;
             return loader;
@@ -136,6 +908,15 @@ int qu_image_loader_load(struct qu_image_loader *loader, unsigned char *pixels)
     return image_loader_callbacks[loader->format].load(loader, pixels);
 }
 
+qu_result qu_image_loader_load_compressed(qu_image_loader *loader, void *data)
+{
+    if (!image_loader_callbacks[loader->format].load_compressed) {
+        return QU_FAILURE;
+    }
+
+    return image_loader_callbacks[loader->format].load_compressed(loader, data);
+}
+
 //------------------------------------------------------------------------------
 // Audio format: Wave
 
@@ -29,12 +29,28 @@
 
 //------------------------------------------------------------------------------
 
+// Images from container files which are larger are rejected.
+#define QU_MAX_IMAGE_DIMENSION 16384
+
+//------------------------------------------------------------------------------
+
 typedef enum qu_image_loader_format
 {
+    QU_IMAGE_LOADER_DDS,
+    QU_IMAGE_LOADER_KTX2,
     QU_IMAGE_LOADER_STBI,
     QU_TOTAL_IMAGE_LOADERS,
 } qu_image_loader_format;
 
+typedef enum qu_image_compression
+{
+    QU_IMAGE_COMPRESSION_NONE,
+    QU_IMAGE_COMPRESSION_BC1,
+    QU_IMAGE_COMPRESSION_BC3,
+    QU_IMAGE_COMPRESSION_BC7,
+    QU_TOTAL_IMAGE_COMPRESSIONS,
+} qu_image_compression;
+
 typedef enum qu_audio_loader_format
 {
     QU_AUDIO_LOADER_WAVE,
@@ -50,6 +66,10 @@ typedef struct qu_image_loader
     int height;
     int channels;
 
+    // Block-compressed images are either loaded as is,
+    // or decompressed to RGBA on CPU.
+    qu_image_compression compression;
+
     qu_file *file;
     void *context;
 } qu_image_loader;
@@ -71,6 +91,9 @@ typedef struct qu_audio_loader
 qu_image_loader *qu_open_image_loader(qu_file *file);
 void qu_close_image_loader(qu_image_loader *loader);
 qu_result qu_image_loader_load(qu_image_loader *loader, unsigned char *pixels);
+qu_result qu_image_loader_load_compressed(qu_image_loader *loader, void *data);
+size_t qu_get_pixel_data_size(int width, int height, int channels);
+size_t qu_get_compressed_image_size(qu_image_compression compression, int width, int height);
 
 qu_audio_loader *qu_open_audio_loader(qu_file *file);
 void qu_close_audio_loader(qu_audio_loader *loader);
@@ -46,7 +46,6 @@ struct text_draw_state
 {
     float x_current;
     float y_current;
-    float *vertices;
     int count;
     qu_color color;
 };
@@ -413,26 +412,18 @@ static void draw_glyph_callback(struct font *font, struct glyph *glyph, void *da
     float s1 = glyph->s1 / (float) font->atlas.width;
     float t1 = glyph->t1 / (float) font->atlas.height;
 
-    maintain_vertex_buffer(24 * (state->count + 100));
+    maintain_vertex_buffer(16 * (state->count + 100));
 
-    float *v;
-
-    if (state->vertices) {
-        v = state->vertices;
-    } else {
-        v = impl.vertex_buffer;
-    }
+    // Buffer may be moved when it grows, so don't keep pointers into it.
+    float *v = impl.vertex_buffer + 16 * state->count;
 
     *v++ = x0;  *v++ = y0;  *v++ = s0;  *v++ = t0;
     *v++ = x1;  *v++ = y0;  *v++ = s1;  *v++ = t0;
     *v++ = x1;  *v++ = y1;  *v++ = s1;  *v++ = t1;
-    *v++ = x1;  *v++ = y1;  *v++ = s1;  *v++ = t1;
     *v++ = x0;  *v++ = y1;  *v++ = s0;  *v++ = t1;
-    *v++ = x0;  *v++ = y0;  *v++ = s0;  *v++ = t0;
 
     state->x_current += glyph->x_advance;
     state->y_current += glyph->y_advance;
-    state->vertices = v;
     state->count++;
 }
 
@@ -440,7 +431,7 @@ static void draw_text_callback(struct font *font, void *data)
 {
     struct text_draw_state *state = (struct text_draw_state *) data;
 
-    qu_draw_font(font->atlas.texture, state->color, impl.vertex_buffer, 6 * state->count);
+    qu_draw_font(font->atlas.texture, state->color, impl.vertex_buffer, 4 * state->count);
 }
 
 static qu_result process_text(int32_t font_id, char const *text, void *data,
@@ -634,7 +625,6 @@ void qu_draw_text(qu_font font, float x, float y, qu_color color, char const *st
     struct text_draw_state state = {
         .x_current = x,
         .y_current = y,
-        .vertices = NULL,
         .count = 0,
         .color = color,
     };